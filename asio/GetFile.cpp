@@ -2,15 +2,25 @@
 #include <boost/asio/ssl.hpp>
 
 #include "GetFile.hpp"
+#include "dns_cache.hpp"
+#include "fd_sink.hpp"
+#include "happy_eyeballs.hpp"
 #include "headers.hpp"
+#include "http_cache.hpp"
 #include "http_client.hpp"
+#include "metrics.hpp"
+#include "multipart.hpp"
 #include "proxy_tunnel_client.hpp"
+#include "session.hpp"
+#include "tls_session_cache.hpp"
 #include "user_agent.hpp"
 
 #include <ss1x/asio/utility.hpp>
 
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -34,42 +44,96 @@ int & ptc_deadline_timer_wait()
     return ::detail::ss1x_asio_ptc_deadline_wait_secends();
 }
 
+onStats_t & ptc_on_stats()
+{
+    static onStats_t func;
+    return func;
+}
+
+http_cache* & ptc_http_cache()
+{
+    static http_cache* p_cache = nullptr;
+    return p_cache;
+}
+
 namespace detail {
 
+request_stats& last_stats()
+{
+    static thread_local request_stats stats;
+    return stats;
+}
+
+void report_stats(const request_stats& stats, const boost::system::error_code& ec,
+                  unsigned int status_code)
+{
+    last_stats() = stats;
+    record_request_metrics(stats, ec, status_code);
+    if (ptc_on_stats()) {
+        ptc_on_stats()(stats);
+    }
+}
+
+/**
+ * @brief 执行一次同步请求；无论成败，都把 stats 与结果记入 last_stats() 和指标
+ *
+ * @param fn 形如 void(request_stats& stats, unsigned int& status_code)；
+ *           失败时抛出 boost::system::system_error，本函数记录之后原样抛出
+ */
+template <typename Func>
+void reportedRequest(Func&& fn)
+{
+    request_stats stats;
+    unsigned int  status_code = 0;
+    try {
+        fn(stats, status_code);
+    }
+    catch (const boost::system::system_error& e) {
+        stats.finish = request_stats::now();
+        report_stats(stats, e.code(), status_code);
+        throw;
+    }
+    stats.finish = request_stats::now();
+    report_stats(stats, boost::system::error_code(), status_code);
+}
+
+// 经由 session 的请求，结束时写入 last_stats()
+void attach_stats(request_options& options)
+{
+    options.stats    = &last_stats();
+    options.on_stats = ptc_on_stats();
+}
+
 /**
  * @brief 发送文件、信息
  *
+ * @param out        响应的 body
  * @param headers
  * @param serverName
  * @param getCommand
  * @param port
+ * @param form       各字段与文件
  *
  * https://imququ.com/post/four-ways-to-post-data-in-http.html
- * 貌似只能一个一个文件地来，不是整体打包！
- * 相当于包装了一下post数据而已；
- *
- * 那么，相关的数据主要有：
+ * 多个文件、字段，打包在同一个 multipart/form-data 请求中：
  *
- * 1. 服务器域名+端口
- * 2. post命令
- * 3. 文件路径
  * Content-Type: multipart/form-data;
  * boundary=---------------------------2473929242097947597857883638
+ *
+ * Content-Length 由 form.size() 算出，不读文件；文件内容经 sendfile() 发送。
  * 另外，还可以post xml、json；以及url命令参数；
  * postXMLInner
  * postJSONInner
  * postParamsInner
  */
-void postFileInner(ss1x::http::Headers* headers, const std::string& serverName,
-                   const std::string& getCommand, int port)
+void postFileImpl(request_stats& stats, unsigned int& status_code,
+                  std::ostream& out, ss1x::http::Headers* headers,
+                  const std::string& serverName, const std::string& getCommand, int port,
+                  const multipart_form& form)
 {
-    char service_port[24] = "";
     if (port <= 0) {
         port = 80;
     }
-    if (port > 0) {
-        sprintf(service_port, "%d", port);
-    }
 
     // std::cout << __func__ << SSS_VALUE_MSG(serverName) << std::endl;
     // std::cout << __func__ << SSS_VALUE_MSG(getCommand) << std::endl;
@@ -80,44 +144,60 @@ void postFileInner(ss1x::http::Headers* headers, const std::string& serverName,
     using boost::asio::ip::tcp;
     boost::asio::io_service io_service;
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver resolver(io_service);
-    tcp::resolver::query query(serverName, service_port);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-    tcp::resolver::iterator end;
+    stats.start     = request_stats::now();
+    stats.dns_start = stats.start;
 
-    // Try each endpoint until we successfully establish a connection.
+    // Get a list of endpoints corresponding to the server name.
+    boost::system::error_code resolve_ec;
+    auto endpoints = dns_cache::instance().resolve(io_service, serverName, port, resolve_ec);
+    stats.dns_done = request_stats::now();
+    if (resolve_ec) {
+        throw boost::system::system_error(resolve_ec);
+    }
+    // NOTE 多个地址并行尝试(Happy Eyeballs)，第一个连上的胜出
     tcp::socket socket(io_service);
-    boost::system::error_code error = boost::asio::error::host_not_found;
-    while (error && endpoint_iterator != end) {
-        socket.close();
-        socket.connect(*endpoint_iterator++, error);
+    boost::system::error_code error;
+    happy_eyeballs::connect(io_service, socket, endpoints.begin(), error);
+    if (error) {
+        throw boost::system::system_error(error);
     }
+    stats.connected = request_stats::now();
 
-    boost::asio::streambuf request;
-    std::ostream request_stream(&request);
+    std::ostringstream request_stream;
 
     request_stream << "POST " << getCommand << " HTTP/1.0\r\n";
-    request_stream << "Host: " << serverName
-                   << "\r\n";  // NOTE 实际使用中，端口号需要加在Host key后面
+    request_stream << "Host: " << serverName;
+    // NOTE 非默认端口，要加在 Host 后面
+    if (port != 80) {
+        request_stream << ':' << port;
+    }
+    request_stream << "\r\n";
     request_stream << "Accept: */*\r\n";
     request_stream << "User-Agent: " << USER_AGENT_DEFAULT << "\r\n";
-    request_stream << "Connection: keep-alive\r\n\r\n";
+    request_stream << "Content-Type: " << form.content_type() << "\r\n";
+    request_stream << "Content-Length: " << form.size() << "\r\n";
+    request_stream << "Connection: close\r\n\r\n";
 
     // TODO FIXME post 需要加上 Referer吗？
 
     // Send the request.
-    boost::asio::write(socket, request);
+    // NOTE 请求头与 body 一起，由 form 直接写 socket；文件内容不进用户态
+    socket.native_non_blocking(false);
+    stats.request_bytes = form.send(socket.native_handle(), request_stream.str(), error);
+    if (error) {
+        throw boost::system::system_error(error);
+    }
+    stats.request_sent  = request_stats::now();
 
     // Read the response status line.
     boost::asio::streambuf response;
-    boost::asio::read_until(socket, response, "\r\n");
+    stats.header_bytes = boost::asio::read_until(socket, response, "\r\n");
+    stats.first_byte   = request_stats::now();
 
     // Check that response is OK.
     std::istream response_stream(&response);
     std::string http_version;
     response_stream >> http_version;
-    unsigned int status_code = 0u;
     response_stream >> status_code;
     std::string status_message;
     std::getline(response_stream, status_message);
@@ -136,7 +216,9 @@ void postFileInner(ss1x::http::Headers* headers, const std::string& serverName,
     oss.str("");
 
     // Read the response headers, which are terminated by a blank line.
-    boost::asio::read_until(socket, response, "\r\n\r\n");
+    // NOTE 状态行已被 response_stream 取走，这里的长度，就是 header 块的长度
+    stats.header_bytes += boost::asio::read_until(socket, response, "\r\n\r\n");
+    stats.header_done   = request_stats::now();
 
     // Process the response headers.
     std::string header;
@@ -171,39 +253,45 @@ void postFileInner(ss1x::http::Headers* headers, const std::string& serverName,
     std::cout << oss.str() << std::endl;
 #endif
 
-    //// Write whatever content we already have to output.
-    // if (response.size() > 0)
-    //{
-    //    outFile << &response;
-    //}
-    //// Read until EOF, writing data to output as we go.
-    // while (boost::asio::read(socket, response,
-    // boost::asio::transfer_at_least(1), error))
-    //{
-    //    outFile << &response;
-    //}
+    // Write whatever content we already have to output.
+    stats.body_bytes = response.size();
+    if (response.size() > 0) {
+        out << &response;
+    }
+    // Read until EOF, writing data to output as we go.
+    while (size_t n = boost::asio::read(socket, response,
+                                        boost::asio::transfer_at_least(1), error)) {
+        stats.body_bytes += n;
+        out << &response;
+    }
+    stats.decoded_bytes = stats.body_bytes;
 }
 
-void getFileInner(std::ostream& outFile, ss1x::http::Headers* headers,
-                  const std::string& serverName, const std::string& getCommand,
-                  int port)
+void postFileInner(std::ostream& out, ss1x::http::Headers* headers,
+                   const std::string& serverName, const std::string& getCommand, int port,
+                   const multipart_form& form)
+{
+    reportedRequest([&](request_stats& stats, unsigned int& status_code) {
+        postFileImpl(stats, status_code, out, headers, serverName, getCommand, port, form);
+    });
+}
+
+// 响应头读完之后，由它接着读 body；response 中可能已经有部分 body。
+// 返回 body 的字节数
+typedef std::function<uint64_t(boost::asio::ip::tcp::socket& socket,
+                               boost::asio::streambuf&       response,
+                               const ss1x::http::Headers&    header)> body_reader_t;
+
+void getFileImpl(request_stats& stats, unsigned int& status_code,
+                 const body_reader_t& read_body, ss1x::http::Headers* headers,
+                 const std::string& serverName, const std::string& getCommand,
+                 int port)
 {
-    char service_port[24] = "";
     if (port <= 0) {
         port = 80;
     }
-    if (port > 0) {
-        sprintf(service_port, "%d", port);
-    }
 
-    std::unique_ptr<boost::asio::ssl::context> p_ctx;
-    ;
     bool use_ssl = (port == 443);
-    if (use_ssl) {
-        p_ctx.reset(
-            new boost::asio::ssl::context(boost::asio::ssl::context::tls_client));
-        p_ctx->set_default_verify_paths();
-    }
 
     // std::cout << __func__ << SSS_VALUE_MSG(serverName) << std::endl;
     // std::cout << __func__ << SSS_VALUE_MSG(getCommand) << std::endl;
@@ -215,29 +303,30 @@ void getFileInner(std::ostream& outFile, ss1x::http::Headers* headers,
     boost::asio::io_service io_service;
     boost::asio::io_service::work work(io_service);
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver resolver(io_service);
-    tcp::resolver::query query(serverName, service_port);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-    tcp::resolver::iterator end;
+    stats.start     = request_stats::now();
+    stats.dns_start = stats.start;
 
-    // Try each endpoint until we successfully establish a connection.
+    // Get a list of endpoints corresponding to the server name.
+    boost::system::error_code resolve_ec;
+    auto endpoints = dns_cache::instance().resolve(io_service, serverName, port, resolve_ec);
+    stats.dns_done = request_stats::now();
+    if (resolve_ec) {
+        throw boost::system::system_error(resolve_ec);
+    }
     // tcp::socket socket(io_service);
     ss1x::detail::socket_t socket(io_service);
     if (use_ssl) {
-        socket.upgrade_to_ssl(*p_ctx);
+        socket.upgrade_to_ssl(tls_session_cache::shared_context());
     }
 
-    boost::system::error_code error = boost::asio::error::host_not_found;
-    while (error && endpoint_iterator != end) {
-        if (use_ssl) {
-            // socket.get_ssl_socket().connect(*endpoint_iterator++, error);
-        }
-        else {
-            socket.get_socket().close();
-            socket.get_socket().connect(*endpoint_iterator++, error);
-        }
+    // NOTE 多个地址并行尝试(Happy Eyeballs)，第一个连上的胜出；ssl 与否，
+    // 建链都在底层的 tcp socket 上
+    boost::system::error_code error;
+    happy_eyeballs::connect(io_service, socket.get_socket(), endpoints.begin(), error);
+    if (error) {
+        throw boost::system::system_error(error);
     }
+    stats.connected = request_stats::now();
 
     boost::asio::streambuf request;
     std::ostream request_stream(&request);
@@ -249,17 +338,18 @@ void getFileInner(std::ostream& outFile, ss1x::http::Headers* headers,
     request_stream << "Connection: close\r\n\r\n";
 
     // Send the request.
-    boost::asio::write(socket.get_socket(), request);
+    stats.request_bytes = boost::asio::write(socket.get_socket(), request);
+    stats.request_sent  = request_stats::now();
 
     // Read the response status line.
     boost::asio::streambuf response;
-    boost::asio::read_until(socket.get_socket(), response, "\r\n");
+    stats.header_bytes = boost::asio::read_until(socket.get_socket(), response, "\r\n");
+    stats.first_byte   = request_stats::now();
 
     // Check that response is OK.
     std::istream response_stream(&response);
     std::string http_version;
     response_stream >> http_version;
-    unsigned int status_code = 0;
     response_stream >> status_code;
     std::string status_message;
     std::getline(response_stream, status_message);
@@ -278,25 +368,27 @@ void getFileInner(std::ostream& outFile, ss1x::http::Headers* headers,
     oss.str("");
 
     // Read the response headers, which are terminated by a blank line.
-    boost::asio::read_until(socket.get_socket(), response, "\r\n\r\n");
+    // NOTE 状态行已被 response_stream 取走，这里的长度，就是 header 块的长度
+    stats.header_bytes += boost::asio::read_until(socket.get_socket(), response, "\r\n\r\n");
+    stats.header_done   = request_stats::now();
 
     // Process the response headers.
+    // NOTE 调用者不要 header 时，也要解析出来，交给 read_body
+    ss1x::http::Headers local_headers;
+    if (!headers) {
+        headers = &local_headers;
+    }
     std::string header;
 #ifdef _ECHO_HTTP_HEADERS
     oss << "header begin:" << std::endl;
     oss << sss::Terminal::debug.data();
 #endif
-    if (headers) {
-        headers->status_code = status_code;
-        headers->http_version = http_version;
-    }
+    headers->status_code = status_code;
+    headers->http_version = http_version;
     while (std::getline(response_stream, header) && header != "\r") {
 #ifdef _ECHO_HTTP_HEADERS
         oss << header << std::endl;
 #endif
-        if (!headers) {
-            continue;
-        }
         size_t colon_pos = header.find(':');
         if (colon_pos == std::string::npos) {
             continue;
@@ -313,18 +405,155 @@ void getFileInner(std::ostream& outFile, ss1x::http::Headers* headers,
     std::cout << oss.str() << std::endl;
 #endif
 
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-        outFile << &response;
+    stats.body_bytes    = read_body(socket.get_socket(), response, *headers);
+    stats.decoded_bytes = stats.body_bytes;
+}
+
+void getFileInner(const body_reader_t& read_body, ss1x::http::Headers* headers,
+                  const std::string& serverName, const std::string& getCommand,
+                  int port)
+{
+    reportedRequest([&](request_stats& stats, unsigned int& status_code) {
+        getFileImpl(stats, status_code, read_body, headers, serverName, getCommand, port);
+    });
+}
+
+void getFileInner(std::ostream& outFile, ss1x::http::Headers* headers,
+                  const std::string& serverName, const std::string& getCommand,
+                  int port)
+{
+    getFileInner(
+        [&outFile](boost::asio::ip::tcp::socket& socket,
+                   boost::asio::streambuf&       response,
+                   const ss1x::http::Headers&) -> uint64_t {
+            uint64_t body_bytes = response.size();
+            // Write whatever content we already have to output.
+            if (response.size() > 0) {
+                outFile << &response;
+            }
+            // Read until EOF, writing data to output as we go.
+            boost::system::error_code error;
+            while (size_t n = boost::asio::read(socket, response,
+                                                boost::asio::transfer_at_least(1), error)) {
+                body_bytes += n;
+                outFile << &response;
+            }
+            return body_bytes;
+        },
+        headers, serverName, getCommand, port);
+}
+
+void getFileInner(int fd, ss1x::http::Headers* headers,
+                  const std::string& serverName, const std::string& getCommand,
+                  int port)
+{
+    getFileInner(
+        [fd](boost::asio::ip::tcp::socket& socket,
+             boost::asio::streambuf&       response,
+             const ss1x::http::Headers&    header) -> uint64_t {
+            fd_sink sink(fd);
+            // NOTE body 不解码，Content-Length 就是要写入的字节数；先预分配，
+            // 减少文件碎片。splice 不经过映射区，只有已读进 streambuf 的部分拷贝进去
+            const std::string length = header.get("Content-Length");
+            if (!length.empty()) {
+                boost::system::error_code ec;
+                sink.reserve(std::strtoull(length.c_str(), nullptr, 10), ec);
+            }
+            // NOTE 已经读进 streambuf 的部分，一次 pwritev 写出
+            if (response.size() > 0) {
+                sink.write_buffers(response.data());
+                response.consume(response.size());
+            }
+            // NOTE 请求是 HTTP/1.0 + Connection: close，body 直到 EOF；
+            // 其余部分经 pipe 从 socket 直接 splice 进 fd，不经过用户态
+            socket.native_non_blocking(false);
+            sink.splice_from(socket.native_handle(), std::numeric_limits<uint64_t>::max());
+            if (sink.error()) {
+                throw boost::system::system_error(sink.error());
+            }
+            return sink.written();
+        },
+        headers, serverName, getCommand, port);
+}
+
+// NOTE 同步的 getFileInner()、postFileInner() 只会明文 http；
+// https 经由 session，其他协议不支持
+bool via_session(const std::string& protocol)
+{
+    if (protocol == "https") {
+        return true;
     }
-    // Read until EOF, writing data to output as we go.
-    while (boost::asio::read(socket.get_socket(), response,
-                             boost::asio::transfer_at_least(1), error)) {
-        outFile << &response;
+    if (!protocol.empty() && protocol != "http") {
+        throw boost::system::system_error(
+            boost::system::errc::make_error_code(boost::system::errc::protocol_not_supported));
+    }
+    return false;
+}
+
+void sessionGetFile(std::ostream& outFile, ss1x::http::Headers& header,
+                    const std::string& url, request_options& options)
+{
+    attach_stats(options);
+    boost::system::error_code ec = session::default_session().get(outFile, header, url, options);
+    if (ec && ec != boost::asio::error::eof) {
+        throw boost::system::system_error(ec);
+    }
+}
+
+// 把 fd_sink 包装成 std::streambuf，供 session::get() 写入
+class fd_sink_buf : public std::streambuf
+{
+public:
+    explicit fd_sink_buf(fd_sink& sink) : m_sink(sink) {}
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        char ch = traits_type::to_char_type(c);
+        return m_sink.write(&ch, 1) ? c : traits_type::eof();
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override
+    {
+        return m_sink.write(s, size_t(n)) ? n : 0;
+    }
+
+private:
+    fd_sink& m_sink;
+};
+
+void sessionGetFile(int fd, ss1x::http::Headers& header, const std::string& url)
+{
+    fd_sink sink(fd);
+    request_options options;
+    // NOTE 未压缩且长度已知时，预分配并映射；之后每块 body 只是一次内存拷贝
+    options.on_header = [&sink](const ss1x::http::Headers& response) -> bool {
+        const std::string encoding = response.get("Content-Encoding");
+        const std::string length   = response.get("Content-Length");
+        if ((encoding.empty() || encoding == "identity") && !length.empty()) {
+            boost::system::error_code ec;
+            sink.reserve(std::strtoull(length.c_str(), nullptr, 10), ec);
+        }
+        return true;
+    };
+    fd_sink_buf  buf(sink);
+    std::ostream out(&buf);
+    sessionGetFile(out, header, url, options);
+    sink.finish();
+    if (sink.error()) {
+        throw boost::system::system_error(sink.error());
     }
 }
 }  // detail namespace
 
+const request_stats& last_request_stats()
+{
+    return detail::last_stats();
+}
+
 void getFile(std::ostream& outFile, const std::string& serverName,
              const std::string& getCommand, int port)
 {
@@ -340,23 +569,65 @@ void getFile(std::ostream& outFile, ss1x::http::Headers& header,
 
 void getFile(std::ostream& outFile, const std::string& url)
 {
-    std::string domain;
-    int port = 80;
-    std::string command;
-    std::tie(std::ignore, domain, port, command) = ss1x::util::url::split(url);
-    ss1x::asio::getFile(outFile, domain, command, port);
+    ss1x::http::Headers header;
+    ss1x::asio::getFile(outFile, header, url);
 }
 
 void getFile(std::ostream& outFile, ss1x::http::Headers& header,
              const std::string& url)
 {
+    std::string protocol;
     std::string domain;
     int port = 80;
     std::string command;
-    std::tie(std::ignore, domain, port, command) = ss1x::util::url::split(url);
+    std::tie(protocol, domain, port, command) = ss1x::util::url::split(url);
+    if (detail::via_session(protocol)) {
+        request_options options;
+        detail::sessionGetFile(outFile, header, url, options);
+        return;
+    }
     ss1x::asio::getFile(outFile, header, domain, command, port);
 }
 
+void getFile(int fd, ss1x::http::Headers& header, const std::string& url)
+{
+    std::string protocol;
+    std::string domain;
+    int port = 80;
+    std::string command;
+    std::tie(protocol, domain, port, command) = ss1x::util::url::split(url);
+    if (detail::via_session(protocol)) {
+        detail::sessionGetFile(fd, header, url);
+        return;
+    }
+    detail::getFileInner(fd, &header, domain, command, port);
+}
+
+void getFile(int fd, const std::string& url)
+{
+    ss1x::http::Headers header;
+    ss1x::asio::getFile(fd, header, url);
+}
+
+void postFile(std::ostream& out, ss1x::http::Headers& header, const std::string& url,
+              const multipart_form& form)
+{
+    std::string protocol;
+    std::string domain;
+    int port = 80;
+    std::string command;
+    std::tie(protocol, domain, port, command) = ss1x::util::url::split(url);
+    // NOTE sendfile() 只能用于明文连接；https 经由 session，body 按块加密发送
+    if (detail::via_session(protocol)) {
+        boost::system::error_code ec = redirectHttpPostForm(out, header, url, form);
+        if (ec && ec != boost::asio::error::eof) {
+            throw boost::system::system_error(ec);
+        }
+        return;
+    }
+    detail::postFileInner(out, &header, domain, command, port, form);
+}
+
 void proxyGetFile(std::ostream& outFile, const std::string& proxy_domain,
                   int proxy_port, const std::string& serverName,
                   const std::string& getCommand, int port)
@@ -426,34 +697,44 @@ boost::system::error_code redirectHttpPostCookie(
     CookieFunc_t&&             cookieFun,
     const ss1x::http::Headers& request_header)
 {
-    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_client);
-    ctx.set_default_verify_paths();
-    auto url_info = ss1x::util::url::split_port_auto(url);
+    request_options options;
+    options.header         = request_header;
+    options.use_cookie_jar = false;
+    options.cookie_func    = std::move(cookieFun);
+    detail::attach_stats(options);
+    return session::default_session().post(out, header, url, post_content, options);
+}
 
-    boost::asio::io_service io_service;
-    boost::asio::io_service::work work(io_service);
+boost::system::error_code redirectHttpPostFormCookie(
+    std::ostream&              out,
+    ss1x::http::Headers&       header,
+    const std::string&         url,
+    const multipart_form&      form,
+    CookieFunc_t&&             cookieFun,
+    const ss1x::http::Headers& request_header)
+{
+    boost::system::error_code ec;
+    std::shared_ptr<body_source> body = form.body(ec);
+    if (ec) {
+        return ec;
+    }
+    request_options options;
+    options.header                 = request_header;
+    options.header["Content-Type"] = form.content_type();
+    options.use_cookie_jar         = false;
+    options.cookie_func            = std::move(cookieFun);
+    detail::attach_stats(options);
+    return session::default_session().post(out, header, url, body, options);
+}
 
-    proxy_tunnel_client c(io_service, nullptr);
-    // c.max_redirect(0);
-    c.upgrade_to_ssl(ctx);
-    c.request_header() = request_header;
-    c.setOnFinished(
-        [&io_service]()->void{
-            io_service.stop();
-        });
-    c.setOnContent(
-        [&out](sss::string_view response) -> void { out << response; });
-    c.setCookieFunc(std::move(cookieFun));
-    c.http_post(url, post_content);
-    // 现有的实现，有少许问题，不能立即检测到此种连接方式(prox-https)的eof。
-    // 于是，额外提供了一种检查机制，以便快速返回。
-    // c.setOnEndCheck([](sss::string_view sv)-> bool { return
-    // sv.find("</html>") != sss::string_view::npos; });
-    io_service.run();
-    COLOG_DEBUG(SSS_VALUE_MSG(c.header().status_code));
-    header = c.header();
-
-    return c.error_code();
+boost::system::error_code redirectHttpPostForm(
+    std::ostream& out, ss1x::http::Headers& header, const std::string& url,
+    const multipart_form& form,
+    const ss1x::http::Headers& request_header)
+{
+    CookieFunc_t cookieFun;
+    return redirectHttpPostFormCookie(out, header, url, form, std::move(cookieFun),
+                                      request_header);
 }
 
 boost::system::error_code redirectHttpPost(
@@ -487,36 +768,13 @@ boost::system::error_code redirectHttpGetCookie(std::ostream& out,
                                                 CookieFunc_t&& cookieFun,
                                                 const ss1x::http::Headers& request_header)
 {
-    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_client);
-    ctx.set_default_verify_paths();
-    auto url_info = ss1x::util::url::split_port_auto(url);
-
-    boost::asio::io_service io_service;
-    boost::asio::io_service::work work(io_service);
-
-    proxy_tunnel_client c(io_service, nullptr);
-    // c.max_redirect(0);
-    c.upgrade_to_ssl(ctx);
-    c.request_header() = request_header;
-    c.setOnFinished(
-        [&io_service]()->void{
-            io_service.stop();
-        });
-    c.setOnContent(
-        [&out](sss::string_view response) -> void {
-            out << response;
-        });
-    c.setCookieFunc(std::move(cookieFun));
-    c.http_get(url);
-    // 现有的实现，有少许问题，不能立即检测到此种连接方式(prox-https)的eof。
-    // 于是，额外提供了一种检查机制，以便快速返回。
-    // c.setOnEndCheck([](sss::string_view sv)-> bool { return
-    // sv.find("</html>") != sss::string_view::npos; });
-    io_service.run();
-    COLOG_DEBUG(SSS_VALUE_MSG(c.header().status_code));
-    header = c.header();
-
-    return c.error_code();
+    request_options options;
+    options.header         = request_header;
+    options.use_cookie_jar = false;
+    options.cookie_func    = std::move(cookieFun);
+    options.cache          = ptc_http_cache();
+    detail::attach_stats(options);
+    return session::default_session().get(out, header, url, options);
 }
 
 boost::system::error_code proxyRedirectHttpGet(
@@ -535,39 +793,18 @@ boost::system::error_code proxyRedirectHttpGetCookie(
     CookieFunc_t&& cookieFun, const ss1x::http::Headers& request_header)
 {
     // TODO 可以用跟踪法，看看avhttp，是如何使用proxy的。
-    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_client);
-    ctx.set_default_verify_paths();
-    auto url_info = ss1x::util::url::split_port_auto(url);
-
-    boost::asio::io_service io_service;
-    boost::asio::io_service::work work(io_service);
-
-    proxy_tunnel_client c(io_service, nullptr);
-    c.upgrade_to_ssl(ctx);
-    c.request_header() = request_header;
-    c.setOnFinished(
-        [&io_service]()->void{
-            io_service.stop();
-        });
-    c.setOnContent(
-        [&out](sss::string_view response) -> void {
-            out << response;
-        });
-    c.setCookieFunc(std::move(cookieFun));
-    c.setSetCookieFunc(ss1x::cookie::set);
-    // 现有的实现，有少许问题，不能立即检测到此种连接方式(prox-https)的eof。
-    // 于是，额外提供了一种检查机制，以便快速返回。
-#if 1
-    c.setOnEndCheck([](sss::string_view sv) -> bool {
-        return sv.find("</html>") != sss::string_view::npos;
-    });
-#endif
-    c.ssl_tunnel_get(proxy_domain, proxy_port, url);
-    io_service.run();
-    COLOG_DEBUG(SSS_VALUE_MSG(c.header().status_code));
-    header = c.header();
-
-    return c.error_code();
+    request_options options;
+    options.header          = request_header;
+    options.proxy_domain    = proxy_domain;
+    options.proxy_port      = proxy_port;
+    options.use_cookie_jar  = false;
+    options.cookie_func     = std::move(cookieFun);
+    options.set_cookie_func = ss1x::cookie::set;
+    // NOTE 经由代理的 https，同样按 Content-Length/chunked 结束；不再需要
+    // 用 "</html>" 之类的标记来判断 body 是否完整
+    options.cache           = ptc_http_cache();
+    detail::attach_stats(options);
+    return session::default_session().get(out, header, url, options);
 }
 
 boost::system::error_code proxyRedirectHttpPost(
@@ -596,40 +833,17 @@ boost::system::error_code proxyRedirectHttpPostCookie(
     CookieFunc_t&& cookieFun, const ss1x::http::Headers& request_header)
 {
     // TODO 可以用跟踪法，看看avhttp，是如何使用proxy的。
-    boost::asio::ssl::context ctx(boost::asio::ssl::context::tls_client);
-    ctx.set_default_verify_paths();
-    auto url_info = ss1x::util::url::split_port_auto(url);
-
-    boost::asio::io_service io_service;
-    boost::asio::io_service::work work(io_service);
-
-    proxy_tunnel_client c(io_service, nullptr);
-    c.upgrade_to_ssl(ctx);
-    c.request_header() = request_header;
-    c.setOnFinished(
-        [&io_service]()->void{
-            io_service.stop();
-        });
-    c.setOnContent(
-        [&out](sss::string_view response) -> void {
-            out << response;
-        });
-    c.setCookieFunc(std::move(cookieFun));
-    c.setSetCookieFunc(ss1x::cookie::set);
-    // 现有的实现，有少许问题，不能立即检测到此种连接方式(prox-https)的eof。
-    // 于是，额外提供了一种检查机制，以便快速返回。
-#if 1
-    c.setOnEndCheck([](sss::string_view sv) -> bool {
-        return sv.find("</html>") != sss::string_view::npos;
-    });
-#endif
-    c.ssl_tunnel_post(proxy_domain, proxy_port, url, post_content);
-    io_service.run();
-    COLOG_DEBUG(SSS_VALUE_MSG(c.header().status_code));
-    header = c.header();
-
-    return c.error_code();
-
+    request_options options;
+    options.header          = request_header;
+    options.proxy_domain    = proxy_domain;
+    options.proxy_port      = proxy_port;
+    options.use_cookie_jar  = false;
+    options.cookie_func     = std::move(cookieFun);
+    options.set_cookie_func = ss1x::cookie::set;
+    // NOTE 经由代理的 https，同样按 Content-Length/chunked 结束；不再需要
+    // 用 "</html>" 之类的标记来判断 body 是否完整
+    detail::attach_stats(options);
+    return session::default_session().post(out, header, url, post_content, options);
 }
 
 //! http://boost.2283326.n4.nabble.com/boost-asio-SSL-connection-thru-proxy-server-td2586048.html
@@ -7,6 +7,7 @@
 
 #include "headers.hpp"
 #include "cookie.hpp"
+#include "request_stats.hpp"
 
 namespace boost {
 namespace system {
@@ -21,6 +22,16 @@ namespace asio {
 bool & ptc_colog_status();
 int & ptc_deadline_timer_wait();
 
+// NOTE 本线程最近一次 getFile()、redirectHttpGet() 等请求的各阶段耗时与字节数
+const request_stats& last_request_stats();
+// 非空时，上述函数的每个请求结束时调用；在发起请求之前设置
+onStats_t & ptc_on_stats();
+
+class http_cache;
+// NOTE 非空时，redirectHttpGet()、proxyRedirectHttpGet() 等 GET 请求经由该缓存；
+// 见 request_options::cache
+http_cache* & ptc_http_cache();
+
 void getFile(std::ostream& outFile, const std::string& serverName,
              const std::string& getCommand, int port = 80);
 
@@ -28,11 +39,27 @@ void getFile(std::ostream& outFile, ss1x::http::Headers& header,
              const std::string& serverName, const std::string& getCommand,
              int port = 80);
 
+// NOTE 以下按 url 的版本：https 经由 session::default_session()；
+// 除 http、https 之外的协议，抛出 protocol_not_supported
 void getFile(std::ostream& outFile, ss1x::http::Headers& header,
              const std::string& url);
 
 void getFile(std::ostream& outFile, const std::string& url);
 
+// body 直接写入文件描述符 fd(从偏移 0 开始，用 pwritev/splice)；
+// 不经过 std::ostream，明文 body 也不进用户态。Content-Length 已知时，
+// 先预分配；https 的 body 则拷贝进 mmap 的预分配区
+void getFile(int fd, ss1x::http::Headers& header, const std::string& url);
+
+void getFile(int fd, const std::string& url);
+
+class multipart_form;
+// multipart/form-data 上传；明文 http，文件内容经 sendfile() 直接发送。
+// body 只有 Content-Length，不读入内存；响应的 body 写入 out。
+// https 的 url 转给 redirectHttpPostForm()；其他协议抛出异常
+void postFile(std::ostream& out, ss1x::http::Headers& header, const std::string& url,
+              const multipart_form& form);
+
 void proxyGetFile(std::ostream& outFile, const std::string& proxy_domain,
                   int proxy_port, const std::string& serverName,
                   const std::string& getCommand, int port = 80);
@@ -68,6 +95,20 @@ boost::system::error_code redirectHttpPost(
     const std::string& post_content,
     const ss1x::http::Headers& request_header = {});
 
+// 同 postFile()，但经由 session：支持 https 与跳转；文件按块读出再发送
+boost::system::error_code redirectHttpPostForm(
+    std::ostream& out, ss1x::http::Headers& header, const std::string& url,
+    const multipart_form& form,
+    const ss1x::http::Headers& request_header = {});
+
+boost::system::error_code redirectHttpPostFormCookie(
+    std::ostream&              out,
+    ss1x::http::Headers&       header,
+    const std::string&         url,
+    const multipart_form&      form,
+    CookieFunc_t&&             cookieFun,
+    const ss1x::http::Headers& request_header = {});
+
 boost::system::error_code redirectHttpPostCookie(
     std::ostream&              out,
     ss1x::http::Headers&       header,
@@ -0,0 +1,200 @@
+// ss1x/asio/body_source.cpp
+#include "body_source.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+const size_t body_block_size = 64 * 1024;
+
+class memory_body : public body_source
+{
+public:
+    explicit memory_body(sss::string_view data) : m_data(data), m_done(false) {}
+
+    explicit memory_body(std::string&& data)
+        : m_owned(std::move(data)), m_data(m_owned), m_done(false)
+    {}
+
+    int64_t size() const override { return int64_t(m_data.size()); }
+
+    bool rewind() override
+    {
+        m_done = false;
+        return true;
+    }
+
+    boost::asio::const_buffer next(boost::system::error_code& ec) override
+    {
+        ec.clear();
+        if (m_done) {
+            return boost::asio::const_buffer();
+        }
+        m_done = true;
+        return boost::asio::buffer(m_data.data(), m_data.size());
+    }
+
+private:
+    std::string      m_owned;
+    sss::string_view m_data;
+    bool             m_done;
+};
+
+class file_body : public body_source
+{
+public:
+    file_body(int fd, uint64_t offset, int64_t size, bool own_fd)
+        : m_fd(fd), m_own_fd(own_fd), m_begin(offset), m_size(size), m_read(0),
+          m_seekable(true)
+    {
+        struct stat st;
+        if (::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (m_size < 0) {
+                m_size = st.st_size > int64_t(m_begin) ? st.st_size - int64_t(m_begin) : 0;
+            }
+        }
+        else {
+            m_seekable = false;
+        }
+    }
+
+    ~file_body()
+    {
+        if (m_own_fd && m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    int64_t size() const override { return m_size; }
+
+    bool rewind() override
+    {
+        if (!m_seekable) {
+            return m_read == 0;
+        }
+        m_read = 0;
+        return true;
+    }
+
+    boost::asio::const_buffer next(boost::system::error_code& ec) override
+    {
+        ec.clear();
+        size_t want = body_block_size;
+        if (m_size >= 0) {
+            want = size_t(std::min<uint64_t>(want, uint64_t(m_size) - m_read));
+        }
+        if (!want) {
+            return boost::asio::const_buffer();
+        }
+        m_buffer.resize(body_block_size);
+        for (;;) {
+            ssize_t n = m_seekable ? ::pread(m_fd, &m_buffer[0], want, off_t(m_begin + m_read))
+                                   : ::read(m_fd, &m_buffer[0], want);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                ec = boost::system::error_code(errno, boost::system::system_category());
+                COLOG_ERROR(SSS_VALUE_MSG(m_fd), ec.message());
+                return boost::asio::const_buffer();
+            }
+            // NOTE 长度已知而提前读到文件尾(文件被截短)，由 client 报告 body_size_mismatch
+            m_read += uint64_t(n);
+            return boost::asio::buffer(m_buffer.data(), size_t(n));
+        }
+    }
+
+private:
+    int               m_fd;
+    bool              m_own_fd;
+    uint64_t          m_begin;
+    int64_t           m_size;
+    uint64_t          m_read;
+    bool              m_seekable;
+    std::vector<char> m_buffer;
+};
+
+class generator_body : public body_source
+{
+public:
+    generator_body(body_generator_t&& generator, int64_t size)
+        : m_generator(std::move(generator)), m_size(size), m_started(false), m_done(false)
+    {}
+
+    int64_t size() const override { return m_size; }
+
+    bool rewind() override { return !m_started; }
+
+    boost::asio::const_buffer next(boost::system::error_code& ec) override
+    {
+        ec.clear();
+        if (m_done) {
+            return boost::asio::const_buffer();
+        }
+        m_started = true;
+        m_buffer.resize(body_block_size);
+        size_t n = m_generator(&m_buffer[0], m_buffer.size(), ec);
+        if (ec || !n) {
+            m_done = true;
+            return boost::asio::const_buffer();
+        }
+        return boost::asio::buffer(m_buffer.data(), std::min(n, m_buffer.size()));
+    }
+
+private:
+    body_generator_t  m_generator;
+    int64_t           m_size;
+    bool              m_started;
+    bool              m_done;
+    std::vector<char> m_buffer;
+};
+
+} // namespace detail
+
+std::shared_ptr<body_source> make_memory_body(sss::string_view data)
+{
+    return std::make_shared<detail::memory_body>(data);
+}
+
+std::shared_ptr<body_source> make_string_body(std::string data)
+{
+    return std::make_shared<detail::memory_body>(std::move(data));
+}
+
+std::shared_ptr<body_source> make_file_body(int fd, uint64_t offset, int64_t size, bool own_fd)
+{
+    return std::make_shared<detail::file_body>(fd, offset, size, own_fd);
+}
+
+std::shared_ptr<body_source> make_file_body(const std::string& path,
+                                            boost::system::error_code& ec)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ec = boost::system::error_code(errno, boost::system::system_category());
+        COLOG_ERROR(SSS_VALUE_MSG(path), ec.message());
+        return std::shared_ptr<body_source>();
+    }
+    ec.clear();
+    return std::make_shared<detail::file_body>(fd, 0, -1, true);
+}
+
+std::shared_ptr<body_source> make_generator_body(body_generator_t generator, int64_t size)
+{
+    return std::make_shared<detail::generator_body>(std::move(generator), size);
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,79 @@
+// ss1x/asio/body_source.hpp
+#pragma once
+
+#include <sss/string_view.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 请求 body 的来源；client 逐块取出，直接写 socket，不整体拷贝
+ *
+ * - size() 已知(>= 0)时，以 Content-Length 发送；否则以
+ *   Transfer-Encoding: chunked 发送，每次 next() 的结果是一个 chunk；
+ * - next() 返回的 buffer，在下一次调用 next()/rewind() 之前有效；
+ *   返回空 buffer 表示结束；出错时设置 ec；
+ * - 跳转、池中连接失效重发时，client 先 rewind()；不能从头再读的来源，
+ *   返回 false，请求以 body_not_rewindable 结束。
+ *
+ * NOTE 本身不加锁；同一时刻只应由一个请求读取。
+ */
+class body_source
+{
+public:
+    virtual ~body_source() {}
+
+    // body 的总长度；未知时为 -1
+    virtual int64_t size() const = 0;
+
+    virtual bool rewind() = 0;
+
+    virtual boost::asio::const_buffer next(boost::system::error_code& ec) = 0;
+};
+
+// 生成 body 的回调：向 buf 写入至多 size 字节，返回写入的字节数；返回 0 表示结束
+typedef std::function<size_t(char* buf, size_t size, boost::system::error_code& ec)>
+    body_generator_t;
+
+/**
+ * @brief 一段内存；整段作为一块发出，不拷贝
+ *
+ * NOTE data 指向的内存，要一直有效到请求结束
+ */
+std::shared_ptr<body_source> make_memory_body(sss::string_view data);
+
+// 持有 data(可以移动进来)；调用者不必保持其有效
+std::shared_ptr<body_source> make_string_body(std::string data);
+
+/**
+ * @brief 从文件描述符的 offset 处，读取 size 字节；size 为 -1 时，读到文件尾
+ *
+ * 普通文件且 size 为 -1 时，用 fstat() 得到长度，仍以 Content-Length 发送；
+ * 管道之类，长度未知，以 chunked 发送，也不能 rewind()。
+ * 按 pread() 读取，不改变 fd 的文件偏移。
+ */
+std::shared_ptr<body_source> make_file_body(int fd, uint64_t offset = 0, int64_t size = -1,
+                                            bool own_fd = false);
+
+// 打开 path；失败时返回空指针，并设置 ec
+std::shared_ptr<body_source> make_file_body(const std::string& path,
+                                            boost::system::error_code& ec);
+
+/**
+ * @brief 由回调逐块生成；size 未知时(-1)以 chunked 发送
+ *
+ * 只能 rewind() 到还没有取过数据的状态；于是遇到跳转、重发，请求会失败。
+ */
+std::shared_ptr<body_source> make_generator_body(body_generator_t generator,
+                                                 int64_t size = -1);
+
+} // namespace asio
+} // namespace ss1x
@@ -3,6 +3,9 @@
 
 #include <sss/debug/value_msg.hpp>
 #include <ss1x/asio/error_codec.hpp>
+#include <ss1x/asio/metrics.hpp>
+
+#include <chrono>
 
 #include <boost/asio/error.hpp>
 
@@ -21,18 +24,25 @@ int brstream::inflate(const char * data, size_t size, error_code_type * p_ec)
         return 0;
     }
 
+    static const ss1x::asio::decoder_metrics s_metrics("br");
+
     int bytes_transferred = 0;
     char * buffer         = &m_buffer[0];
     size_t available_out  = m_buffer.size();
+    const size_t input    = size;
+    // NOTE 只计解码本身的耗时；on_avail_out() 中是消费者的处理
+    std::chrono::steady_clock::duration elapsed(0);
 
     while (size != 0 && m_state == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
     {
+        auto begin = std::chrono::steady_clock::now();
         m_state
             = ::BrotliDecoderDecompressStream(
                 m_ptr_dec,
                 &size, reinterpret_cast<const uint8_t**>(&data),
                 &available_out, reinterpret_cast<uint8_t**>(&buffer),
                 0);
+        elapsed += std::chrono::steady_clock::now() - begin;
 
         switch (m_state)
         {
@@ -73,6 +83,8 @@ int brstream::inflate(const char * data, size_t size, error_code_type * p_ec)
         }
     } // while
 
+    s_metrics.record(input - size, bytes_transferred,
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
     return bytes_transferred;
 }
 
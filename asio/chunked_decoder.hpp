@@ -0,0 +1,200 @@
+// ss1x/asio/chunked_decoder.hpp
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//! https://www.rfc-editor.org/rfc/rfc9112#section-7.1
+// chunked-body   = *chunk
+//                  last-chunk
+//                  trailer-section
+//                  CRLF
+//
+// chunk          = chunk-size [ chunk-ext ] CRLF
+//                  chunk-data CRLF
+// last-chunk     = 1*("0") [ chunk-ext ] CRLF
+
+namespace ss1x {
+namespace detail {
+
+/**
+ * @brief 可续的 chunked transfer-encoding 解码器；不分配内存
+ *
+ * 每次 feed() 把传入的字节尽量处理完：chunk-size 的 16 进制数逐字节累加，
+ * chunk-ext 以及 trailer 用 memchr 跳过；状态保存在对象中，所以 CRLF、
+ * chunk-size 被切在两次读取之间，也没有关系。
+ *
+ * 每个 chunk 的数据，以原 buffer 中连续的片段交给 on_payload(data, size)；
+ * 一个 chunk 跨两次读取时，分两次交出。
+ *
+ * NOTE 行结束符容忍单独的 '\n'。
+ */
+class chunked_decoder
+{
+public:
+    enum state_t {
+        st_size,         // chunk-size 的 16 进制数字
+        st_size_line,    // chunk-size 之后，直到行尾(包括 chunk-ext)
+        st_data,         // chunk-data
+        st_data_cr,      // chunk-data 之后的 CR
+        st_data_lf,      // chunk-data 之后的 LF
+        st_trailer,      // last-chunk 之后，trailer 行的行首
+        st_trailer_line, // trailer 行的其余部分
+        st_last_lf,      // 结尾空行的 LF
+        st_done,
+        st_error
+    };
+
+    chunked_decoder() { this->reset(); }
+
+    void reset()
+    {
+        m_state  = st_size;
+        m_remain = 0;
+        m_digits = 0;
+    }
+
+    bool done()  const { return m_state == st_done;  }
+    bool error() const { return m_state == st_error; }
+
+    state_t state() const { return m_state; }
+
+    // 当前 chunk 中，尚未收到的数据字节数
+    uint64_t remain() const { return m_remain; }
+
+    /**
+     * @return 消耗的字节数；done() 之后的数据，不会被消耗
+     */
+    template <typename OnPayload>
+    size_t feed(const char* data, size_t size, OnPayload&& on_payload)
+    {
+        const char* p   = data;
+        const char* end = data + size;
+        while (p < end) {
+            switch (m_state) {
+            case st_size: {
+                int v = hex_value(*p);
+                if (v < 0) {
+                    if (!m_digits) {
+                        return this->fail(p - data);
+                    }
+                    m_state = st_size_line;
+                    break;
+                }
+                // NOTE 最多 15 个 16 进制数字，不会溢出
+                if (++m_digits > 15) {
+                    return this->fail(p - data);
+                }
+                m_remain = (m_remain << 4) | uint64_t(v);
+                ++p;
+                break;
+            }
+
+            case st_size_line: {
+                const char* lf = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                if (!lf) {
+                    p = end;
+                    break;
+                }
+                p        = lf + 1;
+                m_digits = 0;
+                m_state  = m_remain ? st_data : st_trailer;
+                break;
+            }
+
+            case st_data: {
+                size_t n = size_t(std::min<uint64_t>(m_remain, uint64_t(end - p)));
+                on_payload(p, n);
+                p        += n;
+                m_remain -= n;
+                if (!m_remain) {
+                    m_state = st_data_cr;
+                }
+                break;
+            }
+
+            case st_data_cr:
+                if (*p == '\r') {
+                    ++p;
+                }
+                m_state = st_data_lf;
+                break;
+
+            case st_data_lf:
+                if (*p != '\n') {
+                    return this->fail(p - data);
+                }
+                ++p;
+                m_state = st_size;
+                break;
+
+            case st_trailer:
+                if (*p == '\r') {
+                    ++p;
+                    m_state = st_last_lf;
+                }
+                else if (*p == '\n') {
+                    ++p;
+                    m_state = st_done;
+                    return p - data;
+                }
+                else {
+                    m_state = st_trailer_line;
+                }
+                break;
+
+            case st_trailer_line: {
+                const char* lf = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                if (!lf) {
+                    p = end;
+                    break;
+                }
+                p       = lf + 1;
+                m_state = st_trailer;
+                break;
+            }
+
+            case st_last_lf:
+                if (*p != '\n') {
+                    return this->fail(p - data);
+                }
+                ++p;
+                m_state = st_done;
+                return p - data;
+
+            case st_done:
+            case st_error:
+                return p - data;
+            }
+        }
+        return p - data;
+    }
+
+private:
+    static int hex_value(char c)
+    {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        c |= 0x20;
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+    size_t fail(size_t consumed)
+    {
+        m_state = st_error;
+        return consumed;
+    }
+
+    state_t  m_state;
+    uint64_t m_remain;
+    int      m_digits;
+};
+
+} // namespace detail
+} // namespace ss1x
@@ -0,0 +1,121 @@
+// ss1x/asio/co_session.cpp
+#include "co_session.hpp"
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+body_stream::body_stream(boost::asio::io_service& io_service, size_t window)
+    : m_io_service(io_service),
+      m_finished(false),
+      m_flow(std::make_shared<content_flow>(window))
+{
+}
+
+void body_stream::read(read_handler_t&& handler)
+{
+    std::string               data;
+    boost::system::error_code ec;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_buffer.empty() && !m_finished) {
+            m_reader = std::move(handler);
+            return;
+        }
+        data.swap(m_buffer);
+        // NOTE 先交出已缓存的字节；结束的消息，留给下一次读取
+        if (data.empty()) {
+            ec = m_ec;
+        }
+    }
+    if (!data.empty()) {
+        m_flow->release(data.size());
+    }
+    handler(ec, std::move(data));
+}
+
+void body_stream::push(sss::string_view data)
+{
+    if (data.empty()) {
+        return;
+    }
+    read_handler_t reader;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_reader) {
+            m_buffer.append(data.data(), data.size());
+            return;
+        }
+        reader.swap(m_reader);
+    }
+    // 有读者在等，直接交出；credit 随即归还
+    m_flow->release(data.size());
+    reader(boost::system::error_code(), std::string(data.data(), data.size()));
+}
+
+void body_stream::finish(const boost::system::error_code& ec)
+{
+    read_handler_t reader;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_finished) {
+            return;
+        }
+        m_finished = true;
+        // NOTE chunked 或者读到连接关闭的响应，正常结束时报告的是 eof
+        m_ec = ec ? ec : boost::system::error_code(boost::asio::error::eof);
+        if (!m_reader || !m_buffer.empty()) {
+            return;
+        }
+        reader.swap(m_reader);
+    }
+    reader(m_ec, std::string());
+}
+
+void open_stream(session& sess, const std::string& url, const request_options& options,
+                 size_t window, open_handler_t&& on_open)
+{
+    std::shared_ptr<body_stream>    body   = std::make_shared<body_stream>(sess.get_io_service(), window);
+    std::shared_ptr<open_handler_t> p_open = std::make_shared<open_handler_t>(std::move(on_open));
+
+    request_options inner = options;
+    inner.flow            = body->flow();
+    proxy_tunnel_client::onHeader_t on_header = options.on_header;
+    inner.on_header = [body, p_open, on_header](const ss1x::http::Headers& header) -> bool {
+        if (on_header && !on_header(header)) {
+            return false;
+        }
+        open_handler_t func;
+        func.swap(*p_open);
+        stream_response response;
+        response.header = header;
+        response.body   = body;
+        func(boost::system::error_code(), std::move(response));
+        return true;
+    };
+
+    sess.async_get(
+        url,
+        [body](sss::string_view data) -> void { body->push(data); },
+        [body, p_open](const boost::system::error_code& ec,
+                       const ss1x::http::Headers& header) -> void {
+            body->finish(ec);
+            // header 之前就失败了
+            if (*p_open) {
+                COLOG_DEBUG(SSS_VALUE_MSG(header.status_code), ec);
+                open_handler_t func;
+                func.swap(*p_open);
+                stream_response response;
+                response.header = header;
+                response.body   = body;
+                func(ec ? ec : boost::system::error_code(boost::asio::error::operation_aborted),
+                     std::move(response));
+            }
+        },
+        inner);
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,228 @@
+// ss1x/asio/co_session.hpp
+#pragma once
+
+#include <ss1x/asio/session.hpp>
+#include <ss1x/asio/content_flow.hpp>
+#include <ss1x/asio/headers.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 拉取式的 body：消费者读一块，client 才补一块
+ *
+ * session 把解码之后的 body 推进来；缓存的字节数达到 window，就通过
+ * content_flow 让 client 暂停读 socket，直到消费者取走。
+ * 读到结尾时，读取得到的错误码为 eof；请求失败时，为失败的原因。
+ * 同一时刻，只能有一个未完成的读取。各个成员函数都是线程安全的。
+ */
+class body_stream
+{
+public:
+    typedef std::function<void(const boost::system::error_code& ec, std::string data)>
+        read_handler_t;
+
+    static const size_t default_window = 256 * 1024;
+
+    // NOTE 没有关联 executor 的 handler(比如普通回调)，由 io_service 调用
+    explicit body_stream(boost::asio::io_service& io_service, size_t window = default_window);
+
+    body_stream(const body_stream&) = delete;
+    body_stream& operator=(const body_stream&) = delete;
+
+    // 取走目前缓存的全部字节；没有时，等到有数据或者结束；handler 可能在
+    // 本函数内直接调用
+    void read(read_handler_t&& handler);
+
+    // 完成签名 void(boost::system::error_code, std::string)；handler 经由其
+    // 关联的 executor 调用
+    template <typename CompletionToken>
+    BOOST_ASIO_INITFN_AUTO_RESULT_TYPE(CompletionToken,
+                                       void(boost::system::error_code, std::string))
+    async_read(CompletionToken&& token);
+
+    const std::shared_ptr<content_flow>& flow() const { return m_flow; }
+
+public:
+    // NOTE 以下由 session 的回调调用
+    void push(sss::string_view data);
+    void finish(const boost::system::error_code& ec);
+
+private:
+    struct initiate_read;
+
+    boost::asio::io_service&      m_io_service;
+    std::mutex                    m_lock;
+    std::string                   m_buffer;
+    bool                          m_finished;
+    boost::system::error_code     m_ec;
+    read_handler_t                m_reader;
+    std::shared_ptr<content_flow> m_flow;
+};
+
+// async_get 的结果；header 读完即完成，body 随后从 body 中读取
+struct stream_response
+{
+    ss1x::http::Headers          header;
+    std::shared_ptr<body_stream> body;
+};
+
+typedef std::function<void(const boost::system::error_code& ec, stream_response response)>
+    open_handler_t;
+
+/**
+ * @brief 发起 GET；最终响应的 header 读完时(或者请求失败时)调用 on_open
+ *
+ * on_open 在 client 的回调中调用。options.flow 被 body_stream 自己的取代；
+ * options.on_header 仍然先被调用，返回 false 时，结果为 operation_aborted。
+ */
+void open_stream(session& sess, const std::string& url, const request_options& options,
+                 size_t window, open_handler_t&& on_open);
+
+namespace detail {
+
+// NOTE asio 的 handler 可能只能移动，而 session 的回调是 std::function，要求
+// 可复制；所以放在 shared_ptr 中。完成时，经由 handler 关联的 executor 调用，
+// 期间用 work guard 保持该 executor 不退出
+template <typename Handler, typename Result>
+class shared_handler_t
+{
+public:
+    typedef typename boost::asio::associated_executor<
+        Handler, boost::asio::io_service::executor_type>::type executor_type;
+
+    shared_handler_t(Handler&& handler, boost::asio::io_service& io_service)
+        : m_state(std::make_shared<state_t>(std::move(handler), io_service))
+    {}
+
+    void operator()(const boost::system::error_code& ec, Result result) const
+    {
+        std::shared_ptr<state_t> state = m_state;
+        boost::asio::post(state->work.get_executor(),
+                          [state, ec, result]() mutable -> void {
+                              state->handler(ec, std::move(result));
+                              state->work.reset();
+                          });
+    }
+
+private:
+    struct state_t
+    {
+        state_t(Handler&& h, boost::asio::io_service& io_service)
+            : work(boost::asio::get_associated_executor(h, io_service.get_executor())),
+              handler(std::move(h))
+        {}
+
+        boost::asio::executor_work_guard<executor_type> work;
+        Handler                                         handler;
+    };
+
+    std::shared_ptr<state_t> m_state;
+};
+
+struct initiate_get
+{
+    template <typename Handler>
+    void operator()(Handler&& handler, session* p_sess, const std::string& url,
+                    const request_options& options, size_t window) const
+    {
+        typedef typename std::decay<Handler>::type handler_type;
+        shared_handler_t<handler_type, stream_response> func(
+            handler_type(std::forward<Handler>(handler)), p_sess->get_io_service());
+        open_stream(*p_sess, url, options, window, func);
+    }
+};
+
+} // namespace detail
+
+struct body_stream::initiate_read
+{
+    template <typename Handler>
+    void operator()(Handler&& handler, body_stream* p_body,
+                    boost::asio::io_service* p_io_service) const
+    {
+        typedef typename std::decay<Handler>::type handler_type;
+        detail::shared_handler_t<handler_type, std::string> func(
+            handler_type(std::forward<Handler>(handler)), *p_io_service);
+        p_body->read(func);
+    }
+};
+
+/**
+ * @brief 异步 GET，完成签名 void(boost::system::error_code, stream_response)
+ *
+ * 支持 asio 的各种 completion token：普通回调、use_future，以及 C++20 下的
+ * use_awaitable：
+ *
+ *   auto res = co_await ss1x::asio::async_get(sess, url, boost::asio::use_awaitable);
+ *   for (;;) {
+ *       std::string data = co_await ss1x::asio::co_read(*res.body);
+ *       if (data.empty()) break;
+ *       parser.feed(data);
+ *   }
+ *
+ * 需要有线程驱动 sess.get_io_service()，比如 sess.run()。
+ */
+template <typename CompletionToken>
+BOOST_ASIO_INITFN_AUTO_RESULT_TYPE(CompletionToken,
+                                   void(boost::system::error_code, stream_response))
+async_get(session& sess, const std::string& url, CompletionToken&& token,
+          const request_options& options = request_options(),
+          size_t window = body_stream::default_window)
+{
+    return boost::asio::async_initiate<CompletionToken,
+                                       void(boost::system::error_code, stream_response)>(
+        detail::initiate_get(), token, &sess, url, options, window);
+}
+
+template <typename CompletionToken>
+BOOST_ASIO_INITFN_AUTO_RESULT_TYPE(CompletionToken,
+                                   void(boost::system::error_code, std::string))
+body_stream::async_read(CompletionToken&& token)
+{
+    return boost::asio::async_initiate<CompletionToken,
+                                       void(boost::system::error_code, std::string)>(
+        initiate_read(), token, this, &m_io_service);
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+// NOTE 以下要求 C++20 协程(__cpp_impl_coroutine)；失败时抛出 system_error
+
+inline boost::asio::awaitable<stream_response>
+co_get(session& sess, std::string url, request_options options = request_options())
+{
+    co_return co_await async_get(sess, url, boost::asio::use_awaitable, options);
+}
+
+// 返回空串，表示 body 已经读完
+inline boost::asio::awaitable<std::string> co_read(body_stream& body)
+{
+    boost::system::error_code ec;
+    std::string data = co_await body.async_read(
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec && ec != boost::asio::error::eof) {
+        throw boost::system::system_error(ec);
+    }
+    co_return data;
+}
+
+#endif
+
+} // namespace asio
+} // namespace ss1x
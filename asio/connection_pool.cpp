@@ -0,0 +1,195 @@
+// ss1x/asio/connection_pool.cpp
+#include "connection_pool.hpp"
+#include "metrics.hpp"
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+namespace ss1x {
+namespace asio {
+
+connection_pool::connection_pool(size_t max_idle_per_host, int idle_timeout)
+    : m_max_idle_per_host(max_idle_per_host),
+      m_idle_timeout(idle_timeout)
+{
+}
+
+connection_pool::~connection_pool()
+{
+    this->clear();
+}
+
+bool connection_pool::is_alive(socket_type& sock)
+{
+    auto& s = sock.get_socket();
+    if (!s.is_open()) {
+        return false;
+    }
+    // NOTE 明文连接空闲时，不应该有任何可读数据；
+    // 读到0字节，说明对方已经关闭；读到数据，说明协议状态已经错乱；
+    // 只有 EAGAIN，才说明连接仍然可用。
+    // 而 tls 连接，握手之后服务端还可能发来 NewSessionTicket 等记录，
+    // 留给下次读取时由 ssl 层消化；于是只有0字节与真正的错误，才算失效。
+    char c = 0;
+    ssize_t n = ::recv(s.native_handle(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0) {
+        return false;
+    }
+    if (n > 0) {
+        return sock.using_ssl();
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+connection_pool::socket_ptr connection_pool::acquire(const key_type& key)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto now = clock_type::now();
+    auto it  = m_idle.find(key);
+    if (it == m_idle.end()) {
+        return socket_ptr();
+    }
+
+    socket_ptr sock;
+    auto& idle = it->second;
+    // LIFO: the most recently used connection is the least likely to be
+    // closed by the server
+    while (!idle.empty()) {
+        idle_entry entry = std::move(idle.back());
+        idle.pop_back();
+        pool_idle_gauge().sub();
+        if (now - entry.since < m_idle_timeout && is_alive(*entry.sock)) {
+            sock = std::move(entry.sock);
+            break;
+        }
+        COLOG_DEBUG("drop stale connection to ", key.host, ':', key.port);
+        boost::system::error_code ec;
+        entry.sock->get_socket().close(ec);
+    }
+    if (idle.empty()) {
+        m_idle.erase(it);
+    }
+    return sock;
+}
+
+bool connection_pool::release(const key_type& key, socket_ptr&& sock)
+{
+    if (!sock || !sock->get_socket().is_open()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_max_idle_per_host) {
+        return false;
+    }
+    auto now = clock_type::now();
+    this->purge_locked(now);
+
+    auto& idle = m_idle[key];
+    if (idle.size() >= m_max_idle_per_host) {
+        // drop the oldest one, keep the warm one
+        boost::system::error_code ec;
+        idle.front().sock->get_socket().close(ec);
+        idle.pop_front();
+        pool_idle_gauge().sub();
+    }
+    idle_entry entry;
+    entry.sock  = std::move(sock);
+    entry.since = now;
+    idle.push_back(std::move(entry));
+    pool_idle_gauge().add();
+    COLOG_DEBUG(SSS_VALUE_MSG(key.host), SSS_VALUE_MSG(key.port), SSS_VALUE_MSG(idle.size()));
+    return true;
+}
+
+size_t connection_pool::purge_locked(clock_type::time_point now)
+{
+    size_t cnt = 0;
+    for (auto it = m_idle.begin(); it != m_idle.end();) {
+        auto& idle = it->second;
+        while (!idle.empty() && now - idle.front().since >= m_idle_timeout) {
+            boost::system::error_code ec;
+            idle.front().sock->get_socket().close(ec);
+            idle.pop_front();
+            ++cnt;
+        }
+        if (idle.empty()) {
+            it = m_idle.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    pool_idle_gauge().sub(int64_t(cnt));
+    return cnt;
+}
+
+size_t connection_pool::purge()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return this->purge_locked(clock_type::now());
+}
+
+void connection_pool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    size_t cnt = 0;
+    for (auto& item : m_idle) {
+        for (auto& entry : item.second) {
+            boost::system::error_code ec;
+            entry.sock->get_socket().close(ec);
+        }
+        cnt += item.second.size();
+    }
+    m_idle.clear();
+    pool_idle_gauge().sub(int64_t(cnt));
+}
+
+size_t connection_pool::idle_count() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    size_t cnt = 0;
+    for (const auto& item : m_idle) {
+        cnt += item.second.size();
+    }
+    return cnt;
+}
+
+size_t connection_pool::idle_count(const key_type& key) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_idle.find(key);
+    return it == m_idle.end() ? 0u : it->second.size();
+}
+
+size_t connection_pool::max_idle_per_host() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_max_idle_per_host;
+}
+
+void connection_pool::max_idle_per_host(size_t max)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_max_idle_per_host = max;
+}
+
+int connection_pool::idle_timeout() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return int(m_idle_timeout.count());
+}
+
+void connection_pool::idle_timeout(int seconds)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_idle_timeout = std::chrono::seconds(seconds);
+}
+
+} // namespace asio
+} // namespace ss1x
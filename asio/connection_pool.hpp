@@ -0,0 +1,109 @@
+// ss1x/asio/connection_pool.hpp
+#pragma once
+
+#include <ss1x/asio/socket_t.hpp>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace ss1x {
+namespace asio {
+
+// NOTE HTTP/1.1 keep-alive 连接池
+//
+// 一次完整读完响应(Content-Length 或 chunked 结束标记)、并且服务端没有要求
+// close 的连接，由 proxy_tunnel_client 归还到这里；下一个相同
+// (scheme, host, port, proxy) 的请求，直接取出使用，省掉 resolve、connect
+// 以及 ssl handshake。
+//
+// 池中的 socket 都绑定在创建它们的 io_service 上；所以，一个 connection_pool
+// 只能服务于同一个 io_service 上的 client。
+class connection_pool
+{
+public:
+    typedef ss1x::detail::socket_t       socket_type;
+    typedef std::unique_ptr<socket_type> socket_ptr;
+    typedef std::chrono::steady_clock    clock_type;
+
+    struct key_type
+    {
+        std::string scheme;
+        std::string host;
+        int         port;
+        // "proxy_host:proxy_port"; empty for direct connection
+        std::string proxy;
+
+        key_type() : port(0) {}
+
+        bool operator<(const key_type& rhs) const
+        {
+            return std::tie(scheme, host, port, proxy) <
+                   std::tie(rhs.scheme, rhs.host, rhs.port, rhs.proxy);
+        }
+    };
+
+    static const size_t default_max_idle_per_host = 6;
+    static const int    default_idle_timeout      = 30; // seconds
+
+    explicit connection_pool(size_t max_idle_per_host = default_max_idle_per_host,
+                             int    idle_timeout      = default_idle_timeout);
+    ~connection_pool();
+
+    connection_pool(const connection_pool&) = delete;
+    connection_pool& operator=(const connection_pool&) = delete;
+
+public:
+    /**
+     * @brief take out the most recently used idle connection for key
+     *
+     * @return nullptr if there's no alive one
+     */
+    socket_ptr acquire(const key_type& key);
+
+    /**
+     * @brief give back a connection that finished its response cleanly
+     *
+     * @return false if the connection was dropped (pool full, or closed)
+     */
+    bool       release(const key_type& key, socket_ptr&& sock);
+
+    // close all connections that have been idle longer than idle_timeout()
+    size_t     purge();
+    void       clear();
+
+    size_t     idle_count() const;
+    size_t     idle_count(const key_type& key) const;
+
+    // NOTE 以下设置都在锁内读写；可以在使用中途修改
+    size_t     max_idle_per_host() const;
+    void       max_idle_per_host(size_t max);
+
+    int        idle_timeout() const;
+    void       idle_timeout(int seconds);
+
+private:
+    // NOTE 服务端可能已经单方面关闭了空闲连接；或者发来了不该有的数据。
+    static bool is_alive(socket_type& sock);
+
+    size_t purge_locked(clock_type::time_point now);
+
+    struct idle_entry
+    {
+        socket_ptr             sock;
+        clock_type::time_point since;
+    };
+    typedef std::map<key_type, std::deque<idle_entry>> idle_map_t;
+
+    mutable std::mutex   m_lock;
+    idle_map_t           m_idle;
+    size_t               m_max_idle_per_host;
+    std::chrono::seconds m_idle_timeout;
+};
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,163 @@
+// ss1x/asio/content_flow.hpp
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief body 的流量控制；消费者跟不上时，让 client 暂停读 socket
+ *
+ * 两种用法，可以同时使用：
+ *
+ * 1. credit：window 不为0时，交给 onContent 的(解码后的)字节，都算作占用；
+ *    占用达到 window，client 就不再读 socket，直到消费者 release() 归还；
+ * 2. 显式地 pause()/resume()。
+ *
+ * 暂停期间，数据留在内核的 socket 缓冲区中，由 tcp 的流控反压到服务端；
+ * 于是每个连接的内存占用有上限(window 加上一次读取的量)。暂停期间，不计
+ * idle 超时。
+ *
+ * 各个成员函数都是线程安全的；release()/resume() 可以在任意线程调用。
+ * 同一个 flow 可以由多个请求共用(比如 fetchMany 的各个 url)：credit 合计，
+ * 解除阻塞时，唤醒所有在等的请求。
+ */
+class content_flow
+{
+public:
+    typedef std::function<void()> waker_t;
+
+    explicit content_flow(size_t window = 0)
+        : m_window(window), m_outstanding(0), m_paused(false)
+    {}
+
+    content_flow(const content_flow&) = delete;
+    content_flow& operator=(const content_flow&) = delete;
+
+    void pause()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_paused = true;
+    }
+
+    void resume()
+    {
+        waiters_t wakers;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_paused = false;
+            wakers   = this->take_wakers_locked();
+        }
+        wake(wakers);
+    }
+
+    // 消费者处理完 bytes 字节，归还 credit
+    void release(size_t bytes)
+    {
+        waiters_t wakers;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_outstanding -= std::min(bytes, m_outstanding);
+            wakers = this->take_wakers_locked();
+        }
+        wake(wakers);
+    }
+
+    bool   paused() const       { std::lock_guard<std::mutex> lock(m_lock); return m_paused;      }
+    size_t outstanding() const  { std::lock_guard<std::mutex> lock(m_lock); return m_outstanding; }
+    size_t window() const       { return m_window; }
+
+    bool blocked() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return this->blocked_locked();
+    }
+
+public:
+    // NOTE 以下由 client 调用
+
+    // 记入交给 onContent 的字节数
+    void consume(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_outstanding += bytes;
+    }
+
+    /**
+     * @brief 已阻塞时，为 owner 登记 waker，返回 true；解除阻塞时，waker 被调用一次
+     *
+     * 没有阻塞时，不登记，返回 false；调用者直接继续读取。
+     * 同一 owner 再次登记，替换其原有的 waker。
+     */
+    bool wait(const void* owner, waker_t&& waker)
+    {
+        waker_t old;
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!this->blocked_locked()) {
+            return false;
+        }
+        for (auto& item : m_wakers) {
+            if (item.first == owner) {
+                old.swap(item.second);
+                item.second = std::move(waker);
+                return true;
+            }
+        }
+        m_wakers.emplace_back(owner, std::move(waker));
+        return true;
+    }
+
+    // owner 放弃等待(比如请求已结束)；其 waker 持有的资源，随之释放
+    void cancel_wait(const void* owner)
+    {
+        waker_t waker;
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = m_wakers.begin(); it != m_wakers.end(); ++it) {
+            if (it->first == owner) {
+                waker.swap(it->second);
+                m_wakers.erase(it);
+                break;
+            }
+        }
+    }
+
+private:
+    bool blocked_locked() const
+    {
+        return m_paused || (m_window && m_outstanding >= m_window);
+    }
+
+    typedef std::vector<std::pair<const void*, waker_t>> waiters_t;
+
+    waiters_t take_wakers_locked()
+    {
+        waiters_t wakers;
+        if (!this->blocked_locked()) {
+            wakers.swap(m_wakers);
+        }
+        return wakers;
+    }
+
+    // NOTE 在锁外调用；被唤醒的请求可能立即再次 wait()
+    static void wake(waiters_t& wakers)
+    {
+        for (auto& item : wakers) {
+            item.second();
+        }
+    }
+
+    mutable std::mutex m_lock;
+    const size_t       m_window;
+    size_t             m_outstanding;
+    bool               m_paused;
+    waiters_t          m_wakers;
+};
+
+} // namespace asio
+} // namespace ss1x
@@ -9,6 +9,8 @@
 #include <ctime>
 #include <tuple>
 #include <algorithm>
+#include <mutex>
+#include <vector>
 #include <unordered_map>
 
 #include <boost/date_time.hpp>
@@ -271,7 +273,8 @@ private:
 // 当然，其查找方式呢，又有些区别。相当于windows中，regedit处理打开方式的时候，还提供了"*"，用来匹配所有的文件类型。
 // domain中，如果子路径，没有提供，就说明，可以匹配下属所有的子路径。
 
-inline bool set(const std::string& domain, const std::string& cookies){
+namespace detail {
+inline bool set(CookieMap_t& cookieMap, const std::string& domain, const std::string& cookies){
     Cookie_t cookie(cookies);
     if (cookie.value().empty()) {
         return false;
@@ -284,10 +287,11 @@ inline bool set(const std::string& domain, const std::string& cookies){
         std::reverse(domain_final.begin(), domain_final.end()); // 逆序
         detail::Key_t key = std::make_tuple(domain_final, cookie.path(), cookie.name());
         detail::Value_t value = std::make_tuple(cookie.value(), cookie.expires(), cookie.secure(), cookie.httponly());
-        detail::getCookieMap()[key] = value;
+        cookieMap[key] = value;
         return true;
     }
 }
+} // namespace detail
 
 // NOTE
 // Cookie本身的保存，应该是倒树形来处理的。
@@ -309,20 +313,21 @@ inline bool set(const std::string& domain, const std::string& cookies){
 //
 // 如果，是按照domain(split+desc)，排序之后，那么用lower_bound，找出边界(或者说，最大前缀)；
 
-inline std::vector<std::string> get(const std::string& url)
+namespace detail {
+inline std::vector<std::string> get(CookieMap_t& cookieMap, const std::string& url)
 {
     auto url_info = ss1x::util::url::split_port_auto(url);
     std::string & domain = std::get<1>(url_info);
     const std::string& path = std::get<3>(url_info);
     std::vector<std::string> rv;
     sss::time::Date cur;
-    detail::CookieMap_t::iterator it = detail::getCookieMap().begin();
+    detail::CookieMap_t::iterator it = cookieMap.begin();
     std::reverse(domain.begin(), domain.end());
-    while (it != detail::getCookieMap().end()) {
+    while (it != cookieMap.end()) {
         const detail::Key_t & key = it->first;
         const detail::Value_t & value = it->second;
         if (std::get<1>(value) && *std::get<1>(value) < cur) {
-            it = detail::getCookieMap().erase(it);
+            it = cookieMap.erase(it);
             continue;
         }
         if ((std::get<0>(key).empty() || sss::string_view(domain).is_begin_with(std::get<0>(key))) &&
@@ -335,6 +340,58 @@ inline std::vector<std::string> get(const std::string& url)
     }
     return rv;
 }
+} // namespace detail
+
+inline bool set(const std::string& domain, const std::string& cookies)
+{
+    return detail::set(detail::getCookieMap(), domain, cookies);
+}
+
+inline std::vector<std::string> get(const std::string& url)
+{
+    return detail::get(detail::getCookieMap(), url);
+}
+
+// NOTE 上面的 set/get，操作的是进程全局的cookie表；
+// jar 则是一个独立的cookie表，供 ss1x::asio::session 之类，需要隔离cookie的场合使用。
+class jar
+{
+public:
+    jar() = default;
+    ~jar() = default;
+
+    jar(const jar&) = delete;
+    jar& operator=(const jar&) = delete;
+
+public:
+    bool set(const std::string& domain, const std::string& cookies)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return detail::set(m_cookieMap, domain, cookies);
+    }
+
+    std::vector<std::string> get(const std::string& url)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return detail::get(m_cookieMap, url);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cookieMap.clear();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_cookieMap.size();
+    }
+
+private:
+    mutable std::mutex  m_lock;
+    detail::CookieMap_t m_cookieMap;
+};
 } // namespace ss1x
 
 // std::vector<std::string> get(std::string url)
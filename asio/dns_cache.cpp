@@ -0,0 +1,354 @@
+// ss1x/asio/dns_cache.cpp
+#include "dns_cache.hpp"
+
+#include <memory>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+// NOTE 随解析的 handler 一起析构；handler 没有被调用过时，说明 io_service
+// 已经析构，解析不会再完成了
+struct dns_cache::flight_guard_t
+{
+    flight_guard_t(dns_cache* c, const std::string& k, boost::asio::io_service* p)
+        : cache(c), key(k), p_io_service(p), done(false)
+    {}
+
+    ~flight_guard_t()
+    {
+        if (!done) {
+            cache->abandon(key, p_io_service);
+        }
+    }
+
+    dns_cache*               cache;
+    std::string              key;
+    boost::asio::io_service* p_io_service;
+    bool                     done;
+};
+
+dns_cache::dns_cache(int ttl, int negative_ttl)
+    : m_ttl(ttl),
+      m_negative_ttl(negative_ttl),
+      m_max_entries(default_max_entries),
+      m_hits(0),
+      m_negative_hits(0),
+      m_misses(0),
+      m_coalesced(0)
+{
+}
+
+dns_cache& dns_cache::instance()
+{
+    static dns_cache cache;
+    return cache;
+}
+
+std::string dns_cache::make_key(const std::string& host, int port)
+{
+    return host + ':' + std::to_string(port);
+}
+
+bool dns_cache::is_cacheable_error(const boost::system::error_code& ec)
+{
+    return ec == boost::asio::error::host_not_found ||
+           ec == boost::asio::error::service_not_found ||
+           ec == boost::asio::error::no_data;
+}
+
+bool dns_cache::lookup_locked(const std::string& key, clock_type::time_point now,
+                              boost::system::error_code& ec, results_type& results)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return false;
+    }
+    entry_t& entry = it->second;
+    if (!entry.pinned && (entry.pending() || entry.expires <= now)) {
+        return false;
+    }
+    ec      = entry.ec;
+    results = entry.results;
+    if (ec) {
+        ++m_negative_hits;
+    }
+    else {
+        ++m_hits;
+    }
+    return true;
+}
+
+void dns_cache::purge_locked(clock_type::time_point now)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        const entry_t& entry = it->second;
+        if (!entry.pinned && !entry.pending() && entry.expires <= now) {
+            it = m_entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void dns_cache::async_resolve(boost::asio::io_service& io_service,
+                              const std::string& host, int port, handler_t&& handler)
+{
+    std::string key = make_key(host, port);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto now = clock_type::now();
+
+        boost::system::error_code ec;
+        results_type              results;
+        if (this->lookup_locked(key, now, ec, results)) {
+            io_service.post(std::bind(std::move(handler), ec, results));
+            return;
+        }
+
+        if (m_entries.size() >= m_max_entries) {
+            this->purge_locked(now);
+        }
+
+        std::vector<handler_t>& waiters = m_entries[key].flights[&io_service];
+        waiters.push_back(std::move(handler));
+        if (waiters.size() > 1) {
+            ++m_coalesced;
+            return;
+        }
+        ++m_misses;
+    }
+
+    COLOG_DEBUG(SSS_VALUE_MSG(key));
+    // NOTE resolver 由本次解析自己持有；发起解析的 client 先行析构，也不影响
+    // 等在同一个 key 上的其他请求
+    boost::asio::io_service*        p_io_service = &io_service;
+    std::shared_ptr<resolver_type>  p_resolver   = std::make_shared<resolver_type>(io_service);
+    std::shared_ptr<flight_guard_t> guard = std::make_shared<flight_guard_t>(this, key, p_io_service);
+    p_resolver->async_resolve(
+        host, std::to_string(port),
+        [this, key, p_io_service, p_resolver, guard](const boost::system::error_code& ec,
+                                                     results_type results) -> void {
+            guard->done = true;
+            this->store(key, p_io_service, ec, results);
+        });
+}
+
+dns_cache::results_type dns_cache::resolve(boost::asio::io_service& io_service,
+                                           const std::string& host, int port,
+                                           boost::system::error_code& ec)
+{
+    std::string  key = make_key(host, port);
+    results_type results;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (this->lookup_locked(key, clock_type::now(), ec, results)) {
+            return results;
+        }
+        ++m_misses;
+    }
+
+    resolver_type resolver(io_service);
+    results = resolver.resolve(host, std::to_string(port), ec);
+    this->store(key, nullptr, ec, results);
+    return results;
+}
+
+void dns_cache::store(const std::string& key, boost::asio::io_service* p_io_service,
+                      const boost::system::error_code& ec, const results_type& results)
+{
+    std::vector<handler_t> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto now = clock_type::now();
+        if (m_entries.size() >= m_max_entries) {
+            this->purge_locked(now);
+        }
+        entry_t& entry = m_entries[key];
+        auto it = entry.flights.find(p_io_service);
+        if (it != entry.flights.end()) {
+            waiters.swap(it->second);
+            entry.flights.erase(it);
+        }
+
+        if (entry.pinned) {
+            // NOTE 解析期间被 pin 了；以 pin 的结果为准
+        }
+        else if (!ec || is_cacheable_error(ec)) {
+            entry.ec      = ec;
+            entry.results = results;
+            entry.expires = now + (ec ? m_negative_ttl : m_ttl);
+        }
+        else if (!entry.pending()) {
+            m_entries.erase(key);
+        }
+    }
+
+    COLOG_DEBUG(SSS_VALUE_MSG(key), ec.message(), SSS_VALUE_MSG(waiters.size()));
+    for (auto& handler : waiters) {
+        p_io_service->post(std::bind(std::move(handler), ec, results));
+    }
+}
+
+void dns_cache::abandon(const std::string& key, boost::asio::io_service* p_io_service)
+{
+    // NOTE 等待者与 io_service 一起销毁，不再调用；在锁外析构它们
+    std::vector<handler_t> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            return;
+        }
+        entry_t& entry = it->second;
+        auto flight = entry.flights.find(p_io_service);
+        if (flight != entry.flights.end()) {
+            waiters.swap(flight->second);
+            entry.flights.erase(flight);
+        }
+        if (!entry.pinned && !entry.pending() && entry.expires <= clock_type::now()) {
+            m_entries.erase(it);
+        }
+    }
+    COLOG_DEBUG(SSS_VALUE_MSG(key), "abandoned", SSS_VALUE_MSG(waiters.size()));
+}
+
+void dns_cache::prefetch(boost::asio::io_service& io_service,
+                         const std::vector<std::string>& hosts, int port)
+{
+    for (const auto& host : hosts) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto it = m_entries.find(make_key(host, port));
+            if (it != m_entries.end() &&
+                (it->second.pinned || it->second.pending() ||
+                 clock_type::now() < it->second.expires))
+            {
+                continue;
+            }
+        }
+        this->async_resolve(io_service, host, port,
+                            [](const boost::system::error_code&, results_type) -> void {});
+    }
+}
+
+void dns_cache::pin(const std::string& host, int port,
+                    const std::vector<boost::asio::ip::address>& addresses)
+{
+    std::vector<endpoint_type> endpoints;
+    endpoints.reserve(addresses.size());
+    for (const auto& address : addresses) {
+        endpoints.push_back(endpoint_type(address, static_cast<unsigned short>(port)));
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    entry_t& entry = m_entries[make_key(host, port)];
+    entry.pinned   = true;
+    entry.ec.clear();
+    entry.results  = results_type::create(endpoints.begin(), endpoints.end(),
+                                          host, std::to_string(port));
+}
+
+void dns_cache::pin(const std::string& host, int port, const std::string& address)
+{
+    std::vector<boost::asio::ip::address> addresses;
+    addresses.push_back(boost::asio::ip::make_address(address));
+    this->pin(host, port, addresses);
+}
+
+void dns_cache::unpin(const std::string& host, int port)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_entries.find(make_key(host, port));
+    if (it != m_entries.end() && it->second.pinned) {
+        m_entries.erase(it);
+    }
+}
+
+void dns_cache::erase(const std::string& host, int port)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_entries.find(make_key(host, port));
+    if (it == m_entries.end()) {
+        return;
+    }
+    if (it->second.pending()) {
+        // 等待中的请求，仍然需要这条记录
+        it->second.expires = clock_type::time_point();
+        it->second.pinned  = false;
+    }
+    else {
+        m_entries.erase(it);
+    }
+}
+
+void dns_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->second.pinned && !it->second.pending()) {
+            it = m_entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+size_t dns_cache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_entries.size();
+}
+
+int dns_cache::ttl() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return int(m_ttl.count());
+}
+
+void dns_cache::ttl(int seconds)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_ttl = std::chrono::seconds(seconds);
+}
+
+int dns_cache::negative_ttl() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return int(m_negative_ttl.count());
+}
+
+void dns_cache::negative_ttl(int seconds)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_negative_ttl = std::chrono::seconds(seconds);
+}
+
+size_t dns_cache::max_entries() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_max_entries;
+}
+
+void dns_cache::max_entries(size_t max)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_max_entries = max;
+}
+
+dns_cache::stats_t dns_cache::stats() const
+{
+    stats_t s;
+    s.hits          = m_hits;
+    s.negative_hits = m_negative_hits;
+    s.misses        = m_misses;
+    s.coalesced     = m_coalesced;
+    return s;
+}
+
+} // namespace asio
+} // namespace ss1x
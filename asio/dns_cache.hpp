@@ -0,0 +1,150 @@
+// ss1x/asio/dns_cache.hpp
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace ss1x {
+namespace asio {
+
+// NOTE 进程级的域名解析缓存
+//
+// getaddrinfo 是同步调用，asio 把它放在一个隐藏线程里执行；每个请求、每次跳转
+// 都要解析一遍的话，就是几十毫秒的额外延时。这里按 "host:port" 缓存解析结果：
+//
+// 1. 成功的结果，缓存 ttl() 秒；失败(域名不存在等)的结果，缓存 negative_ttl() 秒；
+// 2. 同一个 io_service 上，同一个 "host:port" 同时有多个请求在解析时，只发起一次
+//    解析，结果分发给所有请求者；解析跑在该 io_service 上，于是不同 io_service
+//    之间互不等待；io_service 析构而解析未完成时，其上的等待者随之丢弃；
+// 3. pin() 固定某个 "host:port" 的地址，不再解析，也不过期；类似 curl 的 --resolve；
+// 4. prefetch() 预先解析一批域名。
+//
+// getaddrinfo 不提供记录的 TTL，所以这里的 ttl 是统一配置的。
+// 各个成员函数都是线程安全的。
+class dns_cache
+{
+public:
+    typedef boost::asio::ip::tcp::resolver resolver_type;
+    typedef resolver_type::results_type    results_type;
+    typedef boost::asio::ip::tcp::endpoint endpoint_type;
+    typedef std::chrono::steady_clock      clock_type;
+
+    typedef std::function<void(const boost::system::error_code& ec, results_type results)>
+        handler_t;
+
+    struct stats_t
+    {
+        uint64_t hits;           // 命中成功的结果
+        uint64_t negative_hits;  // 命中失败的结果
+        uint64_t misses;         // 真正发起解析的次数
+        uint64_t coalesced;      // 等待同一次解析的请求数
+    };
+
+    static const int    default_ttl          = 60; // seconds
+    static const int    default_negative_ttl = 5;  // seconds
+    static const size_t default_max_entries  = 4096;
+
+    explicit dns_cache(int ttl          = default_ttl,
+                       int negative_ttl = default_negative_ttl);
+
+    dns_cache(const dns_cache&) = delete;
+    dns_cache& operator=(const dns_cache&) = delete;
+
+    static dns_cache& instance();
+
+public:
+    /**
+     * @brief 异步解析；handler 总是经由 io_service 调用，不会在本函数内直接调用
+     */
+    void async_resolve(boost::asio::io_service& io_service,
+                       const std::string& host, int port, handler_t&& handler);
+
+    // 同步解析；命中缓存时不会阻塞
+    results_type resolve(boost::asio::io_service& io_service,
+                         const std::string& host, int port,
+                         boost::system::error_code& ec);
+
+    // 异步预解析；已在缓存中的，直接跳过
+    void prefetch(boost::asio::io_service& io_service,
+                  const std::vector<std::string>& hosts, int port = 80);
+
+    // host:port 固定解析到 addresses 上；不过期，clear() 也不会删除
+    void pin(const std::string& host, int port,
+             const std::vector<boost::asio::ip::address>& addresses);
+    void pin(const std::string& host, int port, const std::string& address);
+    void unpin(const std::string& host, int port);
+
+    void   erase(const std::string& host, int port);
+    // 删除所有非 pin 的记录
+    void   clear();
+    size_t size() const;
+
+    stats_t stats() const;
+
+    // NOTE 以下设置都在锁内读写；可以在使用中途修改，只影响之后写入的记录
+    int    ttl() const;
+    void   ttl(int seconds);
+    int    negative_ttl() const;
+    void   negative_ttl(int seconds);
+    size_t max_entries() const;
+    void   max_entries(size_t max);
+
+private:
+    // 每个 io_service 上正在进行的解析，以及等待它的请求
+    typedef std::map<boost::asio::io_service*, std::vector<handler_t>> flight_map_t;
+
+    struct entry_t
+    {
+        entry_t() : pinned(false) {}
+
+        bool pending() const { return !flights.empty(); }
+
+        results_type              results;
+        boost::system::error_code ec;
+        clock_type::time_point    expires;
+        bool                      pinned;
+        flight_map_t              flights;
+    };
+
+    struct flight_guard_t;
+    typedef std::map<std::string, entry_t> entry_map_t;
+
+    static std::string make_key(const std::string& host, int port);
+
+    // 解析失败时，只缓存确定性的错误；超时、取消之类的，下次重试
+    static bool is_cacheable_error(const boost::system::error_code& ec);
+
+    bool lookup_locked(const std::string& key, clock_type::time_point now,
+                       boost::system::error_code& ec, results_type& results);
+
+    // p_io_service 非空时，把结果交给该 io_service 上等待的请求
+    void store(const std::string& key, boost::asio::io_service* p_io_service,
+               const boost::system::error_code& ec, const results_type& results);
+
+    // 解析的 handler 没有被调用就析构了(io_service 析构)；丢弃这次解析
+    void abandon(const std::string& key, boost::asio::io_service* p_io_service);
+
+    void purge_locked(clock_type::time_point now);
+
+    mutable std::mutex    m_lock;
+    entry_map_t           m_entries;
+    std::chrono::seconds  m_ttl;
+    std::chrono::seconds  m_negative_ttl;
+    size_t                m_max_entries;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_negative_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_coalesced;
+};
+
+} // namespace asio
+} // namespace ss1x
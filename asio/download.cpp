@@ -0,0 +1,625 @@
+// ss1x/asio/download.cpp
+#include "download.hpp"
+
+#include "error_codec.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+inline boost::system::error_code errno_code(int e = errno)
+{
+    return boost::system::error_code(e, boost::system::system_category());
+}
+
+inline boost::system::error_code status_code_error(unsigned int status_code)
+{
+    return ss1x::errc::make_error_code(static_cast<ss1x::errc::errc_t>(status_code));
+}
+
+inline bool is_ok_finish(const boost::system::error_code& ec)
+{
+    // NOTE chunked 或者读到连接关闭的响应，正常结束时报告的是 eof
+    return !ec || ec == boost::asio::error::eof;
+}
+
+// "bytes first-last/total"；total 为 "*" 时，返回0
+bool parse_content_range(const std::string& value,
+                         uint64_t& first, uint64_t& last, uint64_t& total)
+{
+    unsigned long long f = 0;
+    unsigned long long l = 0;
+    unsigned long long t = 0;
+    if (std::sscanf(value.c_str(), "bytes %llu-%llu/%llu", &f, &l, &t) == 3) {
+        total = t;
+    }
+    else if (std::sscanf(value.c_str(), "bytes %llu-%llu/*", &f, &l) == 2) {
+        total = 0;
+    }
+    else {
+        return false;
+    }
+    first = f;
+    last  = l;
+    return first <= last;
+}
+
+uint64_t content_length(const ss1x::http::Headers& header)
+{
+    const std::string value = header.get("Content-Length");
+    return value.empty() ? 0u : std::strtoull(value.c_str(), nullptr, 10);
+}
+
+// If-Range 只接受强校验器；弱 ETag 时，退回 Last-Modified
+std::string range_validator(const ss1x::http::Headers& header)
+{
+    std::string etag = header.get("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        return etag;
+    }
+    return header.get("Last-Modified");
+}
+
+bool preallocate(int fd, uint64_t size, boost::system::error_code& ec)
+{
+    if (!size) {
+        return true;
+    }
+    int ret = ::posix_fallocate(fd, 0, off_t(size));
+    if (ret == 0) {
+        return true;
+    }
+    // NOTE 部分文件系统不支持 fallocate；退回到 ftruncate(稀疏文件)
+    if (ret != EOPNOTSUPP && ret != EINVAL) {
+        ec = errno_code(ret);
+        return false;
+    }
+    if (::ftruncate(fd, off_t(size)) != 0) {
+        ec = errno_code();
+        return false;
+    }
+    return true;
+}
+
+bool pwrite_all(int fd, const char* data, size_t size, uint64_t offset,
+                boost::system::error_code& ec)
+{
+    while (size) {
+        ssize_t n = ::pwrite(fd, data, size, off_t(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ec = errno_code();
+            return false;
+        }
+        data   += n;
+        size   -= size_t(n);
+        offset += uint64_t(n);
+    }
+    return true;
+}
+
+std::string to_hex(const void* data, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::string ret;
+    ret.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        ret.push_back(digits[p[i] >> 4]);
+        ret.push_back(digits[p[i] & 0x0Fu]);
+    }
+    return ret;
+}
+
+// NOTE openssl 3 起，SHA1_Init() 等已不推荐使用；改用 EVP 接口
+class sha1_digest
+{
+public:
+    sha1_digest() : m_ctx(::EVP_MD_CTX_new()) { this->reset(); }
+    ~sha1_digest() { ::EVP_MD_CTX_free(m_ctx); }
+
+    sha1_digest(const sha1_digest&) = delete;
+    sha1_digest& operator=(const sha1_digest&) = delete;
+
+    void reset() { ::EVP_DigestInit_ex(m_ctx, ::EVP_sha1(), nullptr); }
+
+    void update(const void* data, size_t size) { ::EVP_DigestUpdate(m_ctx, data, size); }
+
+    std::string final_hex()
+    {
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int  size = 0;
+        ::EVP_DigestFinal_ex(m_ctx, md, &size);
+        return to_hex(md, size);
+    }
+
+private:
+    EVP_MD_CTX* m_ctx;
+};
+
+struct segment_t
+{
+    segment_t(uint64_t o, uint64_t l, uint64_t w = 0) : offset(o), length(l), written(w) {}
+
+    uint64_t offset;
+    // 0 表示长度未知(单连接，且没有 Content-Length)
+    uint64_t length;
+    uint64_t written;
+};
+
+/**
+ * 断点续传日志；文本格式，一行一项：
+ *
+ *   ss1x-journal 1
+ *   url <url>
+ *   validator <ETag 或 Last-Modified>
+ *   total <n>
+ *   segment <offset> <length> <written>
+ *   ...
+ *
+ * NOTE 先 fdatasync 目标文件，再用 "写临时文件 + rename" 替换日志；所以日志
+ * 中记录的字节数，一定已经落盘。
+ * NOTE EVP 的 SHA1 上下文不透明，不能写入日志；续传时，SHA1 在最后从文件补算。
+ * 旧日志中的 sha1 行被忽略。
+ */
+struct download_journal
+{
+    download_journal() : total(0) {}
+
+    bool load(const std::string& journal_path)
+    {
+        std::ifstream ifs(journal_path.c_str());
+        std::string   line;
+        if (!std::getline(ifs, line) || line != "ss1x-journal 1") {
+            return false;
+        }
+        while (std::getline(ifs, line)) {
+            std::string::size_type pos = line.find(' ');
+            std::string key   = line.substr(0, pos);
+            std::string value = pos == std::string::npos ? "" : line.substr(pos + 1);
+            if (key == "url") {
+                url = value;
+            }
+            else if (key == "validator") {
+                validator = value;
+            }
+            else if (key == "total") {
+                total = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (key == "segment") {
+                unsigned long long o = 0;
+                unsigned long long l = 0;
+                unsigned long long w = 0;
+                if (std::sscanf(value.c_str(), "%llu %llu %llu", &o, &l, &w) != 3 || w > l) {
+                    return false;
+                }
+                segments.push_back(segment_t(o, l, w));
+            }
+        }
+        return !url.empty() && !segments.empty();
+    }
+
+    bool save(const std::string& journal_path) const
+    {
+        std::string tmp_path = journal_path + ".tmp";
+        {
+            std::ofstream ofs(tmp_path.c_str(), std::ios_base::out | std::ios_base::trunc);
+            ofs << "ss1x-journal 1\n"
+                << "url " << url << '\n'
+                << "validator " << validator << '\n'
+                << "total " << total << '\n';
+            for (const auto& seg : segments) {
+                ofs << "segment " << seg.offset << ' ' << seg.length << ' ' << seg.written << '\n';
+            }
+            ofs.flush();
+            if (!ofs) {
+                return false;
+            }
+        }
+        return std::rename(tmp_path.c_str(), journal_path.c_str()) == 0;
+    }
+
+    std::string            url;
+    std::string            validator;
+    uint64_t               total;
+    std::vector<segment_t> segments;
+};
+
+struct download_state_t
+{
+    download_state_t(int f, uint64_t t, const download_options& o)
+        : fd(f), total(t), on_progress(o.on_progress),
+          journal_interval(o.journal_interval), sha1(o.sha1),
+          downloaded(0), unsynced(0), sha1_covered(0),
+          cancel(std::make_shared<request_cancel>())
+    {
+    }
+
+    ~download_state_t()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // NOTE 第一个失败的段，取消其余各段；它们的数据已经注定作废。
+    // 各段以 operation_aborted 结束时，照常写日志，续传时不必重下
+    void fail(const boost::system::error_code& e)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ec) {
+                return;
+            }
+            ec = e;
+        }
+        cancel->cancel();
+    }
+
+    // 不分段时，总长度来自 GET 的响应头
+    void set_total(uint64_t t)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        total = t;
+    }
+
+    bool failed()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bool(ec);
+    }
+
+    // NOTE 每段的 written 只由该段自己的回调修改；读自己的不必加锁，
+    // 修改以及读别的段(写日志)时，需要加锁
+    void write(size_t index, sss::string_view data)
+    {
+        if (this->failed()) {
+            return;
+        }
+        segment_t& seg    = segments[index];
+        uint64_t   offset = seg.offset + seg.written;
+        if (seg.length && seg.written + data.size() > seg.length) {
+            this->fail(ss1x::errc::invalid_content_range);
+            return;
+        }
+        boost::system::error_code e;
+        if (!pwrite_all(fd, data.data(), data.size(), offset, e)) {
+            this->fail(e);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        seg.written += data.size();
+        downloaded  += data.size();
+        // NOTE 只有紧接着已计入前缀的数据，才能喂给 SHA1；其余的在最后从文件补算
+        if (sha1 && offset == sha1_covered) {
+            sha_ctx.update(data.data(), data.size());
+            sha1_covered += data.size();
+        }
+        if (on_progress) {
+            on_progress(downloaded, total);
+        }
+        unsynced += data.size();
+        if (!journal_path.empty() && unsynced >= journal_interval) {
+            this->save_journal_locked();
+        }
+    }
+
+    void save_journal()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->save_journal_locked();
+    }
+
+    void save_journal_locked()
+    {
+        if (journal_path.empty()) {
+            return;
+        }
+        unsynced = 0;
+        if (::fdatasync(fd) != 0) {
+            COLOG_ERROR(SSS_VALUE_MSG(journal_path), std::strerror(errno));
+            return;
+        }
+        download_journal journal;
+        journal.url       = url;
+        journal.validator = validator;
+        journal.total     = total;
+        journal.segments  = segments;
+        if (!journal.save(journal_path)) {
+            COLOG_ERROR(SSS_VALUE_MSG(journal_path), "save failed");
+        }
+    }
+
+    void restore(const download_journal& journal)
+    {
+        segments = journal.segments;
+        for (const auto& seg : segments) {
+            downloaded += seg.written;
+        }
+        // NOTE 已下载的部分，在最后从文件补算 SHA1
+        if (sha1) {
+            sha_ctx.reset();
+            sha1_covered = 0;
+        }
+    }
+
+    // 把 [sha1_covered, size) 从文件中补算进 SHA1，返回 hex 串
+    bool finish_sha1(uint64_t size, std::string& hex, boost::system::error_code& e)
+    {
+        std::vector<char> buffer(128 * 1024);
+        while (sha1_covered < size) {
+            size_t  want = size_t(std::min<uint64_t>(buffer.size(), size - sha1_covered));
+            ssize_t n    = ::pread(fd, buffer.data(), want, off_t(sha1_covered));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                e = n < 0 ? errno_code() : make_error_code(ss1x::errc::incomplete_body);
+                return false;
+            }
+            sha_ctx.update(buffer.data(), size_t(n));
+            sha1_covered += uint64_t(n);
+        }
+        hex = sha_ctx.final_hex();
+        return true;
+    }
+
+    int                       fd;
+    uint64_t                  total;
+    download_progress_t       on_progress;
+    uint64_t                  journal_interval;
+    bool                      sha1;
+
+    // 为空时，不写日志
+    std::string               journal_path;
+    std::string               url;
+    std::string               validator;
+
+    std::mutex                mutex;
+    uint64_t                  downloaded;
+    uint64_t                  unsynced;
+    uint64_t                  sha1_covered;
+    sha1_digest               sha_ctx;
+    boost::system::error_code ec;
+    std::vector<segment_t>    segments;
+    // 各段请求共用
+    std::shared_ptr<request_cancel> cancel;
+};
+
+void start_segment(session& sess, const std::string& url,
+                   const std::shared_ptr<download_state_t>& state, size_t index,
+                   const request_options& base, bool ranged)
+{
+    request_options options = base;
+    options.cancel = state->cancel;
+    const segment_t& seg = state->segments[index];
+    const uint64_t first = seg.offset + seg.written;
+    const bool if_range = ranged && !state->validator.empty();
+    if (ranged) {
+        options.header["Range"] = "bytes=" + std::to_string(first) + '-' +
+                                  std::to_string(seg.offset + seg.length - 1);
+        // NOTE Range 针对的是编码后的字节；必须要求服务端不压缩
+        options.header["Accept-Encoding"] = "identity";
+        if (if_range) {
+            options.header["If-Range"] = state->validator;
+        }
+    }
+
+    options.on_header = [state, index, ranged, if_range, first](const ss1x::http::Headers& header) -> bool {
+        const segment_t& seg = state->segments[index];
+        if (!ranged) {
+            if (header.status_code / 100 != 2) {
+                state->fail(status_code_error(header.status_code));
+                return false;
+            }
+            // NOTE 压缩时，Content-Length 是编码后的长度，与写入的字节数无关
+            if (!header.has("Content-Encoding")) {
+                state->set_total(content_length(header));
+            }
+            return true;
+        }
+        if (header.status_code != 206) {
+            // NOTE If-Range 不匹配时，服务端返回整个新资源(200)
+            state->fail(if_range && header.status_code == 200
+                            ? ss1x::errc::resource_changed
+                            : ss1x::errc::range_not_supported);
+            return false;
+        }
+        uint64_t range_first = 0;
+        uint64_t range_last  = 0;
+        uint64_t range_total = 0;
+        if (!parse_content_range(header.get("Content-Range"), range_first, range_last, range_total) ||
+            range_first != first || range_last + 1 != seg.offset + seg.length ||
+            (range_total && range_total != state->total))
+        {
+            state->fail(ss1x::errc::invalid_content_range);
+            return false;
+        }
+        return true;
+    };
+
+    sess.async_get(
+        url,
+        [state, index](sss::string_view data) -> void {
+            state->write(index, data);
+        },
+        [state, index](const boost::system::error_code& ec,
+                       const ss1x::http::Headers& header) -> void {
+            const segment_t& seg = state->segments[index];
+            COLOG_DEBUG(SSS_VALUE_MSG(index), SSS_VALUE_MSG(seg.written), ec.message());
+            if (!is_ok_finish(ec)) {
+                state->fail(ec);
+            }
+            else if (header.status_code / 100 != 2) {
+                state->fail(status_code_error(header.status_code));
+            }
+            else if (seg.length && seg.written != seg.length) {
+                state->fail(ss1x::errc::incomplete_body);
+            }
+            state->save_journal();
+        },
+        options);
+}
+
+} // namespace detail
+
+std::string download_journal_path(const std::string& path)
+{
+    return path + ".ss1x-journal";
+}
+
+boost::system::error_code segmentedDownload(session&                sess,
+                                            const std::string&      url,
+                                            const std::string&      path,
+                                            ss1x::http::Headers&    header,
+                                            const download_options& options,
+                                            std::string*            p_sha1)
+{
+    boost::system::error_code ec = sess.head(header, url, options.request);
+    if (ec && !detail::is_ok_finish(ec)) {
+        return ec;
+    }
+    ec.clear();
+
+    const bool head_ok = header.status_code / 100 == 2;
+    uint64_t   total   = head_ok ? detail::content_length(header) : 0u;
+    bool       capable = head_ok && total && header.has_kv("Accept-Ranges", "bytes") &&
+                         !header.has("Content-Encoding");
+    std::string validator  = capable ? detail::range_validator(header) : std::string();
+    // NOTE 没有强校验器，就无法判断续传前后是不是同一个资源
+    const bool  resumable  = options.resume && capable && !validator.empty();
+    std::string journal_path = download_journal_path(path);
+
+    size_t segments = std::max<size_t>(options.segments, 1u);
+    if (capable) {
+        uint64_t by_size = total / std::max<uint64_t>(options.min_segment_size, 1u);
+        segments = size_t(std::max<uint64_t>(1u, std::min<uint64_t>(segments, by_size)));
+    }
+    else {
+        segments = 1;
+    }
+    // NOTE 单连接且不续传时，不发 Range；文件长度以实际收到的为准
+    const bool ranged = capable && (segments > 1 || resumable);
+
+    detail::download_journal journal;
+    bool resuming = false;
+    if (resumable && journal.load(journal_path)) {
+        struct stat st;
+        resuming = journal.url == url && journal.validator == validator &&
+                   journal.total == total &&
+                   ::stat(path.c_str(), &st) == 0 && uint64_t(st.st_size) == total;
+        if (!resuming) {
+            COLOG_INFO("journal outdated, restart:", SSS_VALUE_MSG(path),
+                       SSS_VALUE_MSG(journal.validator), SSS_VALUE_MSG(validator));
+        }
+    }
+    if (options.resume && !resuming) {
+        ::unlink(journal_path.c_str());
+    }
+    COLOG_DEBUG(SSS_VALUE_MSG(url), SSS_VALUE_MSG(total), SSS_VALUE_MSG(ranged),
+                SSS_VALUE_MSG(segments), SSS_VALUE_MSG(resuming));
+
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC | (resuming ? 0 : O_TRUNC);
+    int fd    = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        return detail::errno_code();
+    }
+    std::shared_ptr<detail::download_state_t> state =
+        std::make_shared<detail::download_state_t>(fd, ranged ? total : 0u, options);
+    state->url       = url;
+    state->validator = resumable ? validator : std::string();
+
+    if (resuming) {
+        state->restore(journal);
+    }
+    else if (ranged) {
+        if (!detail::preallocate(fd, total, ec)) {
+            return ec;
+        }
+        uint64_t step   = total / segments;
+        uint64_t offset = 0;
+        for (size_t i = 0; i < segments; ++i) {
+            uint64_t length = (i + 1 == segments) ? total - offset : step;
+            state->segments.push_back(detail::segment_t(offset, length));
+            offset += length;
+        }
+    }
+    else {
+        state->segments.push_back(detail::segment_t(0, 0));
+    }
+
+    if (resumable) {
+        state->journal_path = journal_path;
+        state->save_journal();
+    }
+    if (sess.pool().max_idle_per_host() < state->segments.size()) {
+        sess.pool().max_idle_per_host(state->segments.size());
+    }
+
+    for (size_t i = 0; i < state->segments.size(); ++i) {
+        const detail::segment_t& seg = state->segments[i];
+        if (!seg.length || seg.written < seg.length) {
+            detail::start_segment(sess, url, state, i, options.request, ranged);
+        }
+    }
+    sess.run();
+
+    if (state->ec) {
+        // NOTE 资源已经变了，日志里的内容作废；下次从头开始
+        if (resumable && state->ec == ss1x::errc::resource_changed) {
+            ::unlink(journal_path.c_str());
+        }
+        return state->ec;
+    }
+
+    if (options.sha1) {
+        uint64_t size = ranged ? total : state->segments.front().written;
+        std::string hex;
+        if (!state->finish_sha1(size, hex, ec)) {
+            return ec;
+        }
+        if (p_sha1) {
+            p_sha1->swap(hex);
+        }
+    }
+    if (resumable) {
+        ::unlink(journal_path.c_str());
+    }
+    return ec;
+}
+
+boost::system::error_code segmentedDownload(const std::string&      url,
+                                            const std::string&      path,
+                                            ss1x::http::Headers&    header,
+                                            const download_options& options,
+                                            std::string*            p_sha1)
+{
+    return segmentedDownload(session::default_session(), url, path, header, options, p_sha1);
+}
+
+} // namespace asio
+} // namespace ss1x
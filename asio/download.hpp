@@ -0,0 +1,79 @@
+// ss1x/asio/download.hpp
+#pragma once
+
+#include <ss1x/asio/session.hpp>
+#include <ss1x/asio/headers.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <boost/system/error_code.hpp>
+
+namespace ss1x {
+namespace asio {
+
+// downloaded: 已写入文件的字节数；total: 资源总长度，未知时为0
+typedef std::function<void(uint64_t downloaded, uint64_t total)> download_progress_t;
+
+struct download_options
+{
+    download_options()
+        : segments(4),
+          min_segment_size(1024 * 1024),
+          resume(false),
+          sha1(false),
+          journal_interval(8 * 1024 * 1024)
+    {}
+
+    // 最大并发分段数；服务端不支持 Range，或者资源太小时，退化为单连接下载
+    size_t              segments;
+    // 每一段的最小长度
+    uint64_t            min_segment_size;
+    request_options     request;
+    // 多线程驱动时，也保证串行调用
+    download_progress_t on_progress;
+
+    // 断点续传；在 path + ".ss1x-journal" 中记录 url、校验器(ETag 或
+    // Last-Modified)以及各段已落盘的字节数；下次调用时，若校验器未变，
+    // 就用 Range + If-Range 接着下载；否则从头开始。下载成功后删除日志。
+    bool                resume;
+    // 计算整个文件的 SHA1；顺序到达的数据边下载边算，其余部分(包括续传前
+    // 已落盘的前缀)在最后从文件补算；SHA1 状态不写入日志
+    bool                sha1;
+    // 每写入这么多字节，同步一次文件并刷新日志
+    uint64_t            journal_interval;
+};
+
+// 断点续传日志的路径
+std::string download_journal_path(const std::string& path);
+
+/**
+ * @brief 分段并发下载单个大文件
+ *
+ * 先发送 HEAD；若服务端声明了 "Accept-Ranges: bytes" 以及 Content-Length，
+ * 就预分配(fallocate)目标文件，再用 K 个带 Range 的连接并发下载，各段用
+ * pwrite 直接写到文件中各自的偏移上。否则，退化为单连接顺序下载。
+ *
+ * @param header [out] HEAD(或退化时 GET)的响应头
+ * @param p_sha1 [out] options.sha1 为 true 时，成功后写入40个字符的 hex 串
+ *
+ * @return 任意一段失败，即取消其余各段，并返回该段的错误；此时文件内容不完整；若开启了
+ *         resume，已落盘的部分记录在日志中，可以再次调用以继续
+ */
+boost::system::error_code segmentedDownload(session&                sess,
+                                            const std::string&      url,
+                                            const std::string&      path,
+                                            ss1x::http::Headers&    header,
+                                            const download_options& options = download_options(),
+                                            std::string*            p_sha1 = nullptr);
+
+// 使用当前线程的 session::default_session()
+boost::system::error_code segmentedDownload(const std::string&      url,
+                                            const std::string&      path,
+                                            ss1x::http::Headers&    header,
+                                            const download_options& options = download_options(),
+                                            std::string*            p_sha1 = nullptr);
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,107 @@
+// ss1x/asio/end_matcher.hpp
+#pragma once
+
+#include <sss/string_view.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+namespace ss1x {
+namespace detail {
+
+/**
+ * @brief 流式的结束标记匹配；支持多个标记
+ *
+ * 每次 feed() 只扫描新到的字节(memmem，由 libc 做向量化)；另外保留上次末尾
+ * 的 max_len - 1 个字节，与本次开头拼接后再查一次，于是跨越两次读取的
+ * 标记也能找到。assign() 之后，feed() 不再分配内存。
+ */
+class end_matcher
+{
+public:
+    end_matcher() : m_max_len(0), m_matched(false) {}
+
+    explicit end_matcher(const std::vector<std::string>& markers)
+        : m_max_len(0), m_matched(false)
+    {
+        this->assign(markers);
+    }
+
+    void assign(const std::vector<std::string>& markers)
+    {
+        m_markers.clear();
+        m_max_len = 0;
+        for (const auto& marker : markers) {
+            if (!marker.empty()) {
+                m_markers.push_back(marker);
+                m_max_len = std::max(m_max_len, marker.size());
+            }
+        }
+        m_tail.reserve(m_max_len * 2);
+        this->reset();
+    }
+
+    // 开始新的一段数据流；标记不变
+    void reset()
+    {
+        m_tail.clear();
+        m_matched = false;
+    }
+
+    bool empty()   const { return m_markers.empty(); }
+    bool matched() const { return m_matched;         }
+
+    // 至今喂入的数据中，出现过任一标记时，返回 true
+    bool feed(sss::string_view sv)
+    {
+        if (m_matched || m_markers.empty() || sv.empty()) {
+            return m_matched;
+        }
+        const size_t keep = m_max_len - 1;
+        if (!m_tail.empty()) {
+            m_tail.append(sv.data(), std::min(sv.size(), keep));
+            if (this->search(m_tail.data(), m_tail.size())) {
+                return m_matched = true;
+            }
+        }
+        if (this->search(sv.data(), sv.size())) {
+            return m_matched = true;
+        }
+
+        if (sv.size() >= keep) {
+            m_tail.assign(sv.data() + sv.size() - keep, keep);
+        }
+        else if (m_tail.empty()) {
+            m_tail.assign(sv.data(), sv.size());
+        }
+        else if (m_tail.size() > keep) {
+            m_tail.erase(0, m_tail.size() - keep);
+        }
+        return false;
+    }
+
+private:
+    bool search(const char* data, size_t size) const
+    {
+        for (const auto& marker : m_markers) {
+            if (marker.size() <= size &&
+                ::memmem(data, size, marker.data(), marker.size()) != nullptr)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::string> m_markers;
+    size_t                   m_max_len;
+    std::string              m_tail;
+    bool                     m_matched;
+};
+
+} // namespace detail
+} // namespace ss1x
@@ -74,6 +74,39 @@ enum errc_t
 
     redirect_not_found = 14,
 
+    /// Range request answered without "206 Partial Content"
+    range_not_supported = 15,
+
+    /// Content-Range does not match the requested range
+    invalid_content_range = 16,
+
+    /// Connection finished before the whole body was received
+    incomplete_body = 17,
+
+    /// Resource changed since the partial download began (If-Range failed)
+    resource_changed = 18,
+
+    /// Resolving and connecting (including the proxy CONNECT) took too long
+    connect_timeout = 19,
+
+    /// TLS handshake took too long
+    handshake_timeout = 20,
+
+    /// No status line received in time after sending the request
+    first_byte_timeout = 21,
+
+    /// No data received in time while reading headers or body
+    idle_timeout = 22,
+
+    /// The whole request (including redirects) took too long
+    total_timeout = 23,
+
+    /// The request body cannot be replayed for a redirect or a retry
+    body_not_rewindable = 24,
+
+    /// The request body source produced more or fewer bytes than its declared size
+    body_size_mismatch = 25,
+
 	// Server-generated status codes.
 
 	/// The server-generated status code "100 Continue".
@@ -306,6 +339,28 @@ class error_category_impl
             return "Exceed max redirect";
         case errc::redirect_not_found:
             return "Redirect not found";
+        case errc::range_not_supported:
+            return "Range request not supported";
+        case errc::invalid_content_range:
+            return "Invalid Content-Range";
+        case errc::incomplete_body:
+            return "Incomplete response body";
+        case errc::resource_changed:
+            return "Resource changed";
+        case errc::connect_timeout:
+            return "Connect timeout";
+        case errc::handshake_timeout:
+            return "TLS handshake timeout";
+        case errc::first_byte_timeout:
+            return "First byte timeout";
+        case errc::idle_timeout:
+            return "Idle read timeout";
+        case errc::total_timeout:
+            return "Total request timeout";
+        case errc::body_not_rewindable:
+            return "Request body cannot be rewound";
+        case errc::body_size_mismatch:
+            return "Request body size mismatch";
 		case errc::continue_request:
 			return "Continue";
 		case errc::switching_protocols:
@@ -440,6 +495,13 @@ class error_category_impl
 			return boost::system::errc::permission_denied;
 		case errc::not_found:
 			return boost::system::errc::no_such_file_or_directory;
+		case errc::deadline_timer_error:
+		case errc::connect_timeout:
+		case errc::handshake_timeout:
+		case errc::first_byte_timeout:
+		case errc::idle_timeout:
+		case errc::total_timeout:
+			return boost::system::errc::timed_out;
 		default:
 			return boost::system::error_condition(e, *this);
 		}
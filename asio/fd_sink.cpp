@@ -0,0 +1,309 @@
+// ss1x/asio/fd_sink.cpp
+#include "fd_sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+const size_t splice_chunk_size = 64 * 1024;
+
+} // namespace detail
+
+fd_sink::fd_sink(int fd, uint64_t offset, bool own_fd)
+    : m_fd(fd),
+      m_own_fd(own_fd),
+      m_offset(offset),
+      m_written(0),
+      m_map(nullptr),
+      m_map_size(0),
+      m_map_skip(0),
+      m_map_begin(0),
+      m_reserved(0),
+      m_file_size(0)
+{
+}
+
+fd_sink::~fd_sink()
+{
+    this->finish();
+    if (m_own_fd && m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool fd_sink::fail(int e)
+{
+    if (!m_ec) {
+        m_ec = boost::system::error_code(e, boost::system::system_category());
+        COLOG_ERROR(SSS_VALUE_MSG(m_fd), m_ec.message());
+    }
+    return false;
+}
+
+bool fd_sink::reserve(uint64_t size, boost::system::error_code& ec)
+{
+    this->unmap();
+    if (!size || m_ec) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0) {
+        ec = boost::system::error_code(errno, boost::system::system_category());
+        return false;
+    }
+    uint64_t begin = m_offset + m_written;
+    int ret = ::posix_fallocate(m_fd, off_t(begin), off_t(size));
+    // NOTE 部分文件系统不支持 fallocate；退回到 ftruncate(稀疏文件)
+    if ((ret == EOPNOTSUPP || ret == EINVAL) && uint64_t(st.st_size) < begin + size) {
+        ret = ::ftruncate(m_fd, off_t(begin + size)) == 0 ? 0 : errno;
+    }
+    if (ret) {
+        ec = boost::system::error_code(ret, boost::system::system_category());
+        return false;
+    }
+    m_reserved  = size;
+    m_file_size = uint64_t(st.st_size);
+
+    uint64_t page    = uint64_t(::sysconf(_SC_PAGESIZE));
+    uint64_t aligned = begin / page * page;
+    m_map_skip = size_t(begin - aligned);
+    m_map_size = size_t(m_map_skip + size);
+    void* p = ::mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, off_t(aligned));
+    if (p == MAP_FAILED) {
+        // NOTE 比如 fd 以 O_WRONLY 打开；预分配仍然有效，继续用 pwrite
+        ec = boost::system::error_code(errno, boost::system::system_category());
+        m_map_size = 0;
+        m_map_skip = 0;
+        return false;
+    }
+    m_map       = static_cast<char*>(p);
+    m_map_begin = m_written;
+    return true;
+}
+
+bool fd_sink::unmap()
+{
+    if (!m_map) {
+        return true;
+    }
+    int ret = ::munmap(m_map, m_map_size);
+    m_map      = nullptr;
+    m_map_size = 0;
+    m_map_skip = 0;
+    return ret == 0 || this->fail(errno);
+}
+
+bool fd_sink::write(sss::string_view sv)
+{
+    if (m_ec) {
+        return false;
+    }
+    if (m_map) {
+        uint64_t used = m_written - m_map_begin;
+        if (used + sv.size() <= m_reserved) {
+            std::memcpy(m_map + m_map_skip + used, sv.data(), sv.size());
+            m_written += sv.size();
+            return true;
+        }
+        // NOTE 超出了预分配的长度；剩下的改用 pwrite
+        COLOG_DEBUG("exceed reserved:", SSS_VALUE_MSG(m_reserved));
+        this->unmap();
+    }
+
+    const char* data = sv.data();
+    size_t      size = sv.size();
+    while (size) {
+        ssize_t n = ::pwrite(m_fd, data, size, off_t(m_offset + m_written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return this->fail(errno);
+        }
+        data      += n;
+        size      -= size_t(n);
+        m_written += uint64_t(n);
+    }
+    return true;
+}
+
+bool fd_sink::writev(const struct iovec* iov, size_t count)
+{
+    if (m_ec) {
+        return false;
+    }
+    if (m_map) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!this->write(sss::string_view(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<struct iovec> left(iov, iov + count);
+    size_t first = 0;
+    while (first < left.size()) {
+        int     cnt = int(std::min<size_t>(left.size() - first, IOV_MAX));
+        ssize_t n   = ::pwritev(m_fd, left.data() + first, cnt, off_t(m_offset + m_written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return this->fail(errno);
+        }
+        m_written += uint64_t(n);
+        // NOTE 部分写入；跳过已写完的 iovec，并调整第一个未写完的
+        size_t done = size_t(n);
+        while (first < left.size() && done >= left[first].iov_len) {
+            done -= left[first].iov_len;
+            ++first;
+        }
+        if (first < left.size()) {
+            left[first].iov_base = static_cast<char*>(left[first].iov_base) + done;
+            left[first].iov_len -= done;
+        }
+    }
+    return true;
+}
+
+bool fd_sink::copy_from_socket(int socket_fd, uint64_t max, uint64_t& moved)
+{
+    std::vector<char> buffer(detail::splice_chunk_size);
+    while (moved < max) {
+        size_t  want = size_t(std::min<uint64_t>(buffer.size(), max - moved));
+        ssize_t n    = ::read(socket_fd, buffer.data(), want);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return this->fail(errno);
+        }
+        if (n == 0) {
+            break;
+        }
+        if (!this->write(buffer.data(), size_t(n))) {
+            return false;
+        }
+        moved += uint64_t(n);
+    }
+    return true;
+}
+
+uint64_t fd_sink::splice_from(int socket_fd, uint64_t max)
+{
+    uint64_t moved = 0;
+    if (m_ec || !max) {
+        return moved;
+    }
+    // NOTE splice 直接写文件的 page cache；与 mmap 区混用时，先解除映射
+    this->unmap();
+
+    int pipe_fds[2];
+    if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        this->copy_from_socket(socket_fd, max, moved);
+        return moved;
+    }
+
+    bool to_file = true;
+    while (moved < max && !m_ec) {
+        size_t  want = size_t(std::min<uint64_t>(detail::splice_chunk_size, max - moved));
+        ssize_t n    = ::splice(socket_fd, nullptr, pipe_fds[1], nullptr, want,
+                                SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && !moved) {
+                // 源不支持 splice(比如不是 socket)
+                break;
+            }
+            this->fail(errno);
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        moved += uint64_t(n);
+
+        size_t left = size_t(n);
+        while (left && to_file) {
+            loff_t  off = loff_t(m_offset + m_written);
+            ssize_t m   = ::splice(pipe_fds[0], nullptr, m_fd, &off, left,
+                                   SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (m < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EINVAL) {
+                    // NOTE 目标文件系统不支持 splice；管道中剩下的，用 read 取出
+                    COLOG_DEBUG("splice to fd not supported:", SSS_VALUE_MSG(m_fd));
+                    to_file = false;
+                    break;
+                }
+                this->fail(errno);
+                break;
+            }
+            left      -= size_t(m);
+            m_written += uint64_t(m);
+        }
+        // 退化后，把管道中的数据读出来写入
+        while (left && !m_ec) {
+            char    buffer[4096];
+            ssize_t m = ::read(pipe_fds[0], buffer, std::min(sizeof(buffer), left));
+            if (m < 0 && errno == EINTR) {
+                continue;
+            }
+            if (m <= 0) {
+                this->fail(m < 0 ? errno : EIO);
+                break;
+            }
+            this->write(buffer, size_t(m));
+            left -= size_t(m);
+        }
+        if (!to_file && !m_ec) {
+            ::close(pipe_fds[0]);
+            ::close(pipe_fds[1]);
+            this->copy_from_socket(socket_fd, max, moved);
+            return moved;
+        }
+    }
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+
+    if (!moved && !m_ec) {
+        this->copy_from_socket(socket_fd, max, moved);
+    }
+    return moved;
+}
+
+bool fd_sink::finish()
+{
+    bool ok = this->unmap();
+    if (m_reserved) {
+        // 预分配而未写入的部分，截掉
+        uint64_t size = std::max(m_file_size, m_offset + m_written);
+        if (::ftruncate(m_fd, off_t(size)) != 0) {
+            ok = this->fail(errno);
+        }
+        m_reserved = 0;
+    }
+    return ok;
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,122 @@
+// ss1x/asio/fd_sink.hpp
+#pragma once
+
+#include <sss/string_view.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 直接写文件描述符的 body 接收端；不经过 std::ostream
+ *
+ * - write(sv)：pwrite 到当前偏移；reserve() 之后，改为拷贝进 mmap 的预分配区，
+ *   不再有系统调用；
+ * - write_buffers()：把 asio 的 buffer 序列，用一次 pwritev 写出；
+ * - splice_from()：明文 socket 上的 identity body，经 pipe 直接搬进 fd，
+ *   数据不进用户态。
+ *
+ * 出错后，后续写入都被忽略；用 error() 取第一个错误。
+ * NOTE 本身不加锁；同一时刻只应由一个请求写入。
+ */
+class fd_sink
+{
+public:
+    explicit fd_sink(int fd, uint64_t offset = 0, bool own_fd = false);
+    ~fd_sink();
+
+    fd_sink(const fd_sink&) = delete;
+    fd_sink& operator=(const fd_sink&) = delete;
+
+    /**
+     * @brief 在当前偏移处预分配 size 字节，并 mmap 成可写区域
+     *
+     * 失败时(比如 fd 不是普通文件)，返回 false；sink 仍可用 pwrite 继续写。
+     */
+    bool reserve(uint64_t size, boost::system::error_code& ec);
+
+    bool write(sss::string_view sv);
+
+    bool write(const char* data, size_t size)
+    {
+        return this->write(sss::string_view(data, size));
+    }
+
+    template <typename ConstBufferSequence>
+    bool write_buffers(const ConstBufferSequence& buffers)
+    {
+        std::vector<struct iovec> iov;
+        for (auto it = boost::asio::buffer_sequence_begin(buffers);
+             it != boost::asio::buffer_sequence_end(buffers); ++it)
+        {
+            boost::asio::const_buffer b(*it);
+            if (b.size()) {
+                struct iovec v;
+                v.iov_base = const_cast<void*>(b.data());
+                v.iov_len  = b.size();
+                iov.push_back(v);
+            }
+        }
+        return this->writev(iov.data(), iov.size());
+    }
+
+    bool writev(const struct iovec* iov, size_t count);
+
+    /**
+     * @brief 从(阻塞模式的)socket 直接搬运至多 max 字节，或者直到对方关闭连接
+     *
+     * 内核不支持对 fd 做 splice 时，退回 read + pwrite。
+     *
+     * @return 搬运的字节数；出错时，error() 被设置
+     */
+    uint64_t splice_from(int socket_fd, uint64_t max);
+
+    /**
+     * @brief 解除映射；预分配而未写入的部分会被截掉
+     */
+    bool finish();
+
+    uint64_t                         written() const { return m_written; }
+    const boost::system::error_code& error()   const { return m_ec;      }
+
+    int fd() const { return m_fd; }
+
+private:
+    bool fail(int e);
+    bool unmap();
+    bool copy_from_socket(int socket_fd, uint64_t max, uint64_t& moved);
+
+    int                       m_fd;
+    bool                      m_own_fd;
+    uint64_t                  m_offset;
+    uint64_t                  m_written;
+    boost::system::error_code m_ec;
+
+    // mmap 的预分配区
+    char*                     m_map;
+    size_t                    m_map_size;
+    // 映射起点需要页对齐；m_map + m_map_skip 对应 reserve() 时的写入位置
+    size_t                    m_map_skip;
+    uint64_t                  m_map_begin;
+    uint64_t                  m_reserved;
+    // reserve() 之前的文件长度；finish() 时，只截掉预分配新增的部分
+    uint64_t                  m_file_size;
+};
+
+// 包装成 session::onContent_t 可用的回调
+inline std::function<void(sss::string_view)> fd_sink_func(const std::shared_ptr<fd_sink>& sink)
+{
+    return [sink](sss::string_view sv) -> void { sink->write(sv); };
+}
+
+} // namespace asio
+} // namespace ss1x
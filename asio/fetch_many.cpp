@@ -0,0 +1,281 @@
+// ss1x/asio/fetch_many.cpp
+#include "fetch_many.hpp"
+
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+// NOTE 批量请求的调度状态；由各个请求的完成回调共享
+struct fetch_batch_t
+{
+    typedef std::chrono::steady_clock clock_type;
+
+    struct host_queue_t
+    {
+        host_queue_t() : in_flight(0) {}
+
+        // 待发起的 url 下标，保持 urls 中的顺序
+        std::deque<size_t>     pending;
+        size_t                 in_flight;
+        // 在此之前，不能再对该 host 发起请求
+        clock_type::time_point next_start;
+    };
+
+    fetch_batch_t(session& s, const std::vector<std::string>& u, size_t c,
+                  const fetch_politeness& p, const sink_factory_t& f,
+                  const request_options& o, const fetch_done_t& d)
+        : sess(s), urls(u), concurrency(c), politeness(p), sink_factory(f), options(o),
+          on_done(d), results(u.size()), host_of(u.size()), cursor(0), in_flight(0),
+          timer(s.get_io_service()), timer_armed(false)
+    {
+    }
+
+    session&                        sess;
+    const std::vector<std::string>& urls;
+    const size_t                    concurrency;
+    const fetch_politeness          politeness;
+    const sink_factory_t&           sink_factory;
+    const request_options&          options;
+    const fetch_done_t&             on_done;
+
+    std::vector<fetch_result>       results;
+
+    // NOTE 以下各项由 lock 保护；多线程驱动时，完成回调、定时器可能同时发生
+    std::mutex                            lock;
+    std::vector<std::string>              host_of;
+    std::map<std::string, host_queue_t>   hosts;
+    // 还有待发起 url 的 host，轮转的顺序
+    std::vector<std::string>              ring;
+    size_t                                cursor;
+    size_t                                in_flight;
+    boost::asio::steady_timer             timer;
+    bool                                  timer_armed;
+    clock_type::time_point                timer_at;
+};
+
+std::string host_key(const std::string& url)
+{
+    auto url_info = ss1x::util::url::split_port_auto(url);
+    std::string host = std::get<1>(url_info);
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) -> char { return char(std::tolower(c)); });
+    return host + ':' + std::to_string(std::get<2>(url_info));
+}
+
+void fetch_schedule(const std::shared_ptr<fetch_batch_t>& batch);
+
+// 在各 host 之间轮转，挑出可以立即发起的 url；都在等间隔时，earliest 为
+// 最早可以发起的时间
+void fetch_pick_locked(fetch_batch_t& batch, fetch_batch_t::clock_type::time_point now,
+                       std::vector<size_t>& picks,
+                       fetch_batch_t::clock_type::time_point& earliest)
+{
+    const size_t per_host = batch.politeness.per_host;
+    while (batch.in_flight < batch.concurrency && !batch.ring.empty()) {
+        bool picked = false;
+        for (size_t n = 0; n < batch.ring.size() && !picked;) {
+            if (batch.cursor >= batch.ring.size()) {
+                batch.cursor = 0;
+            }
+            fetch_batch_t::host_queue_t& host = batch.hosts[batch.ring[batch.cursor]];
+            if (host.pending.empty()) {
+                batch.ring.erase(batch.ring.begin() + std::ptrdiff_t(batch.cursor));
+                continue;
+            }
+            if (per_host && host.in_flight >= per_host) {
+                ++batch.cursor;
+                ++n;
+                continue;
+            }
+            if (host.next_start > now) {
+                earliest = std::min(earliest, host.next_start);
+                ++batch.cursor;
+                ++n;
+                continue;
+            }
+            picks.push_back(host.pending.front());
+            host.pending.pop_front();
+            ++host.in_flight;
+            ++batch.in_flight;
+            host.next_start = now + batch.politeness.min_interval;
+            ++batch.cursor;
+            picked = true;
+        }
+        if (!picked) {
+            break;
+        }
+    }
+}
+
+void fetch_arm_timer_locked(const std::shared_ptr<fetch_batch_t>& batch,
+                            fetch_batch_t::clock_type::time_point at)
+{
+    if (batch->timer_armed && batch->timer_at <= at) {
+        return;
+    }
+    batch->timer_armed = true;
+    batch->timer_at    = at;
+    // NOTE 重设时间会取消之前的等待，其回调得到 operation_aborted
+    batch->timer.expires_at(at);
+    batch->timer.async_wait([batch](const boost::system::error_code& ec) -> void {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(batch->lock);
+            batch->timer_armed = false;
+        }
+        fetch_schedule(batch);
+    });
+}
+
+void fetch_finished(const std::shared_ptr<fetch_batch_t>& batch, size_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(batch->lock);
+        --batch->in_flight;
+        --batch->hosts[batch->host_of[index]].in_flight;
+    }
+    if (batch->on_done) {
+        batch->on_done(index, batch->results[index]);
+    }
+    fetch_schedule(batch);
+}
+
+void fetch_start(const std::shared_ptr<fetch_batch_t>& batch, size_t index)
+{
+    const std::string& url = batch->urls[index];
+    batch->results[index].url = url;
+
+    session::onContent_t on_content;
+    if (batch->sink_factory) {
+        on_content = batch->sink_factory(index, url);
+    }
+    if (!on_content) {
+        on_content = [](sss::string_view) -> void {};
+    }
+
+    // NOTE results 不再改变大小，其中元素的地址，一直有效到 batch 结束
+    request_options options = batch->options;
+    options.stats           = &batch->results[index].stats;
+
+    try {
+        batch->sess.async_get(
+            url, std::move(on_content),
+            [batch, index](const boost::system::error_code& ec,
+                           const ss1x::http::Headers& header) -> void {
+                fetch_result& result = batch->results[index];
+                result.ec     = ec;
+                result.header = header;
+                fetch_finished(batch, index);
+            },
+            options);
+    }
+    // NOTE 发起阶段的同步错误(比如 url 无法解析)，只影响这一个 url
+    catch (boost::system::system_error& e) {
+        COLOG_ERROR(SSS_VALUE_MSG(url), e.what());
+        batch->results[index].ec = e.code();
+        fetch_finished(batch, index);
+    }
+    catch (std::exception& e) {
+        COLOG_ERROR(SSS_VALUE_MSG(url), e.what());
+        batch->results[index].ec = boost::asio::error::invalid_argument;
+        fetch_finished(batch, index);
+    }
+}
+
+void fetch_schedule(const std::shared_ptr<fetch_batch_t>& batch)
+{
+    std::vector<size_t> picks;
+    {
+        std::lock_guard<std::mutex> lock(batch->lock);
+        const auto now      = fetch_batch_t::clock_type::now();
+        auto       earliest = fetch_batch_t::clock_type::time_point::max();
+        fetch_pick_locked(*batch, now, picks, earliest);
+        if (batch->in_flight < batch->concurrency &&
+            earliest != fetch_batch_t::clock_type::time_point::max())
+        {
+            fetch_arm_timer_locked(batch, earliest);
+        }
+    }
+    // NOTE 在锁外发起；同步失败时，fetch_finished() 会再次进入本函数
+    for (size_t index : picks) {
+        fetch_start(batch, index);
+    }
+}
+
+} // namespace detail
+
+std::vector<fetch_result> fetchMany(session&                        sess,
+                                    const std::vector<std::string>& urls,
+                                    size_t                          concurrency,
+                                    const fetch_politeness&         politeness,
+                                    const sink_factory_t&           sink_factory,
+                                    const request_options&          options,
+                                    const fetch_done_t&             on_done)
+{
+    if (!concurrency) {
+        concurrency = 1;
+    }
+    const size_t per_host = politeness.per_host ? std::min(politeness.per_host, concurrency)
+                                                : concurrency;
+    if (sess.pool().max_idle_per_host() < per_host) {
+        sess.pool().max_idle_per_host(per_host);
+    }
+
+    std::shared_ptr<detail::fetch_batch_t> batch = std::make_shared<detail::fetch_batch_t>(
+        sess, urls, concurrency, politeness, sink_factory, options, on_done);
+
+    for (size_t i = 0; i < urls.size(); ++i) {
+        const std::string key = detail::host_key(urls[i]);
+        auto& host = batch->hosts[key];
+        if (host.pending.empty()) {
+            batch->ring.push_back(key);
+        }
+        host.pending.push_back(i);
+        batch->host_of[i] = key;
+    }
+
+    detail::fetch_schedule(batch);
+    sess.run();
+
+    return std::move(batch->results);
+}
+
+std::vector<fetch_result> fetchMany(session&                        sess,
+                                    const std::vector<std::string>& urls,
+                                    size_t                          concurrency,
+                                    const sink_factory_t&           sink_factory,
+                                    const request_options&          options,
+                                    const fetch_done_t&             on_done)
+{
+    return fetchMany(sess, urls, concurrency, fetch_politeness(), sink_factory, options,
+                     on_done);
+}
+
+std::vector<fetch_result> fetchMany(const std::vector<std::string>& urls,
+                                    size_t                          concurrency,
+                                    const sink_factory_t&           sink_factory,
+                                    const request_options&          options,
+                                    const fetch_done_t&             on_done)
+{
+    return fetchMany(session::default_session(), urls, concurrency, fetch_politeness(),
+                     sink_factory, options, on_done);
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,87 @@
+// ss1x/asio/fetch_many.hpp
+#pragma once
+
+#include <ss1x/asio/session.hpp>
+#include <ss1x/asio/headers.hpp>
+#include <ss1x/asio/request_stats.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/system/error_code.hpp>
+
+namespace ss1x {
+namespace asio {
+
+struct fetch_result
+{
+    std::string               url;
+    boost::system::error_code ec;
+    ss1x::http::Headers       header;
+    // 该 url 的各阶段耗时与字节数
+    request_stats             stats;
+};
+
+// 为第 index 个 url 创建接收内容的回调；返回空函数，表示丢弃内容
+typedef std::function<session::onContent_t(size_t index, const std::string& url)>
+    sink_factory_t;
+
+// 单个 url 完成时的通知；在驱动 io_service 的线程中调用；
+// sess.threads() > 1 时，可能被并发调用
+typedef std::function<void(size_t index, const fetch_result& result)>
+    fetch_done_t;
+
+// NOTE 对单个 host(域名:端口)的礼貌限制
+struct fetch_politeness
+{
+    fetch_politeness() : per_host(0), min_interval(0) {}
+
+    // 每个 host 同时进行的请求数上限；0 表示只受总并发数限制
+    size_t                    per_host;
+    // 同一 host 相邻两次请求的最小发起间隔
+    std::chrono::milliseconds min_interval;
+};
+
+/**
+ * @brief 在同一个 io_service 上，并发获取一批 url
+ *
+ * 按 host 把 url 分到各自的队列中，各队列内保持 urls 中的先后顺序；同一时刻
+ * 最多有 concurrency 个请求在进行。有空位时，在各 host 之间轮转，取下一个
+ * 满足 politeness 的 host 发起请求；受限的 host 直接跳过，不占用空位，于是
+ * 个别慢 host 不会拖住其他 host；所有 host 都在等间隔时，由定时器唤醒。
+ * 结果按 urls 的顺序返回；由 sess.threads() 个线程驱动。
+ *
+ * 各请求共享 sess 的连接池、TLS session 缓存以及 dns 缓存；连接池每个
+ * host 的空闲连接上限，不足 concurrency 时，会被调高到 concurrency，
+ * 以免并发请求归还的连接被丢弃。
+ *
+ * 每个 url 的 stats 写入各自的 fetch_result；options.stats 被忽略，
+ * options.on_stats 对每个 url 各调用一次。
+ */
+std::vector<fetch_result> fetchMany(session&                        sess,
+                                    const std::vector<std::string>& urls,
+                                    size_t                          concurrency,
+                                    const fetch_politeness&         politeness,
+                                    const sink_factory_t&           sink_factory,
+                                    const request_options&          options = request_options(),
+                                    const fetch_done_t&             on_done = fetch_done_t());
+
+// 不限制单个 host
+std::vector<fetch_result> fetchMany(session&                        sess,
+                                    const std::vector<std::string>& urls,
+                                    size_t                          concurrency,
+                                    const sink_factory_t&           sink_factory,
+                                    const request_options&          options = request_options(),
+                                    const fetch_done_t&             on_done = fetch_done_t());
+
+// 使用当前线程的 session::default_session()
+std::vector<fetch_result> fetchMany(const std::vector<std::string>& urls,
+                                    size_t                          concurrency,
+                                    const sink_factory_t&           sink_factory,
+                                    const request_options&          options = request_options(),
+                                    const fetch_done_t&             on_done = fetch_done_t());
+
+} // namespace asio
+} // namespace ss1x
@@ -2,6 +2,9 @@
 
 #include <sss/debug/value_msg.hpp>
 #include <ss1x/asio/error_codec.hpp>
+#include <ss1x/asio/metrics.hpp>
+
+#include <chrono>
 
 #include <boost/asio/error.hpp>
 
@@ -58,6 +61,22 @@ void gzstream::close()
     std::memset(&m_stream, 0, sizeof(m_stream));
 }
 
+namespace {
+
+const ss1x::asio::decoder_metrics& metrics_of(gzstream::method_t m)
+{
+    static const ss1x::asio::decoder_metrics s_gzip("gzip");
+    static const ss1x::asio::decoder_metrics s_zlib("zlib");
+    static const ss1x::asio::decoder_metrics s_deflate("deflate");
+    switch (m) {
+        case gzstream::mt_zlib:    return s_zlib;
+        case gzstream::mt_deflate: return s_deflate;
+        default:                   return s_gzip;
+    }
+}
+
+} // namespace
+
 int gzstream::inflate(const char * data, size_t size, error_code_type* p_ec)
 {
     //std::cout << sss::raw_string(data, size) << std::endl;
@@ -66,15 +85,20 @@ int gzstream::inflate(const char * data, size_t size, error_code_type* p_ec)
         m_stream.avail_in = size;
         m_stream.next_in = (z_const Bytef *)data;
     }
+    const uInt avail_in = m_stream.avail_in;
     int bytes_transferred = 0;
     int ec = Z_OK;
+    // NOTE 只计 ::inflate() 本身的耗时；on_avail_out() 中是消费者的处理
+    std::chrono::steady_clock::duration elapsed(0);
     // http://www.zlib.net/zlib_how.html
     while (m_stream.avail_in > 0 && ec == Z_OK) {
         COLOG_DEBUG(SSS_VALUE_MSG(m_stream.avail_in));
         m_stream.avail_out =
             sizeof(m_zlib_buffer);  // 输出位置，连续空闲内存区域长度
         m_stream.next_out = (Bytef *)m_zlib_buffer;  // 下一个输出位置地址；
+        auto begin = std::chrono::steady_clock::now();
         ec = ::inflate(&m_stream, Z_SYNC_FLUSH);
+        elapsed += std::chrono::steady_clock::now() - begin;
         if (ec < 0) {
             if (ec == Z_BUF_ERROR) // extra input needed
             {
@@ -89,6 +113,8 @@ int gzstream::inflate(const char * data, size_t size, error_code_type* p_ec)
         base_type::on_avail_out(m_zlib_buffer, current_cnt);
         bytes_transferred += current_cnt;
     }
+    metrics_of(m_method).record(avail_in - m_stream.avail_in, bytes_transferred,
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
     return bytes_transferred;
 }
 
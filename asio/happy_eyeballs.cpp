@@ -0,0 +1,307 @@
+// ss1x/asio/happy_eyeballs.cpp
+#include "happy_eyeballs.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+#include <boost/bind.hpp>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+const int    endpoint_history::default_window;
+const size_t endpoint_history::default_max_entries;
+
+endpoint_history::endpoint_history(int window)
+    : m_window(window)
+{
+}
+
+endpoint_history& endpoint_history::instance()
+{
+    static endpoint_history history;
+    return history;
+}
+
+uint32_t endpoint_history::failures_locked(const endpoint_type& endpoint,
+                                           clock_type::time_point now) const
+{
+    auto it = m_entries.find(endpoint);
+    if (it == m_entries.end() || it->second.last_failure + m_window <= now) {
+        return 0;
+    }
+    return it->second.failures;
+}
+
+void endpoint_history::purge_locked(clock_type::time_point now)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->second.last_failure + m_window <= now) {
+            it = m_entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void endpoint_history::record_failure(const endpoint_type& endpoint)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto now = clock_type::now();
+    if (m_entries.size() >= default_max_entries) {
+        this->purge_locked(now);
+    }
+    entry_t& entry = m_entries[endpoint];
+    // 窗口之外的旧记录，从头计数
+    if (entry.failures && entry.last_failure + m_window <= now) {
+        entry.failures = 0;
+    }
+    ++entry.failures;
+    entry.last_failure = now;
+}
+
+void endpoint_history::record_success(const endpoint_type& endpoint)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_entries.erase(endpoint);
+}
+
+uint32_t endpoint_history::failures(const endpoint_type& endpoint) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return this->failures_locked(endpoint, clock_type::now());
+}
+
+void endpoint_history::sort(std::vector<endpoint_type>& endpoints) const
+{
+    if (endpoints.size() < 2) {
+        return;
+    }
+    std::vector<std::pair<uint32_t, endpoint_type>> failing;
+    std::deque<endpoint_type> first_family;
+    std::deque<endpoint_type> other_family;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto now = clock_type::now();
+        bool has_family = false;
+        bool is_v6      = false;
+        for (const auto& endpoint : endpoints) {
+            uint32_t cnt = this->failures_locked(endpoint, now);
+            if (cnt) {
+                failing.emplace_back(cnt, endpoint);
+                continue;
+            }
+            if (!has_family) {
+                has_family = true;
+                is_v6      = endpoint.address().is_v6();
+            }
+            if (endpoint.address().is_v6() == is_v6) {
+                first_family.push_back(endpoint);
+            }
+            else {
+                other_family.push_back(endpoint);
+            }
+        }
+    }
+    std::stable_sort(failing.begin(), failing.end(),
+                     [](const std::pair<uint32_t, endpoint_type>& l,
+                        const std::pair<uint32_t, endpoint_type>& r) -> bool {
+                         return l.first < r.first;
+                     });
+
+    endpoints.clear();
+    while (!first_family.empty() || !other_family.empty()) {
+        if (!first_family.empty()) {
+            endpoints.push_back(first_family.front());
+            first_family.pop_front();
+        }
+        if (!other_family.empty()) {
+            endpoints.push_back(other_family.front());
+            other_family.pop_front();
+        }
+    }
+    for (const auto& item : failing) {
+        endpoints.push_back(item.second);
+    }
+}
+
+void endpoint_history::clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_entries.clear();
+}
+
+size_t endpoint_history::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_entries.size();
+}
+
+const int happy_eyeballs::default_attempt_delay_ms;
+
+happy_eyeballs::happy_eyeballs(boost::asio::io_service& io_service, socket_type& target,
+                               std::vector<endpoint_type>&& endpoints, handler_t&& handler,
+                               clock_type::duration attempt_delay)
+    : m_io_service(io_service),
+      m_strand(io_service),
+      m_wheel(timer_wheel::of(io_service)),
+      m_target(target),
+      m_endpoints(std::move(endpoints)),
+      m_sockets(m_endpoints.size()),
+      m_handler(std::move(handler)),
+      m_attempt_delay(attempt_delay),
+      m_delay_timer(0),
+      m_next(0),
+      m_running(0),
+      m_done(false)
+{
+}
+
+happy_eyeballs::~happy_eyeballs()
+{
+}
+
+std::shared_ptr<happy_eyeballs>
+happy_eyeballs::async_connect(boost::asio::io_service& io_service, socket_type& target,
+                              iterator_type first, handler_t&& handler,
+                              clock_type::duration attempt_delay)
+{
+    std::vector<endpoint_type> endpoints;
+    for (iterator_type end; first != end; ++first) {
+        endpoints.push_back(first->endpoint());
+    }
+    endpoint_history::instance().sort(endpoints);
+
+    auto op = std::make_shared<happy_eyeballs>(io_service, target, std::move(endpoints),
+                                               std::move(handler), attempt_delay);
+    op->m_strand.post(boost::bind(&happy_eyeballs::start_next, op));
+    return op;
+}
+
+void happy_eyeballs::connect(boost::asio::io_service& io_service, socket_type& target,
+                             iterator_type first, boost::system::error_code& ec)
+{
+    bool done = false;
+    auto op   = async_connect(io_service, target, first,
+                              [&ec, &done](const boost::system::error_code& err) -> void {
+                                  ec   = err;
+                                  done = true;
+                              });
+    while (!done) {
+        if (!io_service.run_one()) {
+            // NOTE io_service 已被 stop()；恢复之后继续，直到本次建链结束
+            io_service.reset();
+        }
+    }
+}
+
+void happy_eyeballs::cancel()
+{
+    // NOTE 用 post 而不是 dispatch：调用者可能正处于某个 strand 中，不应在
+    // cancel() 内部就调用 handler
+    auto self = this->shared_from_this();
+    m_strand.post([self]() -> void {
+        if (!self->m_done) {
+            self->finish(boost::asio::error::operation_aborted);
+        }
+    });
+}
+
+void happy_eyeballs::start_next()
+{
+    if (m_done) {
+        return;
+    }
+    if (m_delay_timer) {
+        m_wheel.cancel(m_delay_timer);
+        m_delay_timer = 0;
+    }
+    if (m_next >= m_endpoints.size()) {
+        if (!m_running) {
+            this->finish(m_last_ec ? m_last_ec : boost::asio::error::host_not_found);
+        }
+        return;
+    }
+
+    size_t index = m_next++;
+    COLOG_DEBUG("connect attempt", index, m_endpoints[index]);
+    m_sockets[index].reset(new socket_type(m_io_service));
+    ++m_running;
+    m_sockets[index]->async_connect(
+        m_endpoints[index],
+        m_strand.wrap(boost::bind(&happy_eyeballs::on_connect, this->shared_from_this(),
+                                  index, boost::asio::placeholders::error)));
+
+    if (m_next < m_endpoints.size()) {
+        m_delay_timer = m_wheel.schedule(
+            m_attempt_delay,
+            m_strand.wrap(boost::bind(&happy_eyeballs::on_delay, this->shared_from_this(), m_next)));
+    }
+}
+
+void happy_eyeballs::on_delay(size_t expected_next)
+{
+    m_delay_timer = 0;
+    // NOTE 期间已有尝试失败，并提前发起了下一个
+    if (m_done || m_next != expected_next) {
+        return;
+    }
+    this->start_next();
+}
+
+void happy_eyeballs::on_connect(size_t index, const boost::system::error_code& ec)
+{
+    --m_running;
+    if (m_done) {
+        return;
+    }
+    const endpoint_type& endpoint = m_endpoints[index];
+    if (ec) {
+        COLOG_DEBUG("connect failed:", endpoint, ec.message());
+        endpoint_history::instance().record_failure(endpoint);
+        m_last_ec = ec;
+        m_sockets[index].reset();
+        this->start_next();
+        return;
+    }
+    endpoint_history::instance().record_success(endpoint);
+    // NOTE 先发起、却输给了后发起者的尝试，至少慢了 attempt_delay；也记为失败，
+    // 否则黑洞地址永远不会被排到后面
+    for (size_t i = 0; i < index; ++i) {
+        if (m_sockets[i]) {
+            endpoint_history::instance().record_failure(m_endpoints[i]);
+        }
+    }
+    m_target = std::move(*m_sockets[index]);
+    m_sockets[index].reset();
+    this->finish(ec);
+}
+
+void happy_eyeballs::finish(const boost::system::error_code& ec)
+{
+    m_done = true;
+    if (m_delay_timer) {
+        m_wheel.cancel(m_delay_timer);
+        m_delay_timer = 0;
+    }
+    // 落选的尝试，回调以 operation_aborted 返回
+    for (auto& sock : m_sockets) {
+        if (sock) {
+            boost::system::error_code ignored;
+            sock->close(ignored);
+        }
+    }
+    handler_t handler = std::move(m_handler);
+    m_handler = nullptr;
+    if (handler) {
+        handler(ec);
+    }
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,145 @@
+// ss1x/asio/happy_eyeballs.hpp
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "timer_wheel.hpp"
+
+namespace ss1x {
+namespace asio {
+
+// NOTE 进程级的建链失败记录
+//
+// 最近 window() 秒内连接失败过的地址，排到其他地址之后；失败次数越多越靠后。
+// 连接成功一次，记录即清除。各个成员函数都是线程安全的。
+class endpoint_history
+{
+public:
+    typedef boost::asio::ip::tcp::endpoint endpoint_type;
+    typedef std::chrono::steady_clock      clock_type;
+
+    static const int    default_window      = 600; // seconds
+    static const size_t default_max_entries = 4096;
+
+    explicit endpoint_history(int window = default_window);
+
+    endpoint_history(const endpoint_history&) = delete;
+    endpoint_history& operator=(const endpoint_history&) = delete;
+
+    static endpoint_history& instance();
+
+public:
+    void     record_failure(const endpoint_type& endpoint);
+    void     record_success(const endpoint_type& endpoint);
+
+    // 窗口内的失败次数
+    uint32_t failures(const endpoint_type& endpoint) const;
+
+    /**
+     * @brief 按 RFC 8305 排序：地址族交替(以第一个地址的族开头)；
+     * 近期失败过的，按失败次数，排在最后
+     */
+    void     sort(std::vector<endpoint_type>& endpoints) const;
+
+    void     clear();
+    size_t   size() const;
+
+    int      window() const             { return int(m_window.count());         }
+    void     window(int seconds)        { m_window = std::chrono::seconds(seconds); }
+
+private:
+    struct entry_t
+    {
+        uint32_t               failures;
+        clock_type::time_point last_failure;
+    };
+    typedef std::map<endpoint_type, entry_t> entry_map_t;
+
+    uint32_t failures_locked(const endpoint_type& endpoint, clock_type::time_point now) const;
+    void     purge_locked(clock_type::time_point now);
+
+    mutable std::mutex   m_lock;
+    entry_map_t          m_entries;
+    std::chrono::seconds m_window;
+};
+
+/**
+ * @brief RFC 8305(Happy Eyeballs v2)风格的并行建链
+ *
+ * 按 endpoint_history::sort() 的顺序，每隔 attempt_delay 发起下一个地址的连接；
+ * 某个尝试失败时，不等间隔，立即开始下一个。第一个成功的 socket 移入 target，
+ * 其余的尝试全部关闭。于是一个黑洞地址，只耽误 attempt_delay，而不是整个
+ * 连接超时。
+ *
+ * handler(ec) 只调用一次；全部失败时，ec 为最后一个失败的原因；cancel() 之后，
+ * 为 operation_aborted。
+ *
+ * NOTE target 必须与 io_service 关联；在 handler 被调用之前，不要使用 target。
+ */
+class happy_eyeballs : public std::enable_shared_from_this<happy_eyeballs>
+{
+public:
+    typedef boost::asio::ip::tcp::socket             socket_type;
+    typedef boost::asio::ip::tcp::endpoint           endpoint_type;
+    typedef boost::asio::ip::tcp::resolver::iterator iterator_type;
+    typedef timer_wheel::clock_type                  clock_type;
+    typedef std::function<void(const boost::system::error_code& ec)> handler_t;
+
+    // RFC 8305 推荐的 "Connection Attempt Delay"
+    static const int default_attempt_delay_ms = 250;
+
+    static std::shared_ptr<happy_eyeballs>
+    async_connect(boost::asio::io_service& io_service, socket_type& target,
+                  iterator_type first, handler_t&& handler,
+                  clock_type::duration attempt_delay =
+                      std::chrono::milliseconds(default_attempt_delay_ms));
+
+    // 同步版本；内部驱动 io_service，直到建链完成
+    static void connect(boost::asio::io_service& io_service, socket_type& target,
+                        iterator_type first, boost::system::error_code& ec);
+
+    // 放弃所有尝试；可以在任意线程调用
+    void cancel();
+
+    // 已经发起的尝试数
+    size_t attempts() const { return m_next; }
+
+    happy_eyeballs(boost::asio::io_service& io_service, socket_type& target,
+                   std::vector<endpoint_type>&& endpoints, handler_t&& handler,
+                   clock_type::duration attempt_delay);
+    ~happy_eyeballs();
+
+private:
+    void start_next();
+    void on_delay(size_t expected_next);
+    void on_connect(size_t index, const boost::system::error_code& ec);
+    void finish(const boost::system::error_code& ec);
+
+    boost::asio::io_service&                  m_io_service;
+    // NOTE 各个尝试的回调，经由 m_strand 串行执行
+    boost::asio::io_service::strand           m_strand;
+    timer_wheel&                              m_wheel;
+    socket_type&                              m_target;
+    std::vector<endpoint_type>                m_endpoints;
+    std::vector<std::unique_ptr<socket_type>> m_sockets;
+    handler_t                                 m_handler;
+    clock_type::duration                      m_attempt_delay;
+    timer_wheel::timer_id                     m_delay_timer;
+    // 下一个要尝试的地址
+    size_t                                    m_next;
+    // 尚未返回的尝试数
+    size_t                                    m_running;
+    bool                                      m_done;
+    boost::system::error_code                 m_last_ec;
+};
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,594 @@
+// ss1x/asio/http_cache.cpp
+#include "http_cache.hpp"
+
+#include "metrics.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <openssl/sha.h>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+std::string to_lower_copy(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) -> char { return char(std::tolower(c)); });
+    return s;
+}
+
+std::string trim_copy(const std::string& s)
+{
+    std::string::size_type first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    std::string::size_type last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+std::string sha1_hex(const std::string& s)
+{
+    static const char digits[] = "0123456789abcdef";
+    unsigned char     md[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(s.data()), s.size(), md);
+    std::string ret;
+    ret.reserve(SHA_DIGEST_LENGTH * 2);
+    for (unsigned char c : md) {
+        ret.push_back(digits[c >> 4]);
+        ret.push_back(digits[c & 0x0Fu]);
+    }
+    return ret;
+}
+
+struct cache_control_t
+{
+    cache_control_t() : no_store(false), no_cache(false), max_age(-1) {}
+
+    bool    no_store;
+    bool    no_cache;
+    int64_t max_age;
+};
+
+// NOTE 只关心私有缓存用得到的几个指令；s-maxage、public 等忽略
+cache_control_t parse_cache_control(const std::string& value)
+{
+    cache_control_t ret;
+    std::string::size_type pos = 0;
+    while (pos <= value.size()) {
+        std::string::size_type comma = value.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = value.size();
+        }
+        std::string directive = to_lower_copy(trim_copy(value.substr(pos, comma - pos)));
+        if (directive == "no-store") {
+            ret.no_store = true;
+        }
+        else if (directive == "no-cache" || directive.compare(0, 9, "no-cache=") == 0) {
+            ret.no_cache = true;
+        }
+        else if (directive.compare(0, 8, "max-age=") == 0) {
+            std::string arg = directive.substr(8);
+            if (!arg.empty() && arg.front() == '"') {
+                arg = arg.substr(1, arg.size() >= 2 ? arg.size() - 2 : 0);
+            }
+            ret.max_age = std::strtoll(arg.c_str(), nullptr, 10);
+        }
+        pos = comma + 1;
+    }
+    return ret;
+}
+
+// 304 中，描述 body 本身的字段，以磁盘上的为准
+bool is_body_field(const std::string& key)
+{
+    static const char* const fields[] = {
+        "Content-Length", "Content-Encoding", "Transfer-Encoding", "Content-Range",
+    };
+    for (const char* field : fields) {
+        if (strcasecmp(key.c_str(), field) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* const hdr_suffix  = ".hdr";
+const char* const body_suffix = ".body";
+
+bool has_suffix(const std::string& s, const char* suffix)
+{
+    const size_t n = std::strlen(suffix);
+    return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+metric_counter& cache_counter(const char* result)
+{
+    return metrics_registry::instance().counter(
+        "ss1x_http_cache_total", "Lookups of the on-disk http cache, by result.",
+        std::string("result=\"") + result + '"');
+}
+
+} // namespace detail
+
+http_cache::writer::writer(http_cache& cache, const std::string& url)
+    : m_cache(cache), m_url(url), m_size(0), m_committed(false)
+{
+    // NOTE 同一个 url 可能同时有多个请求在写；临时文件名各不相同，最后一个
+    // commit 的生效
+    static std::atomic<uint64_t> s_serial(0);
+    m_tmp_path = m_cache.path_of(detail::sha1_hex(url), detail::body_suffix) + '.' +
+                 std::to_string(::getpid()) + '.' + std::to_string(++s_serial) + ".tmp";
+    m_ofs.open(m_tmp_path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!m_ofs) {
+        COLOG_ERROR("cannot create ", m_tmp_path, ": ", std::strerror(errno));
+    }
+}
+
+http_cache::writer::~writer()
+{
+    if (!m_committed) {
+        m_ofs.close();
+        std::remove(m_tmp_path.c_str());
+    }
+}
+
+bool http_cache::writer::write(const char* data, size_t size)
+{
+    if (!m_ofs) {
+        return false;
+    }
+    m_ofs.write(data, std::streamsize(size));
+    m_size += size;
+    return bool(m_ofs);
+}
+
+bool http_cache::writer::commit(const ss1x::http::Headers& header)
+{
+    if (m_committed || !m_ofs) {
+        return false;
+    }
+    m_ofs.flush();
+    m_ofs.close();
+    if (m_ofs.fail() || !http_cache::is_storable(header)) {
+        return false;
+    }
+    m_committed = m_cache.commit(m_url, m_tmp_path, m_size, header);
+    return m_committed;
+}
+
+http_cache::http_cache(const std::string& dir)
+    : m_dir(dir), m_hits(0), m_revalidated(0), m_misses(0), m_stores(0)
+{
+    while (m_dir.size() > 1 && m_dir.back() == '/') {
+        m_dir.pop_back();
+    }
+    if (::mkdir(m_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        COLOG_ERROR("cannot create ", m_dir, ": ", std::strerror(errno));
+    }
+    this->load();
+}
+
+std::string http_cache::normalize_url(const std::string& url)
+{
+    auto url_info = ss1x::util::url::split_port_auto(url);
+    std::get<0>(url_info) = detail::to_lower_copy(std::get<0>(url_info));
+    std::get<1>(url_info) = detail::to_lower_copy(std::get<1>(url_info));
+    std::string& path = std::get<3>(url_info);
+    std::string::size_type hash = path.find('#');
+    if (hash != std::string::npos) {
+        path.resize(hash);
+    }
+    return ss1x::util::url::join(url_info);
+}
+
+std::string http_cache::path_of(const std::string& name, const char* suffix) const
+{
+    return m_dir + '/' + name + suffix;
+}
+
+bool http_cache::lookup(const std::string& url, entry_t& entry) const
+{
+    const std::string key = normalize_url(url);
+    std::lock_guard<std::mutex> lock(m_lock);
+    index_t::const_iterator it = m_index.find(key);
+    if (it == m_index.end()) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+bool http_cache::is_fresh(const entry_t& entry)
+{
+    return int64_t(std::time(nullptr)) < entry.expires;
+}
+
+bool http_cache::add_validators(const entry_t& entry, ss1x::http::Headers& request_header)
+{
+    bool ret = false;
+    const std::string etag = entry.header.get("ETag");
+    if (!etag.empty()) {
+        request_header["If-None-Match"] = etag;
+        ret = true;
+    }
+    const std::string last_modified = entry.header.get("Last-Modified");
+    if (!last_modified.empty()) {
+        request_header["If-Modified-Since"] = last_modified;
+        ret = true;
+    }
+    return ret;
+}
+
+std::shared_ptr<std::ifstream> http_cache::open_body(const entry_t& entry)
+{
+    std::shared_ptr<std::ifstream> p_ifs = std::make_shared<std::ifstream>(
+        this->path_of(entry.name, detail::body_suffix).c_str(),
+        std::ios_base::in | std::ios_base::binary);
+    if (*p_ifs) {
+        p_ifs->seekg(0, std::ios_base::end);
+        const std::streamoff size = p_ifs->tellg();
+        p_ifs->seekg(0, std::ios_base::beg);
+        if (size >= 0 && uint64_t(size) == entry.body_size) {
+            return p_ifs;
+        }
+    }
+    COLOG_INFO("cached body missing or truncated: ", entry.url);
+    this->erase(entry.url);
+    return nullptr;
+}
+
+bool http_cache::refresh(entry_t& entry, const ss1x::http::Headers& not_modified)
+{
+    for (const auto& kv : not_modified) {
+        if (!detail::is_body_field(kv.first)) {
+            entry.header[kv.first] = kv.second;
+        }
+    }
+    const int64_t now = int64_t(std::time(nullptr));
+    const int64_t lifetime = freshness_lifetime(entry.header, now);
+    entry.stored  = now;
+    entry.expires = now + std::max<int64_t>(lifetime, 0);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    index_t::iterator it = m_index.find(entry.url);
+    // NOTE 期间被 erase 或者被新内容替换了，就不再写回
+    if (it == m_index.end() || it->second.name != entry.name ||
+        it->second.body_size != entry.body_size)
+    {
+        return false;
+    }
+    if (!this->save_entry(entry)) {
+        return false;
+    }
+    it->second = entry;
+    return true;
+}
+
+std::unique_ptr<http_cache::writer> http_cache::begin_store(const std::string& url)
+{
+    return std::unique_ptr<writer>(new writer(*this, normalize_url(url)));
+}
+
+bool http_cache::is_storable(const ss1x::http::Headers& header)
+{
+    if (header.status_code != 200) {
+        return false;
+    }
+    const std::string vary = detail::to_lower_copy(detail::trim_copy(header.get("Vary")));
+    if (!vary.empty() && vary != "accept-encoding") {
+        return false;
+    }
+    const int64_t lifetime = freshness_lifetime(header, int64_t(std::time(nullptr)));
+    if (lifetime < 0) {
+        return false;
+    }
+    return lifetime > 0 || header.has("ETag") || header.has("Last-Modified");
+}
+
+int64_t http_cache::freshness_lifetime(const ss1x::http::Headers& header, int64_t now)
+{
+    const detail::cache_control_t cc = detail::parse_cache_control(header.get("Cache-Control"));
+    if (cc.no_store) {
+        return -1;
+    }
+    if (cc.no_cache) {
+        return 0;
+    }
+    const int64_t age = std::max<int64_t>(0, std::strtoll(header.get("Age").c_str(), nullptr, 10));
+    if (cc.max_age >= 0) {
+        return std::max<int64_t>(0, cc.max_age - age);
+    }
+    int64_t date = parse_http_date(header.get("Date"));
+    if (date < 0) {
+        date = now;
+    }
+    if (header.has("Expires")) {
+        // NOTE 非法的 Expires(比如 "0")，视为已经过期
+        const int64_t expires = parse_http_date(header.get("Expires"));
+        return expires < 0 ? 0 : std::max<int64_t>(0, expires - date - age);
+    }
+    const int64_t last_modified = parse_http_date(header.get("Last-Modified"));
+    if (last_modified >= 0 && last_modified < date) {
+        return std::max<int64_t>(0, (date - last_modified) / 10 - age);
+    }
+    return 0;
+}
+
+int64_t http_cache::parse_http_date(const std::string& value)
+{
+    if (value.empty()) {
+        return -1;
+    }
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    const char* end = ::strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S", &tm);
+    if (!end) {
+        return -1;
+    }
+    return int64_t(::timegm(&tm));
+}
+
+std::string http_cache::format_http_date(int64_t t)
+{
+    const time_t tt = time_t(t);
+    struct tm    tm;
+    ::gmtime_r(&tt, &tm);
+    char buf[64];
+    std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+void http_cache::erase(const std::string& url)
+{
+    const std::string key = normalize_url(url);
+    std::lock_guard<std::mutex> lock(m_lock);
+    index_t::iterator it = m_index.find(key);
+    if (it == m_index.end()) {
+        return;
+    }
+    this->remove_files(it->second.name);
+    m_index.erase(it);
+}
+
+void http_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (const auto& kv : m_index) {
+        this->remove_files(kv.second.name);
+    }
+    m_index.clear();
+}
+
+size_t http_cache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_index.size();
+}
+
+http_cache::stats_t http_cache::stats() const
+{
+    stats_t ret;
+    ret.hits        = m_hits;
+    ret.revalidated = m_revalidated;
+    ret.misses      = m_misses;
+    ret.stores      = m_stores;
+    return ret;
+}
+
+void http_cache::count_hit()
+{
+    static metric_counter& s_counter = detail::cache_counter("hit");
+    ++m_hits;
+    s_counter.add();
+}
+
+void http_cache::count_revalidated()
+{
+    static metric_counter& s_counter = detail::cache_counter("revalidated");
+    ++m_revalidated;
+    s_counter.add();
+}
+
+void http_cache::count_miss()
+{
+    static metric_counter& s_counter = detail::cache_counter("miss");
+    ++m_misses;
+    s_counter.add();
+}
+
+void http_cache::load()
+{
+    DIR* dir = ::opendir(m_dir.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* ent = ::readdir(dir)) {
+        names.push_back(ent->d_name);
+    }
+    ::closedir(dir);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (const std::string& name : names) {
+        const std::string path = m_dir + '/' + name;
+        if (detail::has_suffix(name, ".tmp")) {
+            // 上次异常退出时，遗留的临时文件
+            std::remove(path.c_str());
+            continue;
+        }
+        if (!detail::has_suffix(name, detail::hdr_suffix)) {
+            continue;
+        }
+        entry_t entry;
+        if (this->load_entry(path, entry)) {
+            m_index[entry.url] = std::move(entry);
+        }
+        else {
+            this->remove_files(name.substr(0, name.size() - std::strlen(detail::hdr_suffix)));
+        }
+    }
+    COLOG_DEBUG(m_dir, ": ", m_index.size(), " entries");
+}
+
+/**
+ * .hdr 的格式；文本，一行一项：
+ *
+ *   ss1x-cache 1
+ *   url <规范化的 url>
+ *   stored <time_t>
+ *   expires <time_t>
+ *   size <body 长度>
+ *   status <状态码>
+ *   version <HTTP/1.1>
+ *   header <key>: <value>
+ *   ...
+ *
+ * 多值的 header(内存中以 "\r\n" 串接)，每个值各占一行 header；
+ * 读入时，同名的行再以 "\r\n" 串接起来。
+ */
+bool http_cache::load_entry(const std::string& hdr_path, entry_t& entry) const
+{
+    std::ifstream ifs(hdr_path.c_str());
+    std::string   line;
+    if (!std::getline(ifs, line) || line != "ss1x-cache 1") {
+        return false;
+    }
+    while (std::getline(ifs, line)) {
+        std::string::size_type pos = line.find(' ');
+        std::string key   = line.substr(0, pos);
+        std::string value = pos == std::string::npos ? "" : line.substr(pos + 1);
+        if (key == "url") {
+            entry.url = value;
+        }
+        else if (key == "stored") {
+            entry.stored = std::strtoll(value.c_str(), nullptr, 10);
+        }
+        else if (key == "expires") {
+            entry.expires = std::strtoll(value.c_str(), nullptr, 10);
+        }
+        else if (key == "size") {
+            entry.body_size = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (key == "status") {
+            entry.header.status_code = unsigned(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (key == "version") {
+            entry.header.http_version = value;
+        }
+        else if (key == "header") {
+            std::string::size_type colon = value.find(':');
+            if (colon == std::string::npos) {
+                return false;
+            }
+            std::string& slot = entry.header[value.substr(0, colon)];
+            if (!slot.empty()) {
+                slot.append("\r\n");
+            }
+            slot.append(detail::trim_copy(value.substr(colon + 1)));
+        }
+    }
+    entry.name = detail::sha1_hex(entry.url);
+    if (entry.url.empty() || path_of(entry.name, detail::hdr_suffix) != hdr_path) {
+        return false;
+    }
+    struct stat st;
+    return ::stat(path_of(entry.name, detail::body_suffix).c_str(), &st) == 0 &&
+           uint64_t(st.st_size) == entry.body_size;
+}
+
+bool http_cache::save_entry(const entry_t& entry) const
+{
+    const std::string hdr_path = path_of(entry.name, detail::hdr_suffix);
+    const std::string tmp_path = hdr_path + '.' + std::to_string(::getpid()) + ".tmp";
+    {
+        std::ofstream ofs(tmp_path.c_str(), std::ios_base::out | std::ios_base::trunc);
+        ofs << "ss1x-cache 1\n"
+            << "url " << entry.url << '\n'
+            << "stored " << entry.stored << '\n'
+            << "expires " << entry.expires << '\n'
+            << "size " << entry.body_size << '\n'
+            << "status " << entry.header.status_code << '\n'
+            << "version " << entry.header.http_version << '\n';
+        for (const auto& kv : entry.header) {
+            std::string::size_type beg = 0;
+            for (;;) {
+                std::string::size_type end = kv.second.find("\r\n", beg);
+                ofs << "header " << kv.first << ": "
+                    << kv.second.substr(beg, end == std::string::npos ? end : end - beg) << '\n';
+                if (end == std::string::npos) {
+                    break;
+                }
+                beg = end + 2;
+            }
+        }
+        ofs.flush();
+        if (!ofs) {
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), hdr_path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void http_cache::remove_files(const std::string& name) const
+{
+    std::remove(path_of(name, detail::hdr_suffix).c_str());
+    std::remove(path_of(name, detail::body_suffix).c_str());
+}
+
+bool http_cache::commit(const std::string& url, const std::string& tmp_path, uint64_t size,
+                        const ss1x::http::Headers& header)
+{
+    entry_t entry;
+    entry.url       = url;
+    entry.name      = detail::sha1_hex(url);
+    entry.header    = header;
+    entry.body_size = size;
+    entry.stored    = int64_t(std::time(nullptr));
+    entry.expires   = entry.stored + std::max<int64_t>(freshness_lifetime(header, entry.stored), 0);
+    // NOTE 存的是解码之后的 body；原始的长度与编码，不再有意义
+    entry.header.unset("Content-Length");
+    entry.header.unset("Content-Encoding");
+    entry.header.unset("Transfer-Encoding");
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    // 先换 body，再换 .hdr；.hdr 中记录的长度与 body 不符时，load() 会丢弃该记录
+    if (std::rename(tmp_path.c_str(), path_of(entry.name, detail::body_suffix).c_str()) != 0) {
+        COLOG_ERROR("cannot rename ", tmp_path, ": ", std::strerror(errno));
+        return false;
+    }
+    if (!this->save_entry(entry)) {
+        this->remove_files(entry.name);
+        m_index.erase(url);
+        return false;
+    }
+    m_index[url] = std::move(entry);
+    ++m_stores;
+    return true;
+}
+
+} // namespace asio
+} // namespace ss1x
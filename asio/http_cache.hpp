@@ -0,0 +1,159 @@
+// ss1x/asio/http_cache.hpp
+#pragma once
+
+#include <ss1x/asio/headers.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 磁盘上的 http 缓存(私有缓存)
+ *
+ * 按规范化之后的 url(协议、域名小写，去掉默认端口与 #fragment)存放 GET 的
+ * 200 响应；每条记录两个文件，以 url 的 SHA1 命名：
+ *
+ *   <sha1>.hdr   url、存入时间、过期时间、body 长度，以及响应头；文本格式
+ *   <sha1>.body  解码(gzip/br 等)之后的 body
+ *
+ * 都是先写临时文件，再 rename；所以进程中途退出，也不会留下半截的记录。
+ *
+ * 新鲜度按 Cache-Control(no-store、no-cache、max-age)、Age、Expires 与 Date
+ * 计算；都没有时，取 (Date - Last-Modified) / 10。过期而有校验器(ETag 或
+ * Last-Modified)的记录，由调用者带上 If-None-Match/If-Modified-Since 重新
+ * 验证；得到 304 时，refresh() 合并新的响应头，body 沿用磁盘上的。
+ *
+ * 构造时扫描一遍目录，建立内存中的索引；之后的查找，只是一次 hash 查表。
+ * 各个成员函数都是线程安全的。
+ */
+class http_cache
+{
+public:
+    struct entry_t
+    {
+        entry_t() : stored(0), expires(0), body_size(0) {}
+
+        std::string         url;       // 规范化之后的 url
+        std::string         name;      // 文件名(不含后缀)
+        ss1x::http::Headers header;
+        int64_t             stored;    // 存入(或最近一次验证)的时间；time(nullptr)
+        int64_t             expires;   // 在此之前，不必验证
+        uint64_t            body_size;
+    };
+
+    struct stats_t
+    {
+        uint64_t hits;         // 新鲜的记录，直接使用
+        uint64_t revalidated;  // 验证后得到 304
+        uint64_t misses;       // 没有记录，或者验证后换了新内容
+        uint64_t stores;       // 写入的记录数
+    };
+
+    // 写入一条新记录；commit() 之前，对 lookup() 不可见；没有 commit 就析构时，
+    // 删除临时文件
+    class writer
+    {
+    public:
+        writer(http_cache& cache, const std::string& url);
+        ~writer();
+
+        writer(const writer&) = delete;
+        writer& operator=(const writer&) = delete;
+
+        bool write(const char* data, size_t size);
+        // header 是最终的响应头；不可缓存时，放弃并返回 false
+        bool commit(const ss1x::http::Headers& header);
+
+    private:
+        http_cache&   m_cache;
+        std::string   m_url;
+        std::string   m_tmp_path;
+        std::ofstream m_ofs;
+        uint64_t      m_size;
+        bool          m_committed;
+    };
+
+    // dir 不存在时创建(只创建最后一级)
+    explicit http_cache(const std::string& dir);
+
+    http_cache(const http_cache&) = delete;
+    http_cache& operator=(const http_cache&) = delete;
+
+public:
+    const std::string& dir() const { return m_dir; }
+
+    static std::string normalize_url(const std::string& url);
+
+    // 找到记录时，复制到 entry 中；不判断是否新鲜
+    bool lookup(const std::string& url, entry_t& entry) const;
+
+    static bool is_fresh(const entry_t& entry);
+
+    // 过期记录的校验器，写到请求头中；没有校验器时返回 false
+    static bool add_validators(const entry_t& entry, ss1x::http::Headers& request_header);
+
+    // 打开 body 文件；文件丢失或者长度不符时，删除该记录，并返回 nullptr
+    std::shared_ptr<std::ifstream> open_body(const entry_t& entry);
+
+    // 验证得到 304：合并 not_modified 中的响应头，重新计算过期时间，并更新
+    // entry 与磁盘上的 .hdr
+    bool refresh(entry_t& entry, const ss1x::http::Headers& not_modified);
+
+    // 按 url 开始写入；响应头不可缓存时，commit() 会失败
+    std::unique_ptr<writer> begin_store(const std::string& url);
+
+    // 响应是否可以存入：200、没有 no-store、Vary 只与 Accept-Encoding 有关
+    // (body 存的是解码之后的)，并且新鲜期大于0，或者带有校验器
+    static bool is_storable(const ss1x::http::Headers& header);
+
+    // 新鲜期，单位秒；no-store 时返回 -1
+    static int64_t freshness_lifetime(const ss1x::http::Headers& header, int64_t now);
+
+    // RFC 7231 的 IMF-fixdate；失败时返回 -1
+    static int64_t parse_http_date(const std::string& value);
+    static std::string format_http_date(int64_t t);
+
+    void    erase(const std::string& url);
+    // 删除所有记录，连同磁盘上的文件
+    void    clear();
+    size_t  size() const;
+
+    stats_t stats() const;
+
+    // 由 session 统计命中情况；同时计入 metrics_registry 的 ss1x_http_cache_total
+    void    count_hit();
+    void    count_revalidated();
+    void    count_miss();
+
+private:
+    typedef std::unordered_map<std::string, entry_t> index_t;
+
+    std::string path_of(const std::string& name, const char* suffix) const;
+
+    void load();
+    bool load_entry(const std::string& hdr_path, entry_t& entry) const;
+    bool save_entry(const entry_t& entry) const;
+    void remove_files(const std::string& name) const;
+
+    bool commit(const std::string& url, const std::string& tmp_path, uint64_t size,
+                const ss1x::http::Headers& header);
+
+    std::string           m_dir;
+    mutable std::mutex    m_lock;
+    index_t               m_index;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_revalidated;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_stores;
+};
+
+} // namespace asio
+} // namespace ss1x
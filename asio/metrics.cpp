@@ -0,0 +1,536 @@
+// ss1x/asio/metrics.cpp
+#include "metrics.hpp"
+#include "error_codec.hpp"
+#include "request_stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/asio/error.hpp>
+
+#include <sss/colorlog.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+size_t metric_shard_index()
+{
+    static std::atomic<size_t> s_next(0);
+    static thread_local size_t s_index =
+        s_next.fetch_add(1, std::memory_order_relaxed) % metric_shard_count;
+    return s_index;
+}
+
+} // namespace detail
+
+metric_counter::metric_counter()
+{
+    for (auto& shard : m_shards) {
+        shard.value.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t metric_counter::value() const
+{
+    uint64_t sum = 0;
+    for (const auto& shard : m_shards) {
+        sum += shard.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+const unsigned metric_histogram::sub_bucket_bits;
+const unsigned metric_histogram::sub_bucket_count;
+const unsigned metric_histogram::max_bits;
+const size_t   metric_histogram::bucket_count;
+
+metric_histogram::metric_histogram()
+    : m_shards(new shard_t[detail::metric_shard_count])
+{
+    for (size_t i = 0; i < detail::metric_shard_count; ++i) {
+        for (auto& bucket : m_shards[i].buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_shards[i].sum.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t metric_histogram::bucket_of(uint64_t value)
+{
+    // NOTE 桶取左开右闭；导出的 le 是"小于等于"，恰好等于上界的值，应计入该桶
+    if (value) {
+        --value;
+    }
+    if (value < sub_bucket_count) {
+        return size_t(value);
+    }
+    // 最高位所在的位置；之后的 sub_bucket_bits 位，决定档内的位置
+    unsigned msb = 63u - unsigned(__builtin_clzll(value));
+    if (msb >= max_bits) {
+        return bucket_count - 1;
+    }
+    unsigned shift = msb - sub_bucket_bits;
+    return size_t(msb - sub_bucket_bits + 1) * sub_bucket_count +
+           size_t((value >> shift) & (sub_bucket_count - 1));
+}
+
+uint64_t metric_histogram::lower_of(size_t index)
+{
+    if (index < sub_bucket_count) {
+        return index;
+    }
+    unsigned shift = unsigned(index / sub_bucket_count) - 1;
+    return uint64_t(sub_bucket_count + index % sub_bucket_count) << shift;
+}
+
+uint64_t metric_histogram::upper_of(size_t index)
+{
+    if (index < sub_bucket_count) {
+        return index + 1;
+    }
+    unsigned shift = unsigned(index / sub_bucket_count) - 1;
+    return uint64_t(sub_bucket_count + index % sub_bucket_count + 1) << shift;
+}
+
+void metric_histogram::record(uint64_t value)
+{
+    shard_t& shard = m_shards[detail::metric_shard_index()];
+    shard.buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void metric_histogram::snapshot(uint64_t* buckets) const
+{
+    std::fill(buckets, buckets + bucket_count, uint64_t(0));
+    for (size_t i = 0; i < detail::metric_shard_count; ++i) {
+        for (size_t j = 0; j < bucket_count; ++j) {
+            buckets[j] += m_shards[i].buckets[j].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t metric_histogram::count() const
+{
+    uint64_t buckets[bucket_count];
+    this->snapshot(buckets);
+    uint64_t cnt = 0;
+    for (auto n : buckets) {
+        cnt += n;
+    }
+    return cnt;
+}
+
+uint64_t metric_histogram::sum() const
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < detail::metric_shard_count; ++i) {
+        sum += m_shards[i].sum.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t metric_histogram::quantile(double q) const
+{
+    uint64_t buckets[bucket_count];
+    this->snapshot(buckets);
+    uint64_t cnt = 0;
+    for (auto n : buckets) {
+        cnt += n;
+    }
+    if (!cnt) {
+        return 0;
+    }
+    q = std::min(std::max(q, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(q * double(cnt) + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return upper_of(i);
+        }
+    }
+    return upper_of(bucket_count - 1);
+}
+
+namespace {
+
+void print_scaled(std::ostream& o, double value)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", value);
+    o << buf;
+}
+
+void print_value(std::ostream& o, uint64_t value, double scale)
+{
+    if (scale == 1.0) {
+        o << value;
+    }
+    else {
+        print_scaled(o, double(value) * scale);
+    }
+}
+
+// name{labels,extra}
+void print_name(std::ostream& o, const std::string& name, const char* suffix,
+                const std::string& labels, const std::string& extra = "")
+{
+    o << name << suffix;
+    if (labels.empty() && extra.empty()) {
+        return;
+    }
+    o << '{' << labels;
+    if (!labels.empty() && !extra.empty()) {
+        o << ',';
+    }
+    o << extra << '}';
+}
+
+} // namespace
+
+metrics_registry::metrics_registry()
+    : m_export_interval(0),
+      m_export_stop(false)
+{
+}
+
+metrics_registry::~metrics_registry()
+{
+    this->stop_export();
+}
+
+metrics_registry& metrics_registry::instance()
+{
+    static metrics_registry registry;
+    return registry;
+}
+
+metrics_registry::metric_t& metrics_registry::get_locked(const std::string& name,
+                                                         const std::string& help,
+                                                         const std::string& labels,
+                                                         type_t type, double scale)
+{
+    auto it = m_families.find(name);
+    if (it == m_families.end()) {
+        family_t family;
+        family.type = type;
+        family.help = help;
+        it = m_families.insert(std::make_pair(name, std::move(family))).first;
+    }
+    else if (it->second.type != type) {
+        throw std::invalid_argument("metric " + name + " registered with another type");
+    }
+    std::unique_ptr<metric_t>& p_metric = it->second.metrics[labels];
+    if (!p_metric) {
+        p_metric.reset(new metric_t);
+        p_metric->scale = scale;
+        switch (type) {
+            case type_counter:   p_metric->counter.reset(new metric_counter);     break;
+            case type_gauge:     p_metric->gauge.reset(new metric_gauge);         break;
+            case type_histogram: p_metric->histogram.reset(new metric_histogram); break;
+        }
+    }
+    return *p_metric;
+}
+
+metric_counter& metrics_registry::counter(const std::string& name, const std::string& help,
+                                          const std::string& labels, double scale)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return *this->get_locked(name, help, labels, type_counter, scale).counter;
+}
+
+metric_gauge& metrics_registry::gauge(const std::string& name, const std::string& help,
+                                      const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return *this->get_locked(name, help, labels, type_gauge, 1.0).gauge;
+}
+
+metric_histogram& metrics_registry::histogram(const std::string& name, const std::string& help,
+                                              const std::string& labels, double scale)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return *this->get_locked(name, help, labels, type_histogram, scale).histogram;
+}
+
+void metrics_registry::render(std::ostream& o) const
+{
+    static const char* const s_type_names[] = {"counter", "gauge", "histogram"};
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (const auto& family_item : m_families) {
+        const std::string& name   = family_item.first;
+        const family_t&    family = family_item.second;
+        o << "# HELP " << name << ' ' << family.help << '\n';
+        o << "# TYPE " << name << ' ' << s_type_names[family.type] << '\n';
+
+        for (const auto& metric_item : family.metrics) {
+            const std::string& labels = metric_item.first;
+            const metric_t&    metric = *metric_item.second;
+            switch (family.type) {
+                case type_counter:
+                    print_name(o, name, "", labels);
+                    o << ' ';
+                    print_value(o, metric.counter->value(), metric.scale);
+                    o << '\n';
+                    break;
+
+                case type_gauge:
+                    print_name(o, name, "", labels);
+                    o << ' ' << metric.gauge->value() << '\n';
+                    break;
+
+                case type_histogram:
+                    {
+                        uint64_t buckets[metric_histogram::bucket_count];
+                        metric.histogram->snapshot(buckets);
+                        // NOTE 只在2的幂处输出累计值；桶的边界，恰好落在这些位置上
+                        uint64_t cumulative = 0;
+                        size_t   index      = 0;
+                        for (unsigned bits = 0; bits <= metric_histogram::max_bits; ++bits) {
+                            const uint64_t bound = uint64_t(1) << bits;
+                            while (index < metric_histogram::bucket_count &&
+                                   metric_histogram::upper_of(index) <= bound)
+                            {
+                                cumulative += buckets[index++];
+                            }
+                            std::ostringstream le;
+                            le << "le=\"";
+                            print_scaled(le, double(bound) * metric.scale);
+                            le << '"';
+                            print_name(o, name, "_bucket", labels, le.str());
+                            o << ' ' << cumulative << '\n';
+                        }
+                        for (; index < metric_histogram::bucket_count; ++index) {
+                            cumulative += buckets[index];
+                        }
+                        print_name(o, name, "_bucket", labels, "le=\"+Inf\"");
+                        o << ' ' << cumulative << '\n';
+                        print_name(o, name, "_sum", labels);
+                        o << ' ';
+                        print_value(o, metric.histogram->sum(), metric.scale);
+                        o << '\n';
+                        print_name(o, name, "_count", labels);
+                        o << ' ' << cumulative << '\n';
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+std::string metrics_registry::render() const
+{
+    std::ostringstream oss;
+    this->render(oss);
+    return oss.str();
+}
+
+bool metrics_registry::write_file(const std::string& path, boost::system::error_code& ec) const
+{
+    // NOTE 先写临时文件，再 rename；读取者不会看到写了一半的内容
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path.c_str(), std::ios_base::out | std::ios_base::trunc);
+        if (!ofs) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return false;
+        }
+        this->render(ofs);
+        ofs.flush();
+        if (!ofs) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+            return false;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        ec = boost::system::error_code(errno, boost::system::system_category());
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    ec.clear();
+    return true;
+}
+
+void metrics_registry::start_export(const std::string& path, std::chrono::seconds interval)
+{
+    this->stop_export();
+    std::lock_guard<std::mutex> lock(m_export_lock);
+    m_export_path     = path;
+    m_export_interval = std::max(interval, std::chrono::seconds(1));
+    m_export_stop     = false;
+    m_export_thread   = std::thread(&metrics_registry::export_loop, this);
+}
+
+void metrics_registry::stop_export()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(m_export_lock);
+        m_export_stop = true;
+        thread.swap(m_export_thread);
+    }
+    m_export_cond.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void metrics_registry::export_loop()
+{
+    std::unique_lock<std::mutex> lock(m_export_lock);
+    while (!m_export_stop) {
+        const std::string path = m_export_path;
+        lock.unlock();
+        boost::system::error_code ec;
+        if (!this->write_file(path, ec)) {
+            COLOG_ERROR("export metrics to ", path, " failed: ", ec.message());
+        }
+        lock.lock();
+        m_export_cond.wait_for(lock, m_export_interval, [this]() -> bool { return m_export_stop; });
+    }
+}
+
+decoder_metrics::decoder_metrics(const std::string& codec)
+    : m_input(metrics_registry::instance().counter(
+          "ss1x_decoder_input_bytes_total", "Compressed bytes fed to the decoder.",
+          "codec=\"" + codec + "\"")),
+      m_output(metrics_registry::instance().counter(
+          "ss1x_decoder_output_bytes_total", "Bytes produced by the decoder.",
+          "codec=\"" + codec + "\"")),
+      m_nanoseconds(metrics_registry::instance().counter(
+          "ss1x_decoder_seconds_total", "Time spent inside the decoder.",
+          "codec=\"" + codec + "\"", 1e-9))
+{
+}
+
+namespace {
+
+// NOTE 各个指标只登记一次；之后的更新都是无锁的
+struct request_metrics_t
+{
+    request_metrics_t()
+        : ok(registry().counter("ss1x_requests_total", "Finished requests.", "result=\"ok\"")),
+          failed(registry().counter("ss1x_requests_total", "Finished requests.", "result=\"error\"")),
+          dns(phase("dns")),
+          connect(phase("connect")),
+          tunnel(phase("tunnel")),
+          tls(phase("tls")),
+          wait(phase("wait")),
+          transfer(phase("transfer")),
+          total(phase("total")),
+          sent_bytes(registry().counter("ss1x_request_bytes_total",
+                                        "Request bytes sent, header and body.")),
+          header_bytes(registry().counter("ss1x_response_header_bytes_total",
+                                          "Response status line and header bytes received.")),
+          body_bytes(registry().counter("ss1x_response_body_bytes_total",
+                                        "Response body bytes received on the wire.")),
+          decoded_bytes(registry().counter("ss1x_response_decoded_bytes_total",
+                                           "Response body bytes after decoding.")),
+          redirects(registry().counter("ss1x_redirects_total", "Redirects followed.")),
+          reused(registry().counter("ss1x_connections_reused_total",
+                                    "Requests sent on a pooled keep-alive connection.")),
+          resumed(registry().counter("ss1x_tls_resumed_total",
+                                     "TLS handshakes that resumed a cached session."))
+    {}
+
+    static metrics_registry& registry() { return metrics_registry::instance(); }
+
+    static metric_histogram& phase(const char* name)
+    {
+        return registry().histogram("ss1x_request_phase_seconds",
+                                    "Time spent in each phase of a request.",
+                                    std::string("phase=\"") + name + '"', 1e-6);
+    }
+
+    static void observe(metric_histogram& h, request_stats::time_point end, request_stats::duration d)
+    {
+        if (end != request_stats::time_point()) {
+            h.record(uint64_t(d.count()));
+        }
+    }
+
+    metric_counter&   ok;
+    metric_counter&   failed;
+    metric_histogram& dns;
+    metric_histogram& connect;
+    metric_histogram& tunnel;
+    metric_histogram& tls;
+    metric_histogram& wait;
+    metric_histogram& transfer;
+    metric_histogram& total;
+    metric_counter&   sent_bytes;
+    metric_counter&   header_bytes;
+    metric_counter&   body_bytes;
+    metric_counter&   decoded_bytes;
+    metric_counter&   redirects;
+    metric_counter&   reused;
+    metric_counter&   resumed;
+};
+
+} // namespace
+
+void record_request_metrics(const request_stats&            stats,
+                            const boost::system::error_code& ec,
+                            unsigned int                     status_code)
+{
+    static request_metrics_t m;
+
+    // NOTE chunked 正常结束时，一直以 eof 通知用户；不算失败
+    boost::system::error_code failure;
+    if (ec && ec != boost::asio::error::eof) {
+        failure = ec;
+    }
+    // NOTE 连接层面成功，但最终响应不是 2xx(304 除外)，也算失败；按状态码登记
+    else if (status_code && status_code / 100 != 2 && status_code != 304) {
+        failure = ss1x::errc::make_error_code(ss1x::errc::errc_t(status_code));
+    }
+    const bool failed = bool(failure);
+    (failed ? m.failed : m.ok).add();
+    if (failed) {
+        // 失败很少见；按错误码登记，加锁也无妨
+        std::ostringstream labels;
+        labels << "category=\"" << failure.category().name() << "\",code=\"" << failure.value() << '"';
+        metrics_registry::instance()
+            .counter("ss1x_request_errors_total", "Failed requests by error code.", labels.str())
+            .add();
+    }
+
+    request_metrics_t::observe(m.dns,      stats.dns_done,    stats.dns());
+    request_metrics_t::observe(m.connect,  stats.connected,   stats.connect());
+    request_metrics_t::observe(m.tunnel,   stats.tunnel_done, stats.tunnel());
+    request_metrics_t::observe(m.tls,      stats.tls_done,    stats.tls());
+    request_metrics_t::observe(m.wait,     stats.first_byte,  stats.wait());
+    request_metrics_t::observe(m.transfer, stats.header_done, stats.transfer());
+    request_metrics_t::observe(m.total,    stats.finish,      stats.total());
+
+    m.sent_bytes.add(stats.request_bytes);
+    m.header_bytes.add(stats.header_bytes);
+    m.body_bytes.add(stats.body_bytes);
+    m.decoded_bytes.add(stats.decoded_bytes);
+    m.redirects.add(stats.redirects);
+    if (stats.connection_reused) {
+        m.reused.add();
+    }
+    if (stats.tls_resumed) {
+        m.resumed.add();
+    }
+}
+
+metric_gauge& pool_idle_gauge()
+{
+    static metric_gauge& g = metrics_registry::instance().gauge(
+        "ss1x_pool_idle_connections", "Idle keep-alive connections held by connection pools.");
+    return g;
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,229 @@
+// ss1x/asio/metrics.hpp
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/system/error_code.hpp>
+
+namespace ss1x {
+namespace asio {
+
+struct request_stats;
+
+namespace detail {
+
+// NOTE 计数分散到若干个分片上；每个线程固定写同一个分片，读取时再求和。
+// 于是多线程同时计数时，没有锁，也不会在同一个 cache line 上争用
+static const size_t metric_shard_count = 8;
+
+size_t metric_shard_index();
+
+} // namespace detail
+
+// 单调递增的计数
+class metric_counter
+{
+public:
+    metric_counter();
+
+    metric_counter(const metric_counter&) = delete;
+    metric_counter& operator=(const metric_counter&) = delete;
+
+    void     add(uint64_t n = 1)
+    {
+        m_shards[detail::metric_shard_index()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+private:
+    // NOTE 不依赖 alignas：C++11 的 new 不保证超对齐；补齐到 64 字节，
+    // 相邻分片的计数，就不会落在同一个 cache line 上
+    struct shard_t
+    {
+        std::atomic<uint64_t> value;
+        char                  padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    shard_t m_shards[detail::metric_shard_count];
+};
+
+// 可增可减的瞬时值，比如连接池中的空闲连接数
+class metric_gauge
+{
+public:
+    metric_gauge() : m_value(0) {}
+
+    metric_gauge(const metric_gauge&) = delete;
+    metric_gauge& operator=(const metric_gauge&) = delete;
+
+    void    set(int64_t v)      { m_value.store(v, std::memory_order_relaxed);     }
+    void    add(int64_t n = 1)  { m_value.fetch_add(n, std::memory_order_relaxed); }
+    void    sub(int64_t n = 1)  { m_value.fetch_sub(n, std::memory_order_relaxed); }
+    int64_t value() const       { return m_value.load(std::memory_order_relaxed);  }
+
+private:
+    std::atomic<int64_t> m_value;
+};
+
+/**
+ * @brief HDR 风格的直方图：对数分档，每个2的幂之内再线性分 8 档
+ *
+ * 任意值的相对误差不超过 12.5%；[0, 2^40) 只需 304 个桶，记录一次只是一次
+ * 原子加。值的单位由调用者决定(比如微秒)，导出时乘以 scale。
+ */
+class metric_histogram
+{
+public:
+    static const unsigned sub_bucket_bits  = 3;
+    static const unsigned sub_bucket_count = 1u << sub_bucket_bits;
+    static const unsigned max_bits         = 40;
+    static const size_t   bucket_count     = (max_bits - sub_bucket_bits + 1) * sub_bucket_count;
+
+    metric_histogram();
+
+    metric_histogram(const metric_histogram&) = delete;
+    metric_histogram& operator=(const metric_histogram&) = delete;
+
+    void     record(uint64_t value);
+
+    uint64_t count() const;
+    uint64_t sum() const;
+    // 各个桶的计数(所有分片求和)
+    void     snapshot(uint64_t* buckets) const;
+    // q in [0, 1]；返回所在桶的上界；没有数据时为0
+    uint64_t quantile(double q) const;
+
+    static size_t   bucket_of(uint64_t value);
+    // 桶 index 的值域为 (lower_of(index), upper_of(index)]；0 也落在第0个桶
+    static uint64_t lower_of(size_t index);
+    static uint64_t upper_of(size_t index);
+
+private:
+    struct shard_t
+    {
+        std::atomic<uint64_t> buckets[bucket_count];
+        std::atomic<uint64_t> sum;
+        char                  padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    std::unique_ptr<shard_t[]> m_shards;
+};
+
+/**
+ * @brief 进程级的指标登记处
+ *
+ * counter()/gauge()/histogram() 按 (name, labels) 取出指标，没有则创建；只有
+ * 这一步加锁，取到的引用一直有效。各个子系统把引用缓存下来(比如函数内的
+ * static)，之后的更新都是无锁的。
+ *
+ * labels 是 Prometheus 格式的标签列表，不带花括号，比如 `phase="dns"`；
+ * 同一个 name 的各个指标，必须是同一类型。
+ *
+ * render() 输出 Prometheus 的文本格式；start_export() 在后台线程中，定期
+ * 写到文件(先写临时文件，再 rename)，供 node_exporter 的 textfile collector
+ * 之类的工具读取。
+ */
+class metrics_registry
+{
+public:
+    metrics_registry();
+    ~metrics_registry();
+
+    metrics_registry(const metrics_registry&) = delete;
+    metrics_registry& operator=(const metrics_registry&) = delete;
+
+    static metrics_registry& instance();
+
+public:
+    // scale：导出时，值乘以 scale；比如以纳秒计数、以秒导出
+    metric_counter&   counter(const std::string& name, const std::string& help,
+                              const std::string& labels = "", double scale = 1.0);
+    metric_gauge&     gauge(const std::string& name, const std::string& help,
+                            const std::string& labels = "");
+    metric_histogram& histogram(const std::string& name, const std::string& help,
+                                const std::string& labels = "", double scale = 1.0);
+
+    void        render(std::ostream& o) const;
+    std::string render() const;
+
+    bool        write_file(const std::string& path, boost::system::error_code& ec) const;
+
+    // 每 interval 写一次 path；再次调用时，替换原来的设置
+    void        start_export(const std::string& path, std::chrono::seconds interval);
+    void        stop_export();
+
+private:
+    enum type_t { type_counter, type_gauge, type_histogram };
+
+    struct metric_t
+    {
+        metric_t() : scale(1.0) {}
+
+        double                            scale;
+        std::unique_ptr<metric_counter>   counter;
+        std::unique_ptr<metric_gauge>     gauge;
+        std::unique_ptr<metric_histogram> histogram;
+    };
+
+    struct family_t
+    {
+        type_t                                           type;
+        std::string                                      help;
+        std::map<std::string, std::unique_ptr<metric_t>> metrics;
+    };
+
+    metric_t& get_locked(const std::string& name, const std::string& help,
+                         const std::string& labels, type_t type, double scale);
+
+    void export_loop();
+
+    mutable std::mutex              m_lock;
+    std::map<std::string, family_t> m_families;
+
+    std::mutex                      m_export_lock;
+    std::condition_variable         m_export_cond;
+    std::thread                     m_export_thread;
+    std::string                     m_export_path;
+    std::chrono::seconds            m_export_interval;
+    bool                            m_export_stop;
+};
+
+// NOTE 一个解码器(gzip、br 等)的输入、输出字节数，以及耗时；构造时登记，
+// 之后的 record() 无锁。用法：static const decoder_metrics s_metrics("gzip");
+class decoder_metrics
+{
+public:
+    explicit decoder_metrics(const std::string& codec);
+
+    void record(size_t input, size_t output, std::chrono::nanoseconds elapsed) const
+    {
+        m_input.add(input);
+        m_output.add(output);
+        m_nanoseconds.add(uint64_t(elapsed.count()));
+    }
+
+private:
+    metric_counter& m_input;
+    metric_counter& m_output;
+    metric_counter& m_nanoseconds;
+};
+
+// 请求结束时调用：请求数、各阶段耗时、收发字节数，以及按错误码分类的失败次数；
+// status_code 为最终响应的状态码(0 表示未收到响应)，非 2xx 也计为失败
+void record_request_metrics(const request_stats&            stats,
+                            const boost::system::error_code& ec,
+                            unsigned int                     status_code = 0);
+
+// 连接池中的空闲连接数(所有连接池之和)
+metric_gauge& pool_idle_gauge();
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,371 @@
+// ss1x/asio/multipart.cpp
+#include "multipart.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+#include <ss1x/asio/error_codec.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+const size_t multipart_copy_size = 64 * 1024;
+
+std::string random_boundary()
+{
+    static const char digits[] = "0123456789abcdef";
+    std::random_device rd;
+    std::string        boundary = "----ss1xFormBoundary";
+    for (int i = 0; i < 4; ++i) {
+        unsigned int r = rd();
+        for (int j = 0; j < 8; ++j) {
+            boundary.push_back(digits[r & 0xf]);
+            r >>= 4;
+        }
+    }
+    return boundary;
+}
+
+// NOTE 按 HTML 的做法，name、filename 中的 '"' 与换行写成百分号编码
+void append_quoted(std::string& out, const std::string& value)
+{
+    out.push_back('"');
+    for (char c : value) {
+        switch (c) {
+            case '"':  out.append("%22"); break;
+            case '\r': out.append("%0D"); break;
+            case '\n': out.append("%0A"); break;
+            default:   out.push_back(c);  break;
+        }
+    }
+    out.push_back('"');
+}
+
+std::string base_name(const std::string& path)
+{
+    size_t pos = path.find_last_of('/');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+boost::system::error_code last_error()
+{
+    return boost::system::error_code(errno, boost::system::system_category());
+}
+
+// 阻塞 socket 上，把 data 全部发出
+bool send_all(int socket_fd, sss::string_view data, bool more, boost::system::error_code& ec)
+{
+    const int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    while (!data.empty()) {
+        ssize_t n = ::send(socket_fd, data.data(), data.size(), flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ec = last_error();
+            return false;
+        }
+        data = data.substr(size_t(n));
+    }
+    return true;
+}
+
+// 内核不支持对该 fd 做 sendfile() 时，退回 pread + send
+bool copy_file(int socket_fd, int fd, uint64_t offset, uint64_t size,
+               boost::system::error_code& ec)
+{
+    std::vector<char> buffer(std::min<uint64_t>(size, multipart_copy_size));
+    while (size) {
+        ssize_t n = ::pread(fd, buffer.data(), std::min<uint64_t>(size, buffer.size()),
+                            off_t(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ec = last_error();
+            return false;
+        }
+        if (n == 0) {
+            ec = ss1x::errc::body_size_mismatch;
+            return false;
+        }
+        if (!send_all(socket_fd, sss::string_view(buffer.data(), size_t(n)), true, ec)) {
+            return false;
+        }
+        offset += uint64_t(n);
+        size   -= uint64_t(n);
+    }
+    return true;
+}
+
+bool sendfile_all(int socket_fd, int fd, uint64_t size, boost::system::error_code& ec)
+{
+    off_t offset = 0;
+    while (uint64_t(offset) < size) {
+        const size_t count = size_t(std::min<uint64_t>(size - uint64_t(offset), 0x7ffff000));
+        ssize_t n = ::sendfile(socket_fd, fd, &offset, count);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS) && offset == 0) {
+            return copy_file(socket_fd, fd, 0, size, ec);
+        }
+        if (n < 0) {
+            ec = last_error();
+            return false;
+        }
+        if (n == 0) {
+            // 文件被截短了
+            ec = ss1x::errc::body_size_mismatch;
+            return false;
+        }
+    }
+    return true;
+}
+
+// NOTE 依次发送各段；每段是一块内存，或者一个文件
+class multipart_body : public body_source
+{
+public:
+    struct segment_t
+    {
+        std::string                  data;
+        std::shared_ptr<body_source> file;
+    };
+
+    multipart_body(std::vector<segment_t>&& segments, int64_t size)
+        : m_segments(std::move(segments)), m_size(size), m_index(0), m_data_sent(false)
+    {}
+
+    int64_t size() const override { return m_size; }
+
+    bool rewind() override
+    {
+        for (auto& segment : m_segments) {
+            if (segment.file && !segment.file->rewind()) {
+                return false;
+            }
+        }
+        m_index     = 0;
+        m_data_sent = false;
+        return true;
+    }
+
+    boost::asio::const_buffer next(boost::system::error_code& ec) override
+    {
+        ec.clear();
+        while (m_index < m_segments.size()) {
+            segment_t& segment = m_segments[m_index];
+            if (segment.file) {
+                boost::asio::const_buffer block = segment.file->next(ec);
+                if (ec || block.size()) {
+                    return block;
+                }
+            }
+            else if (!m_data_sent && !segment.data.empty()) {
+                m_data_sent = true;
+                return boost::asio::buffer(segment.data);
+            }
+            ++m_index;
+            m_data_sent = false;
+        }
+        return boost::asio::const_buffer();
+    }
+
+private:
+    std::vector<segment_t> m_segments;
+    int64_t                m_size;
+    size_t                 m_index;
+    bool                   m_data_sent;
+};
+
+} // namespace detail
+
+multipart_form::multipart_form() : m_boundary(detail::random_boundary()) {}
+
+multipart_form::multipart_form(std::string boundary) : m_boundary(std::move(boundary)) {}
+
+void multipart_form::add_field(const std::string& name, const std::string& value,
+                               const std::string& content_type)
+{
+    part_t part;
+    part.head = m_parts.empty() ? "--" : "\r\n--";
+    part.head.append(m_boundary).append("\r\nContent-Disposition: form-data; name=");
+    detail::append_quoted(part.head, name);
+    part.head.append("\r\n");
+    if (!content_type.empty()) {
+        part.head.append("Content-Type: ").append(content_type).append("\r\n");
+    }
+    part.head.append("\r\n");
+    part.value = value;
+    part.size  = value.size();
+    m_parts.push_back(std::move(part));
+}
+
+bool multipart_form::add_file(const std::string& name, const std::string& path,
+                              boost::system::error_code& ec, const std::string& filename,
+                              const std::string& content_type)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        ec = detail::last_error();
+        COLOG_ERROR(SSS_VALUE_MSG(path), ec.message());
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ec = boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+        COLOG_ERROR(SSS_VALUE_MSG(path), "not a regular file");
+        return false;
+    }
+    ec.clear();
+
+    const std::string file_name = filename.empty() ? detail::base_name(path) : filename;
+    part_t part;
+    part.head = m_parts.empty() ? "--" : "\r\n--";
+    part.head.append(m_boundary).append("\r\nContent-Disposition: form-data; name=");
+    detail::append_quoted(part.head, name);
+    part.head.append("; filename=");
+    detail::append_quoted(part.head, file_name);
+    part.head.append("\r\nContent-Type: ")
+        .append(content_type.empty() ? guess_content_type(file_name) : content_type.c_str())
+        .append("\r\n\r\n");
+    part.path = path;
+    part.size = uint64_t(st.st_size);
+    m_parts.push_back(std::move(part));
+    return true;
+}
+
+std::string multipart_form::content_type() const
+{
+    return "multipart/form-data; boundary=" + m_boundary;
+}
+
+std::string multipart_form::closing() const
+{
+    return (m_parts.empty() ? "--" : "\r\n--") + m_boundary + "--\r\n";
+}
+
+uint64_t multipart_form::size() const
+{
+    uint64_t size = this->closing().size();
+    for (const auto& part : m_parts) {
+        size += part.head.size() + part.size;
+    }
+    return size;
+}
+
+std::shared_ptr<body_source> multipart_form::body(boost::system::error_code& ec) const
+{
+    // NOTE 相邻的内存部分合并成一段；于是每个文件前后，各只有一段头部
+    std::vector<detail::multipart_body::segment_t> segments(1);
+    for (const auto& part : m_parts) {
+        segments.back().data.append(part.head);
+        if (part.path.empty()) {
+            segments.back().data.append(part.value);
+            continue;
+        }
+        int fd = ::open(part.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            ec = detail::last_error();
+            COLOG_ERROR(SSS_VALUE_MSG(part.path), ec.message());
+            return std::shared_ptr<body_source>();
+        }
+        segments.emplace_back();
+        segments.back().file = make_file_body(fd, 0, int64_t(part.size), true);
+        segments.emplace_back();
+    }
+    segments.back().data.append(this->closing());
+    ec.clear();
+    return std::make_shared<detail::multipart_body>(std::move(segments), int64_t(this->size()));
+}
+
+uint64_t multipart_form::send(int socket_fd, sss::string_view head,
+                              boost::system::error_code& ec) const
+{
+    ec.clear();
+    uint64_t    sent = 0;
+    std::string pending(head.data(), head.size());
+    for (const auto& part : m_parts) {
+        pending.append(part.head);
+        if (part.path.empty()) {
+            pending.append(part.value);
+            continue;
+        }
+        int fd = ::open(part.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            ec = detail::last_error();
+            COLOG_ERROR(SSS_VALUE_MSG(part.path), ec.message());
+            return sent;
+        }
+        // NOTE MSG_MORE：头部与随后的文件内容，尽量合在同样的 tcp 段中
+        bool ok = detail::send_all(socket_fd, pending, true, ec);
+        if (ok) {
+            sent += pending.size();
+            ok    = detail::sendfile_all(socket_fd, fd, part.size, ec);
+        }
+        ::close(fd);
+        if (!ok) {
+            COLOG_ERROR(SSS_VALUE_MSG(part.path), ec.message());
+            return sent;
+        }
+        sent += part.size;
+        pending.clear();
+    }
+    pending.append(this->closing());
+    if (detail::send_all(socket_fd, pending, false, ec)) {
+        sent += pending.size();
+    }
+    return sent;
+}
+
+const char* multipart_form::guess_content_type(const std::string& filename)
+{
+    static const char* const s_types[][2] = {
+        {"jpg",  "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"png",  "image/png"},
+        {"gif",  "image/gif"},
+        {"webp", "image/webp"},
+        {"bmp",  "image/bmp"},
+        {"svg",  "image/svg+xml"},
+        {"ico",  "image/x-icon"},
+        {"txt",  "text/plain"},
+        {"html", "text/html"},
+        {"htm",  "text/html"},
+        {"css",  "text/css"},
+        {"js",   "application/javascript"},
+        {"json", "application/json"},
+        {"xml",  "application/xml"},
+        {"pdf",  "application/pdf"},
+        {"zip",  "application/zip"},
+        {"gz",   "application/gzip"},
+    };
+    size_t dot = filename.find_last_of('.');
+    if (dot != std::string::npos) {
+        const char* ext = filename.c_str() + dot + 1;
+        for (const auto& type : s_types) {
+            if (::strcasecmp(ext, type[0]) == 0) {
+                return type[1];
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,86 @@
+// ss1x/asio/multipart.hpp
+#pragma once
+
+#include <ss1x/asio/body_source.hpp>
+
+#include <sss/string_view.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/system/error_code.hpp>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief multipart/form-data 的 body；多个字段与文件，流式发送
+ *
+ * 各 part 的头部(boundary、Content-Disposition、Content-Type)在 add_*() 时
+ * 拼好；文件只 stat() 取长度，不读内容；于是 size() 可以直接作为
+ * Content-Length。发送时才打开文件：
+ *
+ * - body()：得到 body_source，交给 session::async_post() 等，支持 https 与代理；
+ * - send()：明文 socket，内存部分 send(MSG_MORE)，文件内容用 sendfile()，
+ *   不进用户态。见 postFile()。
+ *
+ * 发送之前文件长度变了，请求以 body_size_mismatch 失败。
+ */
+class multipart_form
+{
+public:
+    // boundary 随机生成
+    multipart_form();
+    explicit multipart_form(std::string boundary);
+
+    void add_field(const std::string& name, const std::string& value,
+                   const std::string& content_type = "");
+
+    // filename 为空时，取 path 的文件名；content_type 为空时，按扩展名推测
+    bool add_file(const std::string& name, const std::string& path,
+                  boost::system::error_code& ec,
+                  const std::string& filename     = "",
+                  const std::string& content_type = "");
+
+    const std::string& boundary() const { return m_boundary; }
+    // 请求头 Content-Type 的值
+    std::string        content_type() const;
+    // 整个 body 的字节数
+    uint64_t           size() const;
+    bool               empty() const { return m_parts.empty(); }
+
+    // 打开其中的文件；失败时返回空指针，并设置 ec
+    std::shared_ptr<body_source> body(boost::system::error_code& ec) const;
+
+    /**
+     * @brief 经(阻塞模式的)明文 socket 发送整个 body；head 非空时，先于 body 发出
+     *
+     * @return 发送的字节数，包括 head
+     */
+    uint64_t send(int socket_fd, sss::string_view head, boost::system::error_code& ec) const;
+
+    // 常见图片、文档等的 MIME 类型；未知的，返回 application/octet-stream
+    static const char* guess_content_type(const std::string& filename);
+
+private:
+    struct part_t
+    {
+        // "--boundary\r\n" 以及该 part 的头部，直到空行
+        std::string head;
+        // 字段的值；文件 part 为空
+        std::string value;
+        std::string path;
+        uint64_t    size;
+    };
+
+    // 紧跟在最后一个 part 之后："\r\n--boundary--\r\n"
+    std::string closing() const;
+
+    std::string         m_boundary;
+    std::vector<part_t> m_parts;
+};
+
+} // namespace asio
+} // namespace ss1x
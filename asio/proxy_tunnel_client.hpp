@@ -4,14 +4,34 @@
 // http://www.boost.org/doc/libs/1_45_0/doc/html/boost_asio/example/timeouts/async_tcp_client.cpp
 
 #include "socket_t.hpp"
+#include "connection_pool.hpp"
+#include "tls_session_cache.hpp"
+#include "dns_cache.hpp"
+#include "redirect_cache.hpp"
+#include "request_cancel.hpp"
 #include "user_agent.hpp"
 #include "stream.hpp"
 #include "gzstream.hpp"
 #include "brstream.hpp"
 #include "echostream.hpp"
+#include "chunked_decoder.hpp"
+#include "end_matcher.hpp"
+#include "timer_wheel.hpp"
+#include "happy_eyeballs.hpp"
+#include "content_flow.hpp"
+#include "body_source.hpp"
+#include "request_writer.hpp"
+#include "request_stats.hpp"
+#include "metrics.hpp"
 
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
 #include <vector>
 #include <string>
 
@@ -23,6 +43,10 @@
 
 #include <memory>
 #include <functional>
+#include <type_traits>
+#include <utility>
+
+#include <strings.h>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -45,8 +69,7 @@ inline sss::string_view cast_string_view(const boost::asio::streambuf& streambuf
     return sss::string_view(boost::asio::buffer_cast<const char*>(streambuf.data()), streambuf.size());
 }
 
-//this->m_deadline.cancel();
-//m_deadline.expires_from_now(boost::posix_time::seconds(5));
+// NOTE 读 header、body 期间，每个回调都顺延 idle 期限；只是记一下时间，不动定时器
 #define RET_ON_STOP  do { \
     if (m_stoped) {\
         return; \
@@ -89,8 +112,52 @@ inline int &ss1x_asio_ptc_deadline_wait_secends()
     return m_wait_seconds;
 }
 
+// NOTE proxy_tunnel_client 异步回调的包装；每个尚未执行(或尚未销毁)的回调，都持有
+// token 的一份拷贝，于是 client 可以据此判断，自己是否还被 io_service 引用着。
+template <typename Handler>
+struct ss1x_asio_ptc_handler_t
+{
+    Handler               handler;
+    std::shared_ptr<void> token;
+
+    template <typename... Args>
+    void operator()(Args&&... args)
+    {
+        handler(std::forward<Args>(args)...);
+    }
+};
+
 } // namespace detail
 
+namespace ss1x {
+namespace asio {
+
+// 分阶段的超时；为0时，该阶段不限时
+struct request_timeouts
+{
+    request_timeouts()
+        : connect(std::chrono::seconds(30)),
+          handshake(std::chrono::seconds(30)),
+          first_byte(std::chrono::seconds(60)),
+          idle(std::chrono::seconds(::detail::ss1x_asio_ptc_deadline_wait_secends())),
+          total(0)
+    {}
+
+    // 域名解析 + tcp 建链；经代理时，包括 CONNECT 的往返
+    std::chrono::milliseconds connect;
+    // TLS 握手
+    std::chrono::milliseconds handshake;
+    // 开始发送请求，到收到响应的状态行
+    std::chrono::milliseconds first_byte;
+    // 读 header、body 时，两次收到数据之间的最长间隔；默认取 ptc_deadline_timer_wait()
+    std::chrono::milliseconds idle;
+    // 整个请求，包括跳转
+    std::chrono::milliseconds total;
+};
+
+} // namespace asio
+} // namespace ss1x
+
 static const sss::string_view CRLF{"\r\n"};
 static const sss::string_view CRLF2{"\r\n" "\r\n"};
 
@@ -384,6 +451,8 @@ public:
     typedef std::function<void()> onFinished_t;
     typedef std::function<void(sss::string_view response)> onResponce_t;
     typedef std::function<bool(sss::string_view mark)> onEndCheck_t;
+    // 最终(跳转之后)响应的 header 读完时调用；返回 false，放弃读取 body
+    typedef std::function<bool(const ss1x::http::Headers& header)> onHeader_t;
     typedef std::function<std::vector<std::string>(const std::string& url)>
              CookieFunc_t;
     typedef std::function<bool(const std::string& domain, const std::string& sever_cookie)>
@@ -394,29 +463,98 @@ public:
         return status_code / 100 == 2;
     }
 
+    // 单个响应 header 的总长度上限
+    static const size_t s_max_header_bytes = 64 * 1024;
+
+    typedef ss1x::asio::timer_wheel::clock_type clock_type;
+
+    // 当前所处的超时阶段；见 request_timeouts
+    enum phase_t {
+        phase_none,
+        phase_connect,
+        phase_handshake,
+        phase_first_byte,
+        phase_idle,
+        // 消费者要求暂停读取；不计 idle 超时
+        phase_paused
+    };
+
 public:
     proxy_tunnel_client(boost::asio::io_service& io_service,
                         boost::asio::ssl::context* p_ctx = nullptr)
-        : m_resolver(io_service),
-          m_socket(io_service),
+        : m_io_service(io_service),
+          m_strand(io_service),
+          m_handler_token(std::make_shared<char>(0)),
+          m_p_ctx(p_ctx),
+          m_dns(&ss1x::asio::dns_cache::instance()),
+          m_redirect_cache(nullptr),
+          m_memo_redirects(0),
+          m_socket(new ss1x::detail::socket_t(io_service)),
+          m_pool(nullptr),
+          m_connection_reused(false),
+          m_bypass_pool(false),
           m_has_eof(false),
           m_is_chunked(false),
+          m_read_until_eof(false),
           m_expect_res_type(ss1x::asio::res_type_any),
           m_content_to_read(0),
+          m_header_scanned(0),
+          m_header_bytes(0),
           m_max_redirect(5),
           m_stoped(false),
           m_response(2048),
-          m_deadline(io_service)
+          m_wheel(ss1x::asio::timer_wheel::of(io_service)),
+          m_phase(phase_none),
+          m_phase_timer(0),
+          m_total_timer(0),
+          m_timer_gen(0),
+          m_proxy_port(0),
+          m_body_chunked(false),
+          m_body_sent(0)
     {
         COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_request.max_size()), SSS_VALUE_MSG(m_response.max_size()));
+        m_request_data.reserve(1024);
         if (p_ctx) {
-            m_socket.upgrade_to_ssl(*p_ctx);
+            m_socket->upgrade_to_ssl(*p_ctx);
+        }
+    }
+
+    ~proxy_tunnel_client()
+    {
+        // NOTE 时间轮上的回调、尚未完成的建链、content_flow 的唤醒，都引用着 this
+        this->cancelTimers();
+        this->cancelConnecting();
+        if (m_flow) {
+            m_flow->cancel_wait(this);
+        }
+        if (m_cancel) {
+            m_cancel->detach(this);
         }
     }
 
     void upgrade_to_ssl(boost::asio::ssl::context& ctx)
     {
-        m_socket.upgrade_to_ssl(ctx);
+        m_p_ctx = &ctx;
+        m_socket->upgrade_to_ssl(ctx);
+    }
+
+    // NOTE 域名解析缓存；默认使用进程级的 dns_cache::instance()
+    void setDnsCache(ss1x::asio::dns_cache* dns)
+    {
+        m_dns = dns ? dns : &ss1x::asio::dns_cache::instance();
+    }
+
+    // NOTE 跳转记录；默认为 nullptr，既不记录，也不使用；session 设为自己的
+    // redirects()
+    void setRedirectCache(ss1x::asio::redirect_cache* redirects)
+    {
+        m_redirect_cache = redirects;
+    }
+
+    // NOTE keep-alive 连接池；为 nullptr 时，每次请求都是 "Connection: close"
+    void setConnectionPool(ss1x::asio::connection_pool* pool)
+    {
+        m_pool = pool;
     }
 
     void                    setCookieFunc(CookieFunc_t&& func) {
@@ -431,11 +569,41 @@ public:
     void                    setOnContent(const onResponce_t& func)  { m_onContent  = func;       }
     void                    setOnEndCheck(const onEndCheck_t& func) { m_onEndCheck = func;       }
     void                    setOnContent(onResponce_t&& func)  { m_onContent  = std::move(func); }
+    void                    setOnHeader(const onHeader_t& func)     { m_onHeader   = func;       }
     void                    setOnEndCheck(onEndCheck_t&& func) { m_onEndCheck = std::move(func); }
+    // NOTE 只对以关闭连接作为结束的 body(既无 Content-Length 也不是 chunked)起作用；
+    // 收到任一标记，就认为 body 已经完整；m_onEndCheck 同样只拿到新收到的字节
+    void                    setEndMarkers(const std::vector<std::string>& markers) { m_end_matcher.assign(markers); }
+    // NOTE 消费者跟不上时，暂停读 socket；见 content_flow
+    void                    setContentFlow(const std::shared_ptr<ss1x::asio::content_flow>& flow) { m_flow = flow; }
+    // NOTE 在发起请求之前设置；已经取消的，请求一开始就结束
+    void setRequestCancel(const std::shared_ptr<ss1x::asio::request_cancel>& cancel)
+    {
+        m_cancel = cancel;
+        if (!m_cancel) {
+            return;
+        }
+        // NOTE 总是 post 到 strand 上：cancel() 可能就在本 client 的回调中被调用，
+        // 不能就地结束请求
+        boost::asio::io_service::strand* p_strand = &m_strand;
+        auto handler = this->wrap(boost::bind(&proxy_tunnel_client::handle_cancel, this));
+        m_cancel->attach(this, [p_strand, handler]() -> void { p_strand->post(handler); });
+    }
+    // NOTE 在发起请求之前设置
+    void                    setTimeouts(const ss1x::asio::request_timeouts& timeouts) { m_timeouts = timeouts; }
+    const ss1x::asio::request_timeouts& timeouts() const      { return m_timeouts;                    }
+    // NOTE 请求结束时(先于 onFinished)调用，参数同 stats()
+    void                    setOnStats(ss1x::asio::onStats_t&& func) { m_onStats = std::move(func); }
+    const ss1x::asio::request_stats& stats() const             { return m_stats;                       }
 
     ss1x::http::Headers&    header()                           { return m_response_headers;            }
     ss1x::http::Headers&    request_header()                   { return m_request_headers;             }
     bool                    eof() const                        { return m_has_eof;                     }
+    bool                    connection_reused() const          { return m_connection_reused;           }
+
+    boost::asio::io_service::strand& strand()                  { return m_strand;                      }
+    // 还有已提交、但尚未执行完的回调；此时析构 client 是不安全的
+    bool                    has_pending_handlers() const       { return m_handler_token.use_count() > 1; }
 
     const std::string       get_url() const                    { return m_redirect_urls.back();        }
     const boost::system::error_code& error_code() const        { return m_ec;                          }
@@ -475,6 +643,25 @@ public:
         ssl_tunnel_get_impl();
     }
 
+    void http_head(const std::string& url)
+    {
+        COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(url));
+        m_method = method_t(method_t::E_HEAD);
+        this->initUrl(url);
+        http_get_impl();
+    }
+
+    void ssl_tunnel_head(
+        const std::string& proxy_domain, int proxy_port,
+        const std::string& url)
+    {
+        m_method = method_t(method_t::E_HEAD);
+        this->initUrl(url);
+        m_proxy_hostname = proxy_domain;
+        m_proxy_port     = proxy_port;
+        ssl_tunnel_get_impl();
+    }
+
     void http_post(
         const std::string& url,
         const std::string& content)
@@ -484,6 +671,19 @@ public:
         // m_redirect_urls.resize(0);
         // m_redirect_urls.push_back(url);
         m_post_content = content;
+        m_body_source.reset();
+        http_get_impl();
+    }
+
+    // NOTE body 从 source 中逐块取出，直接写 socket；长度未知时，以 chunked 发送
+    void http_post(
+        const std::string& url,
+        std::shared_ptr<ss1x::asio::body_source> body)
+    {
+        m_method = method_t(method_t::E_POST);
+        this->initUrl(url);
+        m_post_content.clear();
+        m_body_source = std::move(body);
         http_get_impl();
     }
 
@@ -501,80 +701,116 @@ public:
         m_proxy_hostname = proxy_domain;
         m_proxy_port     = proxy_port;
         m_post_content   = content;
+        m_body_source.reset();
+        ssl_tunnel_get_impl();
+    }
+
+    void ssl_tunnel_post(
+        const std::string& proxy_domain, int proxy_port,
+        const std::string& url,
+        std::shared_ptr<ss1x::asio::body_source> body,
+        ss1x::asio::resource_type expect_type = ss1x::asio::res_type_any)
+    {
+        m_method = method_t(method_t::E_POST);
+        m_expect_res_type = expect_type;
+        this->initUrl(url);
+        m_proxy_hostname = proxy_domain;
+        m_proxy_port     = proxy_port;
+        m_post_content.clear();
+        m_body_source    = std::move(body);
         ssl_tunnel_get_impl();
     }
 
 private:
     bool is_need_ssl(const decltype(ss1x::util::url::split_port_auto("")) & url_info)
     {
-        return std::get<2>(url_info) == 443;
+        return std::get<0>(url_info) == "https" || std::get<2>(url_info) == 443;
     }
 
     void http_get_impl()
     {
+        this->resetAttemptStats();
+        if (this->reuse_pooled_connection()) {
+            this->startTimer();
+            async_request();
+            return;
+        }
+        this->renew_socket();
+
         // auto url_info = ss1x::util::url::split_port_auto(get_url());
         // auto& url_info = this->m_u;
         COLOG_TRIGER_INFO(
             SSS_VALUE_MSG(is_need_ssl(m_url_info)),
-            SSS_VALUE_MSG(m_socket.is_ssl_enabled()),
-            SSS_VALUE_MSG(m_socket.using_ssl()),
-            SSS_VALUE_MSG(m_socket.has_ssl()));
+            SSS_VALUE_MSG(m_socket->is_ssl_enabled()),
+            SSS_VALUE_MSG(m_socket->using_ssl()),
+            SSS_VALUE_MSG(m_socket->has_ssl()));
 
         if (is_need_ssl(m_url_info)) {
-            m_socket.upgrade_to_ssl();
+            m_socket->upgrade_to_ssl();
         }
         else {
-            m_socket.disable_ssl();
+            m_socket->disable_ssl();
         }
 
         COLOG_TRIGER_INFO(
             SSS_VALUE_MSG(is_need_ssl(m_url_info)),
-            SSS_VALUE_MSG(m_socket.is_ssl_enabled()),
-            SSS_VALUE_MSG(m_socket.using_ssl()),
-            SSS_VALUE_MSG(m_socket.has_ssl()));
+            SSS_VALUE_MSG(m_socket->is_ssl_enabled()),
+            SSS_VALUE_MSG(m_socket->using_ssl()),
+            SSS_VALUE_MSG(m_socket->has_ssl()));
 
         http_get_impl(std::get<1>(m_url_info), std::get<2>(m_url_info), std::get<3>(m_url_info));
     }
 
-    // const boost::system::error_code& err
-    // deadline_time 被调用的时候，error_code 就两种情况，
-    // 要么非0值，boost::asio::error::operation_aborted
-    //
-    // 要么0值，success
-    void check_deadline(const boost::system::error_code& err)
-    {
-        COLOG_TRIGER_INFO(SSS_VALUE_MSG(pretty_ec(err)));
-        COLOG_TRIGER_INFO(SSS_VALUE_MSG(err == boost::asio::error::operation_aborted));
-        // if (!err) {
-        //     set_error_code(boost::asio::error::eof);
-        //     return;
-        // }
-        if (err == boost::asio::error::operation_aborted) {
+    // NOTE 时间轮的回调；gen 为0，表示整个请求的期限；否则为当前阶段定时器的
+    // 序号，不等于 m_timer_gen 的，是已被替换掉的定时器
+    void check_deadline(uint64_t gen)
+    {
+        if (m_stoped) {
             return;
         }
+        if (!gen) {
+            m_total_timer = 0;
+            this->on_timeout(ss1x::errc::total_timeout);
+            return;
+        }
+        if (gen != m_timer_gen) {
+            return;
+        }
+        m_phase_timer = 0;
+        if (m_phase == phase_none) {
+            return;
+        }
+        // idle 期间收到过数据时，期限已经后移；按新的期限，再等
+        if (clock_type::now() < m_phase_deadline) {
+            this->armPhaseTimer(m_phase_deadline);
+            return;
+        }
+        switch (m_phase) {
+            case phase_connect:    this->on_timeout(ss1x::errc::connect_timeout);    break;
+            case phase_handshake:  this->on_timeout(ss1x::errc::handshake_timeout);  break;
+            case phase_first_byte: this->on_timeout(ss1x::errc::first_byte_timeout); break;
+            default:               this->on_timeout(ss1x::errc::idle_timeout);       break;
+        }
+    }
 
-        // Check whether the deadline has passed. We compare the deadline against
-        // the current time since a new asynchronous operation may have moved the
-        // deadline before this actor had a chance to run.
-        if (m_deadline.expires_at() <= boost::asio::deadline_timer::traits_type::now())
-        {
-            // The deadline has passed. The socket is closed so that any outstanding
-            // asynchronous operations are cancelled.
-            // this->m_socket.get_socket().close();
-            this->m_socket.get_socket().close();
-            this->m_stoped = true;
-            // this->m_deadline.cancel();
-            set_error_code(ss1x::errc::deadline_timer_error);
-
-            // There is no longer an active deadline. The expiry is set to positive
-            // infinity so that the actor takes no action until a new deadline is set.
-            // m_deadline.expires_at(boost::posix_time::pos_infin);
+    void handle_cancel()
+    {
+        if (m_stoped) {
+            return;
         }
+        COLOG_TRIGER_INFO("cancelled:", SSS_VALUE_MSG(int(m_phase)));
+        // NOTE 同 on_timeout()；连接上还有未读完的数据，不能放回池中
+        boost::system::error_code ec;
+        this->m_socket->get_socket().close(ec);
+        set_error_code(boost::asio::error::operation_aborted);
+    }
 
-        // Put the actor back to sleep.
-        //m_deadline.async_wait(boost::bind(&proxy_tunnel_client::check_deadline,
-        //                                  this,
-        //                                  boost::asio::placeholders::error));
+    void on_timeout(ss1x::errc::errc_t code)
+    {
+        COLOG_TRIGER_INFO("timeout:", SSS_VALUE_MSG(int(m_phase)), sss::raw_string(this->get_url()));
+        // NOTE 关闭 socket，未完成的异步操作随之以 operation_aborted 返回
+        this->m_socket->get_socket().close();
+        set_error_code(ss1x::errc::make_error_code(code));
     }
 
     void http_get_impl(const std::string& server, int port, const std::string& path)
@@ -583,15 +819,13 @@ private:
 
         this->startTimer();
 
-        char port_buf[24];
-        std::sprintf(port_buf, "%d", port <= 0 ? 80 : port);
-
-        boost::asio::ip::tcp::resolver::query query(server, port_buf);
         COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(server), SSS_VALUE_MSG(port));
-        m_resolver.async_resolve(
-            query, boost::bind(&proxy_tunnel_client::handle_resolve, this,
-                               boost::asio::placeholders::error,
-                               boost::asio::placeholders::iterator));
+        m_stats.dns_start = ss1x::asio::request_stats::now();
+        m_dns->async_resolve(
+            m_io_service, server, port <= 0 ? 80 : port,
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_resolve, this,
+                                   boost::asio::placeholders::error,
+                                   boost::asio::placeholders::iterator)));
     }
 
     bool had_exceed_max_redirect() const
@@ -600,26 +834,25 @@ private:
     }
     void ssl_tunnel_get_impl()
     {
+        this->resetAttemptStats();
+        if (this->reuse_pooled_connection()) {
+            this->startTimer();
+            async_request();
+            return;
+        }
+        this->renew_socket();
+
         // auto url_info = ss1x::util::url::split_port_auto(get_url());
         if (is_need_ssl(m_url_info)) {
-            m_socket.upgrade_to_ssl();
+            m_socket->upgrade_to_ssl();
         }
         else {
-            m_socket.disable_ssl();
+            m_socket->disable_ssl();
         }
         COLOG_TRIGER_DEBUG(sss::raw_string(m_proxy_hostname), m_proxy_port);
 
-        // int32_t -> 11 + 1bytes
-        // int64_t -> 21 bytes
-
-        // ceil(log_10(2^64)) + 1 = 21 bytes
-        // ceil(log_10(2^32)) + 1) = 11 bytes
-        char port_buf[24];
-        std::sprintf(port_buf, "%d", m_proxy_port <= 0 ? 80 : m_proxy_port);
-
         this->startTimer();
 
-        boost::asio::ip::tcp::resolver::query query(m_proxy_hostname, port_buf);
         // NOTE 这async_resolve()之后，是异步完成；如果现在是normal-socket，
         // 那么，我在什么时候，才能upgrade_to_ssl() 呢？
         // 还是说，我额外设计一组流程。只不过，事先就update；然后内部的异步handle调用中，
@@ -628,17 +861,20 @@ private:
         // 或者这样，同一个 proxy_tunnel_client ，调用两次，分别是http_tunnel()
         // 和 http_get()
         // 前者，只是获取一个200；后者完成一般的通信；
-        async_https_proxy_connect(m_socket.get_socket(), query);
+        async_https_proxy_connect(m_socket->get_socket(), m_proxy_hostname,
+                                  m_proxy_port <= 0 ? 80 : m_proxy_port);
     }
 
-    template<typename Stream, typename Query>
-    void async_https_proxy_connect(Stream& sock, Query& query)
+    template<typename Stream>
+    void async_https_proxy_connect(Stream& sock, const std::string& host, int port)
     {
         RET_ON_STOP;
-        m_resolver.async_resolve(
-            query, boost::bind(&proxy_tunnel_client::async_https_proxy_resolve<Stream>, this,
-                               boost::asio::placeholders::error,
-                               boost::asio::placeholders::iterator, boost::ref(sock)));
+        m_stats.dns_start = ss1x::asio::request_stats::now();
+        m_dns->async_resolve(
+            m_io_service, host, port,
+            this->wrap(boost::bind(&proxy_tunnel_client::async_https_proxy_resolve<Stream>, this,
+                                   boost::asio::placeholders::error,
+                                   boost::asio::placeholders::iterator, boost::ref(sock))));
     }
 
     template <typename Stream>
@@ -648,6 +884,7 @@ private:
     {
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG("");
+        m_stats.dns_done = ss1x::asio::request_stats::now();
         if (err)
         {
             COLOG_TRIGER_ERROR("Connect to http proxy \'", m_proxy_hostname, ":",
@@ -656,44 +893,28 @@ private:
             set_error_code(err);
             return;
         }
-        // 开始异步连接代理.
-        boost::asio::async_connect(
-            sock.lowest_layer(), endpoint_iterator,
-            boost::bind(
-                &proxy_tunnel_client::handle_connect_https_proxy<Stream>, this,
-                boost::ref(sock), endpoint_iterator,
-                boost::asio::placeholders::error));
+        // 开始异步连接代理；代理的多个地址，并行尝试
+        this->async_connect_endpoints(
+            sock, endpoint_iterator,
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_connect_https_proxy<Stream>,
+                                   this, boost::ref(sock),
+                                   boost::asio::placeholders::error)));
     }
 
     template <typename Stream>
-    void handle_connect_https_proxy(
-        Stream& sock,
-        boost::asio::ip::tcp::resolver::iterator endpoint_iterator,
-        const boost::system::error_code& err)
+    void handle_connect_https_proxy(Stream& sock, const boost::system::error_code& err)
     {
+        m_connecting.reset();
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG(pretty_ec(err));
         if (err)
         {
-            endpoint_iterator++;
-            boost::asio::ip::tcp::resolver::iterator end;
-            if (endpoint_iterator == end)
-            {
-                COLOG_TRIGER_ERROR("Connect to http proxy \'" , m_proxy_hostname , ":" , m_proxy_port ,
-                    "\', error message \'" , err.message() , "\'");
-                set_error_code(err);
-                return;
-            }
-
-            // 继续尝试连接下一个IP.
-            boost::asio::async_connect(
-                sock.lowest_layer(), endpoint_iterator,
-                boost::bind(&proxy_tunnel_client::handle_connect_https_proxy<Stream>,
-                            this, boost::ref(sock), endpoint_iterator,
-                            boost::asio::placeholders::error));
-
+            COLOG_TRIGER_ERROR("Connect to http proxy \'" , m_proxy_hostname , ":" , m_proxy_port ,
+                "\', error message \'" , err.message() , "\'");
+            set_error_code(err);
             return;
         }
+        m_stats.connected = ss1x::asio::request_stats::now();
         discard(m_response); // clean response before receive data
         std::ostream request_stream(&m_request);
         // auto url_info = ss1x::util::url::split_port_auto(get_url());
@@ -714,7 +935,7 @@ private:
             // NOTE
             // copied from:
             // https://github.com/boostorg/beast/blob/bfd4378c133b2eb35277be8b635adb3f1fdaf09d/example/http/client/sync-ssl/http_client_sync_ssl.cpp#L67
-            if(!::SSL_set_tlsext_host_name(m_socket.get_ssl_socket().native_handle(), std::get<1>(m_url_info).c_str()))
+            if (!this->prepare_handshake())
             {
                 boost::system::error_code ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
                 throw boost::system::system_error{ec};
@@ -722,9 +943,9 @@ private:
 
             boost::asio::async_write(
                 sock, m_request, boost::asio::transfer_exactly(m_request.size()),
-                boost::bind(
+                this->wrap(boost::bind(
                     &proxy_tunnel_client::handle_https_proxy_request<Stream>, this,
-                    boost::ref(sock), boost::asio::placeholders::error));
+                    boost::ref(sock), boost::asio::placeholders::error)));
         }
         else {
             async_request();
@@ -745,9 +966,9 @@ private:
             return;
         }
         boost::asio::async_read_until(sock, m_response, "\r\n\r\n",
-          boost::bind(&proxy_tunnel_client::handle_https_proxy_status<Stream>,
-                      this,
-                      boost::ref(sock), boost::asio::placeholders::error));
+          this->wrap(boost::bind(&proxy_tunnel_client::handle_https_proxy_status<Stream>,
+                                 this,
+                                 boost::ref(sock), boost::asio::placeholders::error)));
     }
 
     template<typename Stream>
@@ -784,16 +1005,18 @@ private:
                         ":", m_proxy_port, "error message ", err.message());
             return;
         }
-        COLOG_TRIGER_DEBUG("proxy_status:http version: ", version_major, '.', version_minor);
+        COLOG_TRIGER_DEBUG("proxy_status:http version: ", version_major, '.', version_minor, status_code);
         m_response.consume(status_line_size);
+        this->header().status_code  = status_code;
+        this->header().http_version = std::to_string(version_major) + '.' + std::to_string(version_minor);
 
         // TODO 按行拆分 proxy header 的处理
         boost::asio::async_read_until(
             sock, m_response, "\r\n\r\n",
-            boost::bind(&proxy_tunnel_client::handle_https_proxy_header<Stream>,
-                        this, boost::ref(sock),
-                        boost::asio::placeholders::bytes_transferred,
-                        boost::asio::placeholders::error));
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_https_proxy_header<Stream>,
+                                   this, boost::ref(sock),
+                                   boost::asio::placeholders::bytes_transferred,
+                                   boost::asio::placeholders::error)));
     }
 
     template<typename Stream>
@@ -812,18 +1035,30 @@ private:
 
         // Process the response headers from proxy server.
         // std::istream response_stream(&m_response);
+        const unsigned int proxy_status = this->header().status_code;
         m_response_headers.clear();
+        m_response_headers.status_code = proxy_status;
         std::size_t raw_header_length{0};
         processHeader(m_response_headers, cast_string_view(m_response), raw_header_length);
         // processHeader(m_response_headers, response_stream);
 
         m_response.consume(raw_header_length);
 
-        // Write whatever content we already have to output.
-        if (m_response.size() > 0 && s_is_status_code_ok(this->header().status_code)) { // 200
-            COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_response.size()));
-            consume_content(m_response);
+        // NOTE CONNECT 失败(比如 407)时，不能接着握手
+        if (!s_is_status_code_ok(proxy_status)) {
+            COLOG_TRIGER_ERROR("Connect to http proxy ", sss::raw_string(m_proxy_hostname),
+                               ":", m_proxy_port, " refused: ", proxy_status);
+            m_socket->close();
+            set_error_code(ss1x::errc::make_error_code(static_cast<ss1x::errc::errc_t>(proxy_status)));
+            return;
+        }
+        // NOTE 隧道建立之后，是 TLS 握手；服务端不会先发数据。这里残留的字节，
+        // 既不是 body，也不能交给 ssl stream
+        if (m_response.size() > 0) {
+            COLOG_TRIGER_ERROR("unexpected bytes after CONNECT response:", m_response.size());
+            discard(m_response);
         }
+        m_stats.tunnel_done = ss1x::asio::request_stats::now();
 
         COLOG_TRIGER_DEBUG("Connect to http proxy \'", m_proxy_hostname, ":", m_proxy_port, "\'.");
 
@@ -834,62 +1069,18 @@ private:
         // 另外需要注意的是，一旦成功handshake之后，后续交流用到的socket，一定是ssl
         // 版！即，需要底层库，完成加密解密后，用户代码才能看到（对于用户透明，但是
         // 有带宽以及运算延时的损耗）。
-        m_socket.get_ssl_socket().async_handshake(
+        this->enterPhase(phase_handshake);
+        m_socket->get_ssl_socket().async_handshake(
             boost::asio::ssl::stream_base::client,
-            boost::bind(&proxy_tunnel_client::handle_https_proxy_handshake, this,
-                        boost::asio::placeholders::error));
-    }
-
-    // NOTE if one filed value is empty, this will deprecated
-    void requestStreamHelper(std::set<std::string>& used_field,
-                             ss1x::http::Headers& request_header,
-                             std::ostream& request_stream,
-                             const std::string& field,
-                             const std::string& default_value = "")
-    {
-        RET_ON_STOP;
-        if (used_field.find(field) != used_field.end()) {
-            return;
-        }
-        auto it = request_header.find(field);
-        if (it != request_header.end())
-        {
-            if (!it->second.empty()) {
-                sss::string_view fd_value = it->second;
-                while(!fd_value.empty()) {
-                    auto pos = fd_value.find(CRLF);
-                    request_stream << field << ": " << fd_value.substr(0, pos) << CRLF;
-                    if (pos == sss::string_view::npos)
-                    {
-                        break;
-                    }
-                    fd_value = fd_value.substr(pos + 2);
-                }
-            }
-        }
-        else if (!default_value.empty()) {
-            request_stream << field << ": " << default_value << CRLF;
-        }
-        used_field.insert(field);
-    }
-
-    void requestStreamDumpRest(std::set<std::string>& used_field,
-                               ss1x::http::Headers& request_header,
-                               std::ostream& request_stream)
-    {
-        RET_ON_STOP;
-        for (const auto & kv : request_header) {
-            if (used_field.find(kv.first) != used_field.end()) {
-                continue;
-            }
-            request_stream << kv.first << ": " << kv.second << CRLF;
-        }
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_https_proxy_handshake, this,
+                                   boost::asio::placeholders::error)));
     }
 
     void handle_https_proxy_handshake(const boost::system::error_code& err)
     {
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG(pretty_ec(err));
+        this->finish_handshake(err);
         if (err)
         {
             COLOG_TRIGER_ERROR("Connect to http proxy ", sss::raw_string(m_proxy_hostname),
@@ -918,19 +1109,162 @@ private:
         // User-Agent: avhttp/2.9.9
         // Connection: close
 
+        this->enterPhase(phase_first_byte);
+
         discard(m_response);
-        discard(m_request);
-        // NOTE 逻辑上，POST，GET，这两种方法，应该公用一个request-generator
-        std::ostream request_stream(&m_request);
-        // auto url_info = ss1x::util::url::split_port_auto(get_url());
 
+        const bool is_post = m_method.is(method_t::E_POST);
+        const bool is_streaming = is_post && m_body_source;
+        // NOTE 跳转、重发时，body 要从头再发一遍
+        if (is_streaming && !m_body_source->rewind()) {
+            COLOG_TRIGER_ERROR("request body cannot be rewound");
+            set_error_code(ss1x::errc::body_not_rewindable);
+            return;
+        }
+        const ss1x::detail::request_header_cache::entry_t& block = this->requestHeaderBlock();
+
+        // NOTE 请求行、动态字段，与缓存的 header 块，一起写入 m_request_data；
+        // 该 buffer 清空后复用，容量稳定之后，不再分配内存
+        m_request_data.clear();
+        ss1x::detail::request_writer w(m_request_data);
+        w.raw(m_method.name()).raw(' ');
         if (m_proxy_hostname.empty()) {
-            request_stream << m_method.name() << " " << std::get<3>(m_url_info) << " HTTP/";
+            w.raw(std::get<3>(m_url_info));
         }
         else {
-            request_stream << m_method.name() << " " << this->get_url() << " HTTP/";
+            w.raw(m_redirect_urls.back());
+        }
+        w.raw(" HTTP/").raw(block.version).crlf();
+        w.raw(block.block);
+
+        // NOTE 用户自己给了 Content-Length 时，body 原样发送，不分块
+        m_body_chunked = false;
+        if (is_streaming && !block.has_content_length) {
+            if (m_body_source->size() >= 0) {
+                w.field("Content-Length", uint64_t(m_body_source->size()));
+            }
+            else {
+                w.field("Transfer-Encoding", "chunked");
+                m_body_chunked = true;
+            }
         }
+        else if (is_post && !block.has_content_length) {
+            w.field("Content-Length", uint64_t(m_post_content.size()));
+        }
+        if (!block.has_cookie && m_onRequestCookie) {
+            auto cookies = m_onRequestCookie(m_redirect_urls.back());
+            for (auto& cookie : cookies) {
+                COLOG_TRIGER_INFO(std::get<1>(m_url_info), std::get<3>(m_url_info), cookie);
+                if (cookie.empty()) {
+                    continue;
+                }
+                w.field("Cookie", cookie);
+            }
+        }
+        w.crlf();
+
+        COLOG_TRIGER_DEBUG(sss::raw_string(m_request_data));
+        if (is_streaming) {
+            m_body_sent = 0;
+            this->write_body();
+            return;
+        }
+        m_stats.request_bytes += m_request_data.size() + (is_post ? m_post_content.size() + CRLF.size() : 0);
+
+        // NOTE POST 的 body 不拷贝，与请求头一起 gather-write
+        // 2017-12-25 body 之后，多发一个 CRLF
+        std::array<boost::asio::const_buffer, 3> buffers = {{
+            boost::asio::buffer(m_request_data),
+            is_post ? boost::asio::buffer(m_post_content) : boost::asio::const_buffer(),
+            is_post ? boost::asio::buffer(CRLF.data(), CRLF.size()) : boost::asio::const_buffer()
+        }};
+        boost::asio::async_write(
+            *m_socket, buffers,
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_request, this,
+                                   boost::asio::placeholders::error)));
+    }
+
+    // NOTE 每次从 m_body_source 取一块，与(第一次时的)请求头一起 gather-write；
+    // chunked 时，块的前后分别加上 chunk-size 行与 CRLF，最后以空 chunk 结束。
+    // 上传期间，每写完一块都重新计 first_byte 超时；于是大的 body 不会因为
+    // 发送本身耗时而超时，只有停滞才会
+    void write_body()
+    {
+        boost::system::error_code ec;
+        boost::asio::const_buffer data = m_body_source->next(ec);
+        if (ec) {
+            COLOG_TRIGER_ERROR("Read request body, error message: ", ec.message());
+            set_error_code(ec);
+            return;
+        }
+        m_body_sent += data.size();
+
+        bool last = data.size() == 0;
+        const int64_t size = m_body_source->size();
+        if (!m_body_chunked && size >= 0) {
+            if (m_body_sent > uint64_t(size) || (last && m_body_sent != uint64_t(size))) {
+                COLOG_TRIGER_ERROR(SSS_VALUE_MSG(size), SSS_VALUE_MSG(m_body_sent));
+                set_error_code(ss1x::errc::body_size_mismatch);
+                return;
+            }
+            last = m_body_sent == uint64_t(size);
+        }
+
+        m_chunk_head.clear();
+        if (m_body_chunked) {
+            if (data.size()) {
+                ss1x::detail::request_writer w(m_chunk_head);
+                w.hex(data.size()).crlf();
+            }
+            else {
+                m_chunk_head = "0\r\n\r\n";
+            }
+        }
+        std::array<boost::asio::const_buffer, 4> buffers = {{
+            boost::asio::buffer(m_request_data),
+            boost::asio::buffer(m_chunk_head),
+            data,
+            m_body_chunked && data.size() ? boost::asio::buffer(CRLF.data(), CRLF.size())
+                                          : boost::asio::const_buffer()
+        }};
+        m_stats.request_bytes += boost::asio::buffer_size(buffers);
+        boost::asio::async_write(
+            *m_socket, buffers,
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_write_body, this,
+                                   boost::asio::placeholders::error, last)));
+    }
 
+    void handle_write_body(const boost::system::error_code& err, bool last)
+    {
+        RET_ON_STOP;
+        if (err) {
+            this->handle_request(err);
+            return;
+        }
+        m_request_data.clear();
+        this->enterPhase(phase_first_byte);
+        if (last) {
+            this->handle_request(err);
+            return;
+        }
+        this->write_body();
+    }
+
+    // NOTE Host 行以及用户的 request header 不变时，复用上次拼好的 header 块；
+    // 每次都可能不同的 Content-Length(POST)、Cookie(来自回调) 不在其中
+    const ss1x::detail::request_header_cache::entry_t& requestHeaderBlock()
+    {
+        const bool is_post = m_method.is(method_t::E_POST);
+        const int  flags   = (is_post ? 1 : 0) | (m_pool ? 2 : 0) | (int(m_expect_res_type) << 2);
+        const std::string& host = m_proxy_hostname.empty() ? std::get<1>(m_url_info) : m_proxy_hostname;
+
+        auto& cache = ss1x::detail::request_header_cache::local();
+        if (const auto* p_entry = cache.find(host, flags, m_request_headers)) {
+            return *p_entry;
+        }
+
+        // 先校验，再写入缓存
+        const char* http_version = "1.1";
         if (!m_request_headers.http_version.empty()) {
             int version_major = -1;
             int version_minor = -1;
@@ -945,35 +1279,23 @@ private:
                     "error parssing user supliment http-version with ",
                     sss::raw_string(m_request_headers.http_version));
             }
-            COLOG_TRIGER_DEBUG("http_version", m_request_headers.http_version);
-            request_stream << m_request_headers.http_version;
-        }
-        else {
-            // NOTE HTTP/1.1 可能需要支持
-            // Transfer-Encoding "chunked"
-            // 特性，这需要特殊处理！先读取16进制的长度数字，然后读取该长度的数据。
-            // 不过，如果中间发生了截断，怎么办？即，被m_response本身的buffer阶段了……
-            // 还有，如果chunk数，太大了怎么办？另外，读取chunk数，本身的时候，
-            // 被截断了，怎么办？
-            // 只能是状态机了！
-            const char * http_version = "1.1";
-            COLOG_TRIGER_DEBUG("http_version", http_version);
-            request_stream << http_version;
+            http_version = m_request_headers.http_version.c_str();
         }
-        request_stream << CRLF;
+        COLOG_TRIGER_DEBUG("http_version", http_version);
 
-        std::set<std::string> used_field;
+        auto& entry   = cache.slot();
+        entry.host    = host;
+        entry.flags   = flags;
+        entry.headers = m_request_headers;
+        entry.version = http_version;
+        entry.block.clear();
 
-        // NOTE Host 需要手动拼凑
-        if (m_proxy_hostname.empty()) {
-            request_stream << "Host: " << std::get<1>(m_url_info) << CRLF;
-        }
-        else {
-            request_stream << "Host: " << m_proxy_hostname << CRLF;
-        }
-        used_field.insert("Host");
+        const ss1x::http::Headers& headers = entry.headers;
+        ss1x::detail::request_writer w(entry.block);
 
-        requestStreamHelper(used_field, m_request_headers, request_stream, "User-Agent", USER_AGENT_DEFAULT);
+        // NOTE Host 需要手动拼凑
+        w.field("Host", host);
+        writeRequestField(w, headers, "User-Agent", USER_AGENT_DEFAULT);
         // 另外，可能还需要根据html标签类型的不同，来限制可以获取的类型；
         // 比如img的话，就获取
         // Accept: image/webp,image/*,*/*;q=0.8
@@ -989,65 +1311,72 @@ private:
             case ss1x::asio::res_type_text:  accept_type = "text/plain, */*";            break;
             case ss1x::asio::res_type_image: accept_type = "image/webp, */*";            break;
         }
-        requestStreamHelper(used_field, m_request_headers, request_stream, "Accept", accept_type);
+        writeRequestField(w, headers, "Accept", accept_type);
 
         // NOTE 部分网站，比如 http://i.imgur.com/lYQgi0R.gif 必须要提供 (Accept-Encoding "gzip, deflate, sdch") 参数；
         // 不然，无法正常从图床获取图片，而是给你一个frame，再显示图片。
-        // requestStreamHelper(used_field, m_request_headers, request_stream, "Accept-Encoding", "gzip, deflate, sdch");
         // 参考： https://imququ.com/post/vary-header-in-http.html
         // NOTE 2019-09-19 add `br`
         // NOTE 2019-10-04 `sdch' is for developed by google, and supported by chrome only; so ...
         // https://www.cnblogs.com/xingzc/p/9082035.html
         // https://cloud.tencent.com/developer/section/1189886
-        requestStreamHelper(used_field, m_request_headers, request_stream, "Accept-Encoding", "gzip, deflate, br");
+        writeRequestField(w, headers, "Accept-Encoding", "gzip, deflate, br");
+        writeRequestField(w, headers, "Referer", "");
 
-        if (m_request_headers.has("Referer")) {
-            requestStreamHelper(used_field, m_request_headers, request_stream, "Referer", "");
+        if (is_post) {
+            writeRequestField(w, headers, "Content-Type", "application/x-www-form-urlencoded");
+            entry.has_content_length = headers.has("Content-Length");
+            writeRequestField(w, headers, "Content-Length", "");
         }
-
-        if (m_method.is(method_t::E_POST)) {
-            std::string CL_str = sss::cast_string(m_post_content.size());
-            requestStreamHelper(used_field, m_request_headers, request_stream, "Content-Type", "application/x-www-form-urlencoded");
-            requestStreamHelper(used_field, m_request_headers, request_stream, "Content-Length", CL_str);
+        else {
+            entry.has_content_length = false;
         }
 
-        if (m_request_headers.has("Cookie")) {
-            requestStreamHelper(used_field, m_request_headers, request_stream, "Cookie", "");
-        }
-        else if (m_onRequestCookie) {
-            auto cookies = m_onRequestCookie(this->get_url());
-            int cookie_cnt = 0;
-            for (auto& cookie : cookies) {
-                COLOG_TRIGER_INFO(std::get<1>(m_url_info), std::get<3>(m_url_info), cookie);
-                if (cookie.empty()) {
-                    continue;
-                }
-                request_stream << "Cookie" << ": " << cookie << CRLF;
-                ++cookie_cnt;
-            }
-            if (cookie_cnt) {
-                used_field.insert("Cookie");
-            }
-        }
+        entry.has_cookie = headers.has("Cookie");
+        writeRequestField(w, headers, "Cookie", "");
 
         // NOTE Connection 选项 等于 close和keep-alive的区别在于，keep-alive的时候，服务器端，不会主动关闭通信，也就是没有eof传来。
         // 这需要客户端，自动分析包大小，进行消息拆分。
         // 比如，分析：Content-Length: 4376 字段
-        requestStreamHelper(used_field, m_request_headers, request_stream, "Connection", "close");
-        requestStreamDumpRest(used_field, m_request_headers, request_stream);
-        request_stream << CRLF;
+        // NOTE 有连接池时，才要求 keep-alive；响应读完后，连接归还到池中。
+        writeRequestField(w, headers, "Connection", m_pool ? "keep-alive" : "close");
 
-        // 2017-12-25
-        if (m_method.is(method_t::E_POST)) {
-            request_stream << m_post_content << CRLF;
+        for (const auto & kv : headers) {
+            if (!is_builtin_request_field(kv.first, is_post)) {
+                w.field(kv.first, kv.second);
+            }
         }
+        return entry;
+    }
 
-        COLOG_TRIGER_DEBUG(streambuf_view(m_request));
-        boost::asio::async_write(
-            m_socket, m_request,
-            boost::asio::transfer_exactly(m_request.size()),
-            boost::bind(&proxy_tunnel_client::handle_request, this,
-                        boost::asio::placeholders::error));
+    // NOTE 用户提供了该字段时，用用户的值；值为空，表示不发送该字段。否则用默认值
+    static void writeRequestField(ss1x::detail::request_writer& w,
+                                  const ss1x::http::Headers&    headers,
+                                  const char*                   field,
+                                  sss::string_view              default_value)
+    {
+        auto it = headers.find(field);
+        if (it != headers.end()) {
+            w.field_lines(field, it->second);
+        }
+        else if (!default_value.empty()) {
+            w.field(field, default_value);
+        }
+    }
+
+    // 由 requestHeaderBlock() 单独处理的字段；其余的，原样附加在后面
+    static bool is_builtin_request_field(const std::string& field, bool is_post)
+    {
+        static const char* const s_fields[] = {
+            "Host", "User-Agent", "Accept", "Accept-Encoding", "Referer", "Cookie", "Connection"
+        };
+        for (const char* name : s_fields) {
+            if (::strcasecmp(field.c_str(), name) == 0) {
+                return true;
+            }
+        }
+        return is_post && (::strcasecmp(field.c_str(), "Content-Type") == 0 ||
+                           ::strcasecmp(field.c_str(), "Content-Length") == 0);
     }
 
     void handle_request(const boost::system::error_code& err)
@@ -1056,18 +1385,22 @@ private:
         COLOG_TRIGER_DEBUG(pretty_ec(err));
         if (err)
         {
+            if (this->retry_stale_connection(err)) {
+                return;
+            }
             COLOG_TRIGER_ERROR("Send request, error message: ", err.message());
             set_error_code(err);
             return;
         }
+        m_stats.request_sent = ss1x::asio::request_stats::now();
 
         discard(m_response);
         // 异步读取Http status.
         boost::asio::async_read_until(
-            m_socket, m_response, "\r\n",
-            boost::bind(&proxy_tunnel_client::handle_read_status, this,
-                        boost::asio::placeholders::bytes_transferred,
-                        boost::asio::placeholders::error));
+            *m_socket, m_response, "\r\n",
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_read_status, this,
+                                   boost::asio::placeholders::bytes_transferred,
+                                   boost::asio::placeholders::error)));
     }
 
     void handle_read_status(int bytes_transferred, const boost::system::error_code& err)
@@ -1076,10 +1409,14 @@ private:
         COLOG_TRIGER_DEBUG(bytes_transferred, pretty_ec(err));
         if (err)
         {
+            if (this->retry_stale_connection(err)) {
+                return;
+            }
             COLOG_TRIGER_ERROR("Read status line, error message: ", err.message());
             set_error_code(err);
             return;
         }
+        m_stats.first_byte = ss1x::asio::request_stats::now();
 
         // 非标准http服务器直接向客户端发送文件的需要, 但是依然需要以malformed_status_line通知用户,
         // malformed_status_line并不意味着连接关闭, 关于m_response中的数据如何
@@ -1108,32 +1445,29 @@ private:
             return;
         }
         this->header().status_code = status_code;
+        this->header().http_version = std::to_string(version_major) + '.' + std::to_string(version_minor);
+        // 响应已经开始；此后按 idle 计时
+        this->enterPhase(phase_idle);
 
         COLOG_TRIGER_DEBUG(status_line_size, version_major, '.', version_minor, status_code);
         discard(m_response, status_line_size);
+        m_stats.header_bytes += status_line_size;
 
-        // NOTE
-        //
-        // 对于大段大段的header，如何处理安全点呢？
-        // 还是分开的好。
-        // 但是，仍然无法避免过长的header攻击。
-        // 或者垃圾header字段，让你抽取不到有用的信息。
-        // 另外，header如果要解析的话，是不区分大小写的（key-value的key）
-        //
-        // TODO FIXME 唯一正确的处理办法，是状态机！
-        // 这样，就不用保持数据，一直扩大缓存，也能处理各种 async_read_until 的结束条件
-        //
-        // 另外，大部分浏览器，处理header的时候，都是定义一个最大空间。比如2048；
-        // 这里的话，可以一个kv，限制最大长度是1024；然后可以有256个kv值对；
-        // 等等；
+        // NOTE 每个响应(包括跳转)的 body 长度，都要重新计算
+        m_content_to_read = 0;
+        m_is_chunked      = false;
+        m_read_until_eof  = false;
+        m_has_eof         = false;
+        m_end_matcher.reset();
+
+        // NOTE header 由 processHeaderBlock() 逐块增量解析，已解析的行随即从
+        // 缓存中取走；总长度超过 s_max_header_bytes 即失败，防止过长的 header
 
         m_response_headers.clear();
+        m_header_scanned = 0;
+        m_header_bytes   = 0;
 
-        boost::asio::async_read_until(
-            m_socket, m_response, "\r\n",
-            boost::bind(&proxy_tunnel_client::handle_read_header, this,
-                        boost::asio::placeholders::bytes_transferred,
-                        boost::asio::placeholders::error));
+        this->read_header();
     }
 
     void processResponseSetCookie(ss1x::http::Headers& headers)
@@ -1150,68 +1484,80 @@ private:
         }
     }
 
-    size_t processHeaderOnce(ss1x::http::Headers& headers, sss::string_view head_line_view)
+    // NOTE 单行 header 的解析；key 不含结尾的空白，value 去掉前导空白
+    void processHeaderLine(ss1x::http::Headers& headers, sss::string_view line)
     {
-        auto pos = 0;
-        size_t raw_header_length = 0;
-        do {
-            auto end_pos = head_line_view.find(CRLF, pos);
-            if (end_pos == sss::string_view::npos) {
-                this->set_error_code(ss1x::errc::malformed_status_line);
-                break;
-            }
+        const char* colon = static_cast<const char*>(std::memchr(line.data(), ':', line.size()));
+        if (!colon) {
+            // NOTE someting wrong
+            COLOG_TRIGER_DEBUG("bad header line:", sss::raw_string(line));
+            return;
+        }
+        size_t key_len   = colon - line.data();
+        size_t value_beg = key_len + 1;
+        while (value_beg < line.size() && (line[value_beg] == ' ' || line[value_beg] == '\t')) {
+            ++value_beg;
+        }
+        sss::string_view value = line.substr(value_beg);
 
-            auto line = head_line_view.substr(0, end_pos);
-            raw_header_length += line.size() + CRLF.size();
-            if (line.empty()) {
-                // this means the last "\r\n" encountered
-                raw_header_length += CRLF.size();
-                break;
-            }
+        // NOTE 多值的key，通过"\r\n"为间隔，串接在一起。
+        // TODO 或许，应该用vector来保存header；
+        std::string& slot = headers[std::string(line.data(), key_len)];
+        if (!slot.empty()) {
+            slot.append("\r\n");
+        }
+        slot.append(value.data(), value.size());
 
-            size_t colon_pos = line.find(':');
+        if (key_len == 10 && ::strncasecmp(line.data(), "Set-Cookie", key_len) == 0) {
+            std::string cookie = value.to_string();
+            this->processResponseSetCookie2(std::get<1>(m_url_info), cookie);
+        }
+        else if (key_len == 14 && ::strncasecmp(line.data(), "Content-Length", key_len) == 0) {
+            m_content_to_read = std::strtoll(slot.c_str(), nullptr, 10);
+        }
 
-            if (colon_pos == std::string::npos) {
-                // NOTE someting wrong
-                continue;
-            }
-            size_t value_beg =
-                line.find_first_not_of("\t ", colon_pos + 1);
-            if (value_beg == std::string::npos) {
-                value_beg = line.length();
-            }
-            // NOTE descard the last '\r'
-            size_t len = line.length() - value_beg;
-            auto key   = line.substr(0, colon_pos).to_string();
-            auto value = line.substr(value_beg, len).to_string();
-            // NOTE 多值的key，通过"\r\n"为间隔，串接在一起。
-            // TODO 或许，应该用vector来保存header；
-            if (key == "Set-Cookie") {
-                this->processResponseSetCookie2(std::get<1>(m_url_info), value);
-            }
-            if (!headers[key].empty()) {
-                headers[key].append("\r\n");
-            }
-            headers[key].append(value);
+        COLOG_TRIGER_DEBUG(sss::raw_string(line));
+    }
 
-            if (key == "Content-Length") {
-                m_content_to_read = sss::string_cast<uint32_t>(value);
+    /**
+     * @brief 一次处理 buf 中所有完整的 header 行
+     *
+     * 行结束符为 "\r\n"(也容忍单独的 '\n')；用 memchr 查找，由 libc 做向量化。
+     * 遇到空行，返回 true，consumed 包括空行本身；否则，consumed 为已解析的完整
+     * 行的长度，剩下的半行留待下次；m_header_scanned 记录其中已确认不含 '\n'
+     * 的长度，续读之后不必重扫。
+     */
+    bool processHeaderBlock(ss1x::http::Headers& headers, sss::string_view buf, size_t& consumed)
+    {
+        const char* beg  = buf.data();
+        const char* end  = beg + buf.size();
+        const char* cur  = beg;
+        const char* scan = beg + std::min(m_header_scanned, buf.size());
+        while (true) {
+            const char* lf = static_cast<const char*>(std::memchr(scan, '\n', end - scan));
+            if (!lf) {
+                consumed         = cur - beg;
+                m_header_scanned = end - cur;
+                return false;
             }
-
-            COLOG_TRIGER_DEBUG(sss::raw_string(line));
-        } while(false);
-
-        return raw_header_length;
+            const char* line_end = (lf > cur && lf[-1] == '\r') ? lf - 1 : lf;
+            if (line_end == cur) {
+                consumed         = lf + 1 - beg;
+                m_header_scanned = 0;
+                return true;
+            }
+            this->processHeaderLine(headers, sss::string_view(cur, line_end - cur));
+            cur = scan = lf + 1;
+        }
     }
 
     void processHeader(ss1x::http::Headers& headers, sss::string_view head_line_view, size_t& raw_header_length)
     {
         RET_ON_STOP;
-        while (!head_line_view.empty()) {
-            size_t cur_len = processHeaderOnce(headers, head_line_view);
-            raw_header_length += cur_len;
-            head_line_view = head_line_view.substr(cur_len);
-        }
+        m_header_scanned = 0;
+        size_t consumed  = 0;
+        this->processHeaderBlock(headers, head_line_view, consumed);
+        raw_header_length += consumed;
     }
 
     // void processHeader(ss1x::http::Headers& headers, std::istream& response_stream)
@@ -1242,64 +1588,50 @@ private:
     //     }
     // }
 
+    // NOTE m_response 中已有的 header 行，一次解析完；缓冲区耗尽而 header
+    // 还没有结束时，才发起新的读取。
+    void read_header()
+    {
+        size_t consumed = 0;
+        bool   done     = this->processHeaderBlock(m_response_headers, cast_string_view(m_response), consumed);
+        m_response.consume(consumed);
+        m_header_bytes += consumed;
+        m_stats.header_bytes += consumed;
+        if (done) {
+            this->handle_header_done();
+            return;
+        }
+        // NOTE 单行 header 撑满了 m_response，或者 header 总长度超限，都按
+        // 攻击/错误处理
+        if (m_response.size() >= m_response.max_size() || m_header_bytes > s_max_header_bytes) {
+            COLOG_TRIGER_ERROR("response header too large:", SSS_VALUE_MSG(m_header_bytes),
+                               SSS_VALUE_MSG(m_response.size()));
+            set_error_code(ss1x::errc::malformed_response_headers);
+            return;
+        }
+        boost::asio::async_read(
+            *m_socket, m_response, boost::asio::transfer_at_least(1),
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_read_header, this,
+                                   boost::asio::placeholders::bytes_transferred,
+                                   boost::asio::placeholders::error)));
+    }
+
     void handle_read_header(int bytes_transferred, const boost::system::error_code& err)
     {
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG(bytes_transferred, pretty_ec(err));
-        COLOG_TRIGER_DEBUG(streambuf_view(m_response));
 
         if (err) {
             set_error_code(err);
             return;
         }
-        // TODO FIXME
-        // 利用状态机，或者分行处理header；
-        // 假设header每个有效行，不会超过1024byte。
-        // 超过的，按错误处理。
-        // Process the response headers.
-
-        // avhttp中，是用一个std::string，作为临时buffer，不断读取字符，直到读取到仅"\r\n"
-        // 的header结束标记为止；
-        // 之后，才一股脑，完成header的解析。
-        // 这确实是一种，逃避"\r\n"状态拆分的方法，虽然看起来好像会不断分配内存……
-        // 而且，内存没有复用。
-        //
-        // /home/sarrow/Sources/avhttp/include/avhttp/impl/http_stream.ipp:2065
-        //
-        // template <typename Handler>
-        // void http_stream::handle_header(Handler handler,
-        //  std::string header_string, int bytes_transferred, const boost::system::error_code& err)
-        //
-        // 注意，函数接口中，header_string是值传递！
-        //
-        // 初始调用形如：
-        //
-        // // 异步读取所有Http header部分.
-        // boost::asio::async_read_until(m_sock, m_response, "\r\n",
-        //  boost::bind(&http_stream::handle_header<Handler>,
-        //      this, handler, std::string(""),
-        //      boost::asio::placeholders::bytes_transferred,
-        //      boost::asio::placeholders::error
-        //  )
-        // );
-
-        auto line = cast_string_view(m_response);
-        if (!line.is_begin_with(CRLF)) {
-            auto header_len = processHeaderOnce(m_response_headers, line);
-            m_response.consume(header_len);
-
-            boost::asio::async_read_until(
-                m_socket, m_response, "\r\n",
-                boost::bind(&proxy_tunnel_client::handle_read_header, this,
-                            boost::asio::placeholders::bytes_transferred,
-                            boost::asio::placeholders::error));
-            return;
-            // NOTE 如果header的单行，都会"爆栈"，那么说明有"攻击"行为。
-        }
-
-        m_response.consume(CRLF.size());
+        this->read_header();
+    }
 
+    void handle_header_done()
+    {
         COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_response_headers));
+        m_stats.header_done = ss1x::asio::request_stats::now();
 
         // processResponseSetCookie(m_response_headers);
 
@@ -1310,6 +1642,8 @@ private:
             // 但是没有提供Location(或者因为种种原因，未获取到该值)
             case 301:
             case 302:
+            case 307:
+            case 308:
                 {
                     const auto it = m_response_headers.find("Location");
                     if (it != m_response_headers.end()) {
@@ -1317,6 +1651,10 @@ private:
                             redirect = true;
                             auto newLocation = ss1x::util::url::full_of_copy(it->second, this->get_url());
                             COLOG_TRIGER_INFO(SSS_VALUE_MSG(newLocation));
+                            if (m_redirect_cache && !m_method.is(method_t::E_POST)) {
+                                m_redirect_cache->add(this->get_url(), newLocation,
+                                                      this->header().status_code);
+                            }
                             // this->m_redirect_urls.push_back(newLocation);
                             this->addRedirectUrl(newLocation);
                         }
@@ -1350,15 +1688,39 @@ private:
                 return;
             }
 
+            // NOTE 跳转响应的 body 没有读取，这个连接不能再复用了
+            m_socket->close();
+            discard(m_response);
+
             if (!m_proxy_hostname.empty()) {
                 ssl_tunnel_get_impl();
             }
             else {
                 http_get_impl();
             }
+            return;
+        }
+
+        if (m_onHeader && !m_onHeader(m_response_headers)) {
+            COLOG_TRIGER_INFO("response rejected by onHeader: ", this->header().status_code);
+            // NOTE body 没有读取，连接不能复用
+            m_socket->close();
+            set_error_code(boost::asio::error::operation_aborted);
+            return;
         }
 
         if (m_onContent) {
+            // 解码之后交给用户的字节，才计入 decoded_bytes，以及占用 credit
+            std::shared_ptr<ss1x::asio::content_flow> flow    = m_flow;
+            onResponce_t                              func    = m_onContent;
+            ss1x::asio::request_stats*                p_stats = &m_stats;
+            m_onDeliver = [flow, func, p_stats](sss::string_view sv) -> void {
+                p_stats->decoded_bytes += sv.size();
+                if (flow) {
+                    flow->consume(sv.size());
+                }
+                func(sv);
+            };
             if (m_response_headers.has("Content-Encoding")) {
                 const auto& content_encoding = m_response_headers.get("Content-Encoding");
                 if (content_encoding == "gzip") {
@@ -1383,107 +1745,121 @@ private:
             }
 
             if (m_stream) {
-                m_stream->set_on_avail_out(m_onContent);
+                m_stream->set_on_avail_out(m_onDeliver);
             }
         }
 
         COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_is_chunked));
 
         if (m_is_chunked) {
-            boost::asio::async_read_until(
-                m_socket, m_response, "\r\n",
-                boost::bind(&proxy_tunnel_client::handle_read_chunk_head, this,
-                            boost::asio::placeholders::bytes_transferred,
-                            boost::asio::placeholders::error));
+            m_content_to_read = 0;
+            m_chunked.reset();
+            this->read_chunked();
         }
         else {
-            COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_response.size()));
+            if (!this->has_response_body()) {
+                m_content_to_read = 0;
+            }
+            else if (!m_response_headers.has("Content-Length")) {
+                // NOTE 只能以对方关闭连接，作为 body 结束的标志
+                m_read_until_eof  = true;
+                m_content_to_read = std::numeric_limits<bytes_size_t>::max();
+            }
+            COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_response.size()), SSS_VALUE_MSG(m_content_to_read));
             // Write whatever content we already have to output.
-            if (m_response.size() > 0) {
+            if (m_response.size() > 0 && m_content_to_read > 0) {
                 consume_content(m_response);
             }
 
             if (!m_content_to_read) {
+                this->finish_response();
                 return;
             }
             // NOTE 如果正文过短的话，可能到这里，已经读完socket缓存了。
             // Start reading remaining data until EOF.
-            boost::asio::async_read(
-                m_socket, m_response, boost::asio::transfer_at_least(1),
-                boost::bind(&proxy_tunnel_client::handle_read_content, this,
-                            boost::asio::placeholders::bytes_transferred,
-                            boost::asio::placeholders::error));
+            this->read_body();
+        }
+    }
+
+    // NOTE body 的下一次读取；消费者要求暂停时，登记唤醒，暂不读取。
+    // 此时 m_response 中至多有一次读取的量，其余的留在内核里
+    void read_body()
+    {
+        if (m_flow && m_flow->blocked() &&
+            m_flow->wait(this, this->wrap(boost::bind(&proxy_tunnel_client::handle_flow_resume, this))))
+        {
+            COLOG_TRIGER_DEBUG("content flow paused:", SSS_VALUE_MSG(m_flow->outstanding()));
+            this->enterPhase(phase_paused);
+            return;
         }
+        void (proxy_tunnel_client::*handler)(int, const boost::system::error_code&) =
+            m_is_chunked ? &proxy_tunnel_client::handle_read_chunk
+                         : &proxy_tunnel_client::handle_read_content;
+        boost::asio::async_read(
+            *m_socket, m_response, boost::asio::transfer_at_least(1),
+            this->wrap(boost::bind(handler, this,
+                                   boost::asio::placeholders::bytes_transferred,
+                                   boost::asio::placeholders::error)));
     }
 
-    // NOTE chunk head pattern: '\x'+ '\s'* '\r\n'
-    void handle_read_chunk_head(int bytes_transferred, const boost::system::error_code& err)
+    void handle_flow_resume()
     {
         RET_ON_STOP;
-        COLOG_TRIGER_DEBUG(pretty_ec(err), bytes_transferred, "out of", m_response.size());
-        if (bytes_transferred <= 0) {
-            auto sv = cast_string_view(m_response);
-            COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(sv));
-            // NOTE hand-made eof mark
-            set_error_code(boost::asio::error::eof);
+        COLOG_TRIGER_DEBUG("content flow resumed");
+        this->enterPhase(phase_idle);
+        this->read_body();
+    }
+
+    // NOTE m_response 中已有的 chunk 数据，一次全部解码；数据不够时，才再读
+    void read_chunked()
+    {
+        const bool       deliver = m_onContent && s_is_status_code_ok(this->header().status_code);
+        sss::string_view sv      = cast_string_view(m_response);
+        size_t used = m_chunked.feed(sv.data(), sv.size(),
+                                     [this, deliver](const char* data, size_t size) -> void {
+                                         if (deliver) {
+                                             this->deliver_content(sss::string_view(data, size));
+                                         }
+                                     });
+        m_response.consume(used);
+        m_stats.body_bytes += used;
+        if (m_stoped) {
             return;
         }
 
-        int chunk_size = -1;
-        int offset     = -1;
-        sss::string_view sv = cast_string_view(m_response);
-        if (std::isxdigit(sv.front()))
-        {
-            int ec = std::sscanf(sv.data(), "%x%n", &chunk_size, &offset);
-            if (ec != 1) {
-                SSS_POSITION_THROW(std::runtime_error,
-                                   "parse x-digit-number error: ",
-                                   sss::raw_string(sv));
-            }
-            // NOTE 标准允许chunk_size的16进制字符后面，跟若干padding用的空格字符！
-            while (sv[offset] == ' ')
-            {
-                ++offset;
-            }
-            sv = sv.substr(offset);
-            if (!sv.is_begin_with(CRLF))
-            {
-                SSS_POSITION_THROW(std::runtime_error,
-                                   "unexpect none-crlf trailing bytes: ",
-                                   sss::raw_string(sv));
-            }
-            sv.remove_prefix(CRLF.size());
-            offset += CRLF.size();
+        if (m_chunked.error()) {
+            COLOG_TRIGER_ERROR("bad chunked encoding:", sss::raw_string(cast_string_view(m_response)));
+            set_error_code(ss1x::errc::invalid_chunked_encoding);
+            return;
         }
-        else
-        {
-            SSS_POSITION_THROW(std::runtime_error,
-                               "parse x-digit-number error: ",
-                               sss::raw_string(sv));
-        }
-
-        m_content_to_read = chunk_size + CRLF.size();
-        COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(chunk_size), " <- ", sss::raw_string(cast_string_view(m_response).substr(0, offset)));
-        m_response.consume(offset);
-        if (!chunk_size) {
-            consume_content(m_response, CRLF.size());
-            COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(chunk_size));
-            set_error_code(boost::asio::error::eof);
+        if (m_chunked.done()) {
+            // NOTE 结尾的 CRLF 已经收到，才算完整读完；此时连接可以复用
+            // chunked 正常结束时，一直以 eof 通知用户
+            this->finish_response(boost::asio::error::eof);
+            return;
+        }
+        if (m_has_eof) {
+            // NOTE 对方在 last-chunk 之前关闭了连接
+            set_error_code(ss1x::errc::incomplete_body);
             return;
         }
+        this->read_body();
+    }
 
+    void handle_read_chunk(int bytes_transferred, const boost::system::error_code& err)
+    {
+        RET_ON_STOP;
+        COLOG_TRIGER_DEBUG(pretty_ec(err), bytes_transferred, "out of", m_response.size(),
+                           SSS_VALUE_MSG(m_chunked.remain()));
         if (err) {
+            if (!is_eof_error(err)) {
+                set_error_code(err);
+                return;
+            }
             // NOTE boost::asio::error::eof 打印输出 asio.misc:2
-            m_has_eof = (err == boost::asio::error::eof);
-            set_error_code(err);
-            return;
+            m_has_eof = true;
         }
-
-        boost::asio::async_read(
-            m_socket, m_response, boost::asio::transfer_exactly(m_content_to_read),
-            boost::bind(&proxy_tunnel_client::handle_read_content, this,
-                        boost::asio::placeholders::bytes_transferred,
-                        boost::asio::placeholders::error));
+        this->read_chunked();
     }
 
     void http_post(const std::string& server, int port, const std::string& path,
@@ -1502,14 +1878,11 @@ private:
                               std::to_string(postParams.length()) + "\r\n\r\n";
         request_stream << postParams << "\r\n\r\n";
 
-        char port_buf[10];
-        std::sprintf(port_buf, "%d", port <= 0 ? 80 : port);
-
-        boost::asio::ip::tcp::resolver::query query(server, port_buf);
-        m_resolver.async_resolve(
-            query, boost::bind(&proxy_tunnel_client::handle_resolve, this,
-                               boost::asio::placeholders::error,
-                               boost::asio::placeholders::iterator));
+        m_dns->async_resolve(
+            m_io_service, server, port <= 0 ? 80 : port,
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_resolve, this,
+                                   boost::asio::placeholders::error,
+                                   boost::asio::placeholders::iterator)));
     }
 
     void handle_resolve(
@@ -1518,16 +1891,17 @@ private:
     {
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG(pretty_ec(err));
+        m_stats.dns_done = ss1x::asio::request_stats::now();
         if (err) {
             set_error_code(err);
             return;
         }
-        if (m_socket.using_ssl()) {
-            m_socket.get_ssl_socket().set_verify_mode(
+        if (m_socket->using_ssl()) {
+            m_socket->get_ssl_socket().set_verify_mode(
                 boost::asio::ssl::verify_peer);
 
 #if USE_509
-            m_socket.get_ssl_socket().set_verify_callback(boost::bind(
+            m_socket->get_ssl_socket().set_verify_callback(boost::bind(
                     &proxy_tunnel_client::verify_certificate, this, _1, _2));
             // TODO
             // if (is_certificate()) {
@@ -1561,8 +1935,8 @@ private:
             // NOTE this site use tls version 1.3!
 
             // http://stackoverflow.com/questions/35387482/security-consequences-due-to-setting-set-verify-modeboostasiosslverify-n
-            m_socket.get_ssl_socket().set_verify_mode(boost::asio::ssl::verify_none);
-            m_socket.get_ssl_socket().set_verify_callback(
+            m_socket->get_ssl_socket().set_verify_mode(boost::asio::ssl::verify_none);
+            m_socket->get_ssl_socket().set_verify_callback(
                 boost::asio::ssl::rfc2818_verification(host), ec);
 
             if (ec)
@@ -1573,10 +1947,21 @@ private:
 #endif
 
         }
-        boost::asio::async_connect(
-            m_socket.lowest_layer(), endpoint_iterator,
-            boost::bind(&proxy_tunnel_client::handle_connect, this,
-                        boost::asio::placeholders::error));
+        this->async_connect_endpoints(
+            m_socket->get_socket(), endpoint_iterator,
+            this->wrap(boost::bind(&proxy_tunnel_client::handle_connect, this,
+                                   boost::asio::placeholders::error)));
+    }
+
+    // NOTE 解析得到的多个地址，按 Happy Eyeballs 错开并行建链；超时或者
+    // 请求结束时，由 m_connecting 取消尚未完成的尝试
+    template <typename Handler>
+    void async_connect_endpoints(boost::asio::ip::tcp::socket& sock,
+                                 boost::asio::ip::tcp::resolver::iterator endpoint_iterator,
+                                 Handler&& handler)
+    {
+        m_connecting = ss1x::asio::happy_eyeballs::async_connect(
+            m_io_service, sock, endpoint_iterator, std::forward<Handler>(handler));
     }
 
     void verify_certificate(bool preverified,
@@ -1592,29 +1977,40 @@ private:
         // from the root certificate authority.
 
         // In this example we will simply print the certificate's subject name.
-        char subject_name[256];
-        X509* cert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
-        X509_NAME_oneline(X509_get_subject_name(cert), subject_name,
-                          sizeof(subject_name));
+        // NOTE 链上每一张证书都会调用一次；不输出日志时，就不必格式化 subject 了
+        if (detail::ss1x_asio_ptc_colog_status()) {
+            char subject_name[256];
+            X509* cert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
+            X509_NAME_oneline(X509_get_subject_name(cert), subject_name,
+                              sizeof(subject_name));
 
-        COLOG_TRIGER_DEBUG("Verifying ", subject_name);
+            COLOG_TRIGER_DEBUG("Verifying ", subject_name);
+        }
 
         // return preverified;
     }
 
     void handle_connect(const boost::system::error_code& err)
     {
+        m_connecting.reset();
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG(pretty_ec(err));
         if (err) {
             set_error_code(err);
             return;
         }
-        if (m_socket.using_ssl()) {
-            m_socket.get_ssl_socket().async_handshake(
+        m_stats.connected = ss1x::asio::request_stats::now();
+        if (m_socket->using_ssl()) {
+            this->enterPhase(phase_handshake);
+            if (!this->prepare_handshake()) {
+                set_error_code(boost::system::error_code(static_cast<int>(::ERR_get_error()),
+                                                         boost::asio::error::get_ssl_category()));
+                return;
+            }
+            m_socket->get_ssl_socket().async_handshake(
                 boost::asio::ssl::stream_base::client,
-                boost::bind(&proxy_tunnel_client::handle_handshake, this,
-                            boost::asio::placeholders::error));
+                this->wrap(boost::bind(&proxy_tunnel_client::handle_handshake, this,
+                                       boost::asio::placeholders::error)));
         }
         else {
             async_request();
@@ -1625,6 +2021,7 @@ private:
     {
         RET_ON_STOP;
         COLOG_TRIGER_DEBUG(pretty_ec(err));
+        this->finish_handshake(err);
         if (err) {
             set_error_code(err);
             return;
@@ -1649,39 +2046,42 @@ private:
             = std::min<bytes_size_t>(m_response.size(), m_content_to_read);
 
         // FIXME NOTE the ending CRLF!
-        if (m_onContent && s_is_status_code_ok(this->header().status_code)) { // 200
+        if (bytes_available <= 0) {
+            // NOTE nothing
+        }
+        else if (m_onContent && s_is_status_code_ok(this->header().status_code)) { // 200
             consume_content(m_response, bytes_available);
         }
         else {
             // NOTE this will discard data from 404 response
             discard(m_response, bytes_available);
+            m_stats.body_bytes += bytes_available;
         }
 
-        if (err && err != boost::asio::error::eof) {
+        if (err) {
+            if (!is_eof_error(err)) {
+                set_error_code(err);
+                return;
+            }
             // NOTE boost::asio::error::eof 打印输出 asio.misc:2
-            set_error_code(err);
+            m_has_eof = true;
+            if (m_read_until_eof) {
+                m_content_to_read = 0;
+            }
+            else if (m_content_to_read > 0) {
+                // NOTE 对方提前关闭了连接，body 不完整
+                set_error_code(boost::asio::error::eof);
+                return;
+            }
         }
 
         if (m_content_to_read > 0) {
-            boost::asio::async_read(
-                m_socket, m_response, boost::asio::transfer_at_least(1),
-                boost::bind(&proxy_tunnel_client::handle_read_content, this,
-                            boost::asio::placeholders::bytes_transferred,
-                            boost::asio::placeholders::error));
-            return;
-        }
-
-        if (m_is_chunked) {
-            boost::asio::async_read_until(
-                m_socket, m_response, "\r\n",
-                boost::bind(&proxy_tunnel_client::handle_read_chunk_head, this,
-                            boost::asio::placeholders::bytes_transferred,
-                            boost::asio::placeholders::error));
+            this->read_body();
             return;
         }
 
         // NOTE here means noting to do
-        set_error_code(boost::system::error_code{});
+        this->finish_response();
 
         // NOTE
         // async_read_until()，在当前buffer大小范围，如果都没有读取到终止标记串，
@@ -1754,46 +2154,324 @@ private:
     // }
 
 protected:
+    // NOTE 每次建链(包括跳转、重连)之前调用；整个请求的期限，只在第一次设置
     void startTimer()
     {
-        // NOTE 这里，用一个全局函数来修改默认值。
-        COLOG_TRIGER_INFO(SSS_VALUE_MSG(detail::ss1x_asio_ptc_deadline_wait_secends()));
-        // m_deadline.expires_from_now(boost::posix_time::seconds(detail::ss1x_asio_ptc_deadline_wait_secends()));
-        m_deadline.expires_from_now(boost::posix_time::seconds(5));
-
-        m_deadline.async_wait(boost::bind(&proxy_tunnel_client::check_deadline,
-                                          this,
-                                          boost::asio::placeholders::error));
+        if (!m_total_timer && m_timeouts.total.count() > 0) {
+            m_total_timer = m_wheel.schedule(
+                m_timeouts.total,
+                this->wrap(boost::bind(&proxy_tunnel_client::check_deadline, this, uint64_t(0))));
+        }
+        this->enterPhase(phase_connect);
     }
 
+    // idle 阶段，顺延期限
     void resetTimer()
     {
-        m_deadline.cancel();
-        this->startTimer();
+        if (m_phase == phase_idle && m_timeouts.idle.count() > 0) {
+            m_phase_deadline = clock_type::now() + m_timeouts.idle;
+        }
+    }
+
+    std::chrono::milliseconds phaseTimeout(phase_t phase) const
+    {
+        switch (phase) {
+            case phase_connect:    return m_timeouts.connect;
+            case phase_handshake:  return m_timeouts.handshake;
+            case phase_first_byte: return m_timeouts.first_byte;
+            case phase_idle:       return m_timeouts.idle;
+            default:               return std::chrono::milliseconds(0);
+        }
+    }
+
+    // NOTE 新期限不早于已登记的触发时刻时，不动时间轮；届时 check_deadline()
+    // 再按 m_phase_deadline 补上剩余的时间
+    void enterPhase(phase_t phase)
+    {
+        m_phase = phase;
+        const auto limit = this->phaseTimeout(phase);
+        if (limit.count() <= 0) {
+            m_phase_deadline = clock_type::time_point::max();
+            return;
+        }
+        m_phase_deadline = clock_type::now() + limit;
+        if (!m_phase_timer || m_phase_expires > m_phase_deadline) {
+            this->armPhaseTimer(m_phase_deadline);
+        }
+    }
+
+    void armPhaseTimer(clock_type::time_point expires)
+    {
+        if (m_phase_timer) {
+            m_wheel.cancel(m_phase_timer);
+        }
+        m_phase_expires = expires;
+        m_phase_timer   = m_wheel.schedule(
+            expires,
+            this->wrap(boost::bind(&proxy_tunnel_client::check_deadline, this, ++m_timer_gen)));
+    }
+
+    void cancelConnecting()
+    {
+        if (m_connecting) {
+            m_connecting->cancel();
+            m_connecting.reset();
+        }
+    }
+
+    void cancelTimers()
+    {
+        if (m_phase_timer) {
+            m_wheel.cancel(m_phase_timer);
+            m_phase_timer = 0;
+        }
+        if (m_total_timer) {
+            m_wheel.cancel(m_total_timer);
+            m_total_timer = 0;
+        }
+        m_phase = phase_none;
     }
 
     void initUrl(const std::string& url)
     {
+        m_stats       = ss1x::asio::request_stats();
+        m_stats.start = ss1x::asio::request_stats::now();
         m_redirect_urls.resize(0);
+        m_memo_redirects = 0;
+        // NOTE 记住过的跳转，直接请求最终的地址；省下中间各级的建链与往返。
+        // 跳过的各级仍计入 m_stats.redirects：调用者(比如 http_cache)据此知道
+        // 响应并非来自 url 本身；超出 max_redirect 的记录不用
+        std::string target;
+        unsigned    hops = 0;
+        if (m_redirect_cache && !m_method.is(method_t::E_POST)) {
+            target = m_redirect_cache->resolve(url, &hops);
+        }
+        if (!target.empty() && hops <= m_max_redirect) {
+            COLOG_TRIGER_INFO("memoized redirect: ", url, " -> ", target, ' ', SSS_VALUE_MSG(hops));
+            m_memo_redirects = hops;
+            this->addRedirectUrl(target);
+            return;
+        }
         this->addRedirectUrl(url);
     }
 
     void addRedirectUrl(const std::string& url)
     {
         m_redirect_urls.push_back(url);
+        m_stats.redirects = m_memo_redirects + unsigned(m_redirect_urls.size() - 1);
         m_url_info = ss1x::util::url::split_port_auto(url);
         COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(m_url_info));
     }
 
+    // NOTE 每次建链(包括跳转、重连)之前调用；累计的计数不动
+    void resetAttemptStats()
+    {
+        const ss1x::asio::request_stats::time_point none;
+        m_stats.dns_start    = none;
+        m_stats.dns_done     = none;
+        m_stats.connected    = none;
+        m_stats.tunnel_done  = none;
+        m_stats.tls_done     = none;
+        m_stats.request_sent = none;
+        m_stats.first_byte   = none;
+        m_stats.header_done  = none;
+        m_stats.body_bytes        = 0;
+        m_stats.decoded_bytes     = 0;
+        m_stats.connection_reused = false;
+        m_stats.tls_resumed       = false;
+    }
+
     void set_error_code(const boost::system::error_code& ec) {
         this->m_ec = ec;
-        this->m_deadline.cancel();
         this->m_stoped = true;
+        this->cancelTimers();
+        this->cancelConnecting();
+        if (m_flow) {
+            m_flow->cancel_wait(this);
+        }
+        if (m_cancel) {
+            m_cancel->detach(this);
+        }
+        if (m_stats.finish == ss1x::asio::request_stats::time_point()) {
+            m_stats.finish = ss1x::asio::request_stats::now();
+            ss1x::asio::record_request_metrics(m_stats, ec, m_response_headers.status_code);
+            if (m_onStats) {
+                m_onStats(m_stats);
+            }
+        }
         if (m_onFinished) {
             COLOG_DEBUG(ec);
             m_onFinished();
         }
     }
+    bool has_response_body() const
+    {
+        const unsigned int status_code = m_response_headers.status_code;
+        return !m_method.is(method_t::E_HEAD) && status_code / 100 != 1 &&
+               status_code != 204 && status_code != 304;
+    }
+
+    static bool is_eof_error(const boost::system::error_code& err)
+    {
+        // NOTE 不少https服务器，关闭连接前不发送 close_notify，此时得到的是 stream_truncated
+        return err == boost::asio::error::eof ||
+               err == boost::asio::ssl::error::stream_truncated;
+    }
+
+    static bool has_token(const ss1x::http::Headers& headers, const std::string& key, sss::string_view token)
+    {
+        const std::string value = headers.get(key);
+        auto it = std::search(value.begin(), value.end(), token.begin(), token.end(),
+                              [](char l, char r) -> bool {
+                                  return std::tolower(l) == std::tolower(r);
+                              });
+        return it != value.end();
+    }
+
+    ss1x::asio::connection_pool::key_type pool_key() const
+    {
+        ss1x::asio::connection_pool::key_type key;
+        key.scheme = std::get<0>(m_url_info);
+        key.host   = std::get<1>(m_url_info);
+        key.port   = std::get<2>(m_url_info);
+        if (!m_proxy_hostname.empty()) {
+            key.proxy = m_proxy_hostname + ':' + std::to_string(m_proxy_port);
+        }
+        return key;
+    }
+
+    bool reuse_pooled_connection()
+    {
+        m_connection_reused = false;
+        if (!m_pool || m_bypass_pool) {
+            m_bypass_pool = false;
+            return false;
+        }
+        auto sock = m_pool->acquire(this->pool_key());
+        if (!sock) {
+            return false;
+        }
+        COLOG_TRIGER_DEBUG("reuse connection to ", sss::raw_string(std::get<1>(m_url_info)), ':', std::get<2>(m_url_info));
+        m_socket = std::move(sock);
+        m_connection_reused = true;
+        m_stats.connection_reused = true;
+        return true;
+    }
+
+    // 异步操作的回调，都要经过这里：串行化到 m_strand 上，并持有 m_handler_token
+    template <typename Handler>
+    auto wrap(Handler&& handler)
+        -> decltype(std::declval<boost::asio::io_service::strand&>().wrap(
+            std::declval<::detail::ss1x_asio_ptc_handler_t<typename std::decay<Handler>::type>>()))
+    {
+        ::detail::ss1x_asio_ptc_handler_t<typename std::decay<Handler>::type> h{
+            std::forward<Handler>(handler), m_handler_token};
+        return m_strand.wrap(std::move(h));
+    }
+
+    ss1x::asio::tls_session_cache* tls_sessions()
+    {
+        return ss1x::asio::tls_session_cache::from(
+            ::SSL_get_SSL_CTX(m_socket->get_ssl_socket().native_handle()));
+    }
+
+    // NOTE 握手之前：设置 SNI；context 上挂接了 session 缓存的话，顺便提供该
+    // host:port 上次的 session，以便服务端接受时，走简化握手。
+    bool prepare_handshake()
+    {
+        SSL* ssl = m_socket->get_ssl_socket().native_handle();
+        const std::string& host = std::get<1>(m_url_info);
+        if (auto* cache = this->tls_sessions()) {
+            return cache->prepare(ssl, host, std::get<2>(m_url_info));
+        }
+        return ::SSL_set_tlsext_host_name(ssl, host.c_str());
+    }
+
+    void finish_handshake(const boost::system::error_code& err)
+    {
+        if (!err) {
+            m_stats.tls_done    = ss1x::asio::request_stats::now();
+            m_stats.tls_resumed = ::SSL_session_reused(m_socket->get_ssl_socket().native_handle());
+        }
+        auto* cache = this->tls_sessions();
+        if (!cache) {
+            return;
+        }
+        if (err) {
+            // 可能正是缓存的 session 出了问题；下次从完整握手开始
+            cache->remove(std::get<1>(m_url_info), std::get<2>(m_url_info));
+            return;
+        }
+        cache->on_handshake(m_socket->get_ssl_socket().native_handle());
+        COLOG_TRIGER_DEBUG(SSS_VALUE_MSG(::SSL_session_reused(m_socket->get_ssl_socket().native_handle())));
+    }
+
+    // NOTE 每次新建连接，都要用新的socket；ssl::stream 不能跨tcp连接复用
+    void renew_socket()
+    {
+        m_socket.reset(new ss1x::detail::socket_t(m_io_service));
+        if (m_p_ctx) {
+            m_socket->upgrade_to_ssl(*m_p_ctx);
+        }
+    }
+
+    bool is_connection_reusable() const
+    {
+        if (!m_pool || m_read_until_eof || m_content_to_read || m_response.size()) {
+            return false;
+        }
+        if (m_response_headers.http_version != "1.1") {
+            return false;
+        }
+        if (has_token(m_response_headers, "Connection", "close") ||
+            has_token(m_response_headers, "Proxy-Connection", "close") ||
+            has_token(m_request_headers, "Connection", "close"))
+        {
+            return false;
+        }
+        return m_socket->get_socket().is_open();
+    }
+
+    void release_connection()
+    {
+        if (!this->is_connection_reusable()) {
+            return;
+        }
+        m_pool->release(this->pool_key(), std::move(m_socket));
+        this->renew_socket();
+    }
+
+    void finish_response(const boost::system::error_code& ec = boost::system::error_code{})
+    {
+        this->release_connection();
+        this->set_error_code(ec);
+    }
+
+    // NOTE 池中的连接，可能在发送请求的同时，被服务端关闭；此时换新连接重试一次
+    bool retry_stale_connection(const boost::system::error_code& err)
+    {
+        if (!m_connection_reused) {
+            return false;
+        }
+        if (!is_eof_error(err) && err != boost::asio::error::connection_reset &&
+            err != boost::asio::error::broken_pipe)
+        {
+            return false;
+        }
+        COLOG_TRIGER_INFO("reused connection closed by peer, reconnect: ", pretty_ec(err));
+        m_connection_reused = false;
+        m_bypass_pool       = true;
+        m_socket->close();
+        discard(m_response);
+        if (!m_proxy_hostname.empty()) {
+            ssl_tunnel_get_impl();
+        }
+        else {
+            http_get_impl();
+        }
+        return true;
+    }
+
     void discard(boost::asio::streambuf& response, int bytes_transferred = 0)
     {
         if (bytes_transferred > 0) {
@@ -1807,13 +2485,29 @@ protected:
         }
     }
 
-    //
+    // 解码(如果有 Content-Encoding)之后，交给 m_onContent
+    void deliver_content(sss::string_view sv)
+    {
+        if (sv.empty()) {
+            return;
+        }
+        if (m_stream) {
+            boost::system::error_code ec;
+            int covert_cnt = m_stream->inflate(sv, &ec);
+            if (ec && ec.value() != Z_BUF_ERROR && covert_cnt <= 0) {
+                COLOG_TRIGER_ERROR(SSS_VALUE_MSG(ec));
+                SSS_POSITION_THROW(std::runtime_error, "inflate error!");
+                set_error_code(ec);
+            }
+        }
+        else {
+            m_onDeliver(sv);
+        }
+    }
+
+    // NOTE 非 chunked 的 body；chunked 的由 read_chunked() 处理
     void consume_content(boost::asio::streambuf& response, int bytes_transferred = 0)
     {
-        // NOTE m_content_to_read 包括了结尾的"\r\n"!
-        // 如果 bytes_transferred 正好等于 m_content_to_read，说明，这次刚好读到chunk结束
-        // 如果小于m_content_to_read，则都说明，还有数据。
-        // 并且，最后两个字节，需要忽略！
         auto old_to_read = m_content_to_read;
 
         std::size_t size = response.size();
@@ -1826,49 +2520,19 @@ protected:
             bytes_transferred = std::min<size_t>(bytes_transferred, size);
         }
 
-        bytes_transferred = std::min<size_t>(m_content_to_read, bytes_transferred);
+        bytes_transferred = std::min<bytes_size_t>(m_content_to_read, bytes_transferred);
 
+        sss::string_view sv = cast_string_view(response).substr(0, bytes_transferred);
+        m_stats.body_bytes += bytes_transferred;
         if (m_onContent) {
-            sss::string_view sv = cast_string_view(response).substr(0, bytes_transferred);
-            if (m_is_chunked) {
-                if (m_content_to_read >= bytes_transferred + bytes_size_t(CRLF.size()))
-                {
-                    // NOTE nothing
-                }
-                else if (m_content_to_read == bytes_transferred + 1)
-                {
-                    sv.remove_suffix(1);
-                }
-                else if (m_content_to_read == bytes_transferred + 0)
-                {
-                    sv.remove_suffix(2);
-                }
-                else if (m_content_to_read < bytes_transferred)
-                {
-                    SSS_POSITION_THROW(
-                        std::runtime_error,
-                        "to many bytes_transferred");
-                }
-            }
-
-            assert(m_content_to_read >= bytes_transferred);
-            m_content_to_read -= bytes_transferred;
+            this->deliver_content(sv);
+        }
 
-            if (sv.size())
-            {
-                if (m_stream) {
-                    boost::system::error_code ec;
-                    int covert_cnt = m_stream->inflate(sv, &ec);
-                    if (ec && ec.value() != Z_BUF_ERROR && covert_cnt <= 0) {
-                        COLOG_TRIGER_ERROR(SSS_VALUE_MSG(ec));
-                        SSS_POSITION_THROW(std::runtime_error, "inflate error!");
-                        set_error_code(ec);
-                    }
-                }
-                else {
-                    m_onContent(sv);
-                }
-            }
+        assert(m_content_to_read >= bytes_transferred);
+        m_content_to_read -= bytes_transferred;
+        if (m_read_until_eof && this->is_body_end(sv)) {
+            COLOG_TRIGER_DEBUG("end marker found");
+            m_content_to_read = 0;
         }
 
         response.consume(bytes_transferred);
@@ -1879,29 +2543,48 @@ protected:
         }
     }
 
-    bool is_end_chunk(const boost::asio::streambuf& buf) const
+    // NOTE 只检查新收到的 body 字节；标记跨越两次读取，由 m_end_matcher 处理
+    bool is_body_end(sss::string_view sv)
     {
-        if (!m_onEndCheck) {
-            return false;
+        if (m_end_matcher.feed(sv)) {
+            return true;
         }
-        sss::string_view sv = cast_string_view(buf);
-        // return sv.find("</html>") != sss::string_view::npos;
-        return m_onEndCheck(sv);
+        return m_onEndCheck && m_onEndCheck(sv);
     }
 
 private:
-    boost::asio::ip::tcp::resolver m_resolver;
-    ss1x::detail::socket_t         m_socket;
+    boost::asio::io_service&       m_io_service;
+    // NOTE 本连接的所有回调，都经由 m_strand 串行执行；于是 io_service 可以由多个线程驱动
+    boost::asio::io_service::strand m_strand;
+    std::shared_ptr<void>          m_handler_token;
+    boost::asio::ssl::context*     m_p_ctx;
+    ss1x::asio::dns_cache*         m_dns;
+    ss1x::asio::redirect_cache*    m_redirect_cache;
+    // initUrl() 时，由 m_redirect_cache 直接跳过的级数
+    unsigned                       m_memo_redirects;
+    std::unique_ptr<ss1x::detail::socket_t> m_socket;
+    ss1x::asio::connection_pool*   m_pool;
+    // 当前连接，是否取自连接池
+    bool                           m_connection_reused;
+    // 复用的连接失效后重试时，跳过连接池
+    bool                           m_bypass_pool;
     // NOTE the other endpoint close the socket
     // the response stream may still has byte to read
     bool                           m_has_eof;
     //! https://en.wikipedia.org/wiki/Chunked_transfer_encoding
     //! http://blog.csdn.net/whatday/article/details/7571451
     bool                           m_is_chunked;
+    // 既没有 Content-Length，也不是 chunked；只能读到对方关闭连接为止
+    bool                           m_read_until_eof;
     ss1x::asio::resource_type      m_expect_res_type;
 
-    // NOTE this means also chunked body size when `m_is_chunked == true`
+    // NOTE 非 chunked 时，尚未读取的 body 长度；chunked 时为0
     bytes_size_t                   m_content_to_read;
+    ss1x::detail::chunked_decoder  m_chunked;
+    // 增量解析 header 时，m_response 中已确认不含 '\n' 的前缀长度
+    size_t                         m_header_scanned;
+    // 当前响应已解析的 header 总长度
+    size_t                         m_header_bytes;
     // 最大跳转次数
     // 0 表示，不允许跳转；
     // 1 表示可以跳转一次；以此类推
@@ -1910,10 +2593,25 @@ private:
     bool                           m_stoped;
     std::unique_ptr<ss1x::stream>  m_stream;
 
+    // NOTE 只用于 CONNECT；普通请求写入 m_request_data
     boost::asio::streambuf         m_request;
+    std::string                    m_request_data;
     boost::asio::streambuf         m_response;
 
-    boost::asio::deadline_timer    m_deadline;
+    // NOTE 超时由 io_service 上共用的时间轮驱动；每个 client 至多登记两个定时器：
+    // 当前阶段的，以及整个请求的
+    ss1x::asio::timer_wheel&       m_wheel;
+    ss1x::asio::request_timeouts   m_timeouts;
+    phase_t                        m_phase;
+    // 当前阶段的期限；idle 阶段，随收到的数据后移
+    clock_type::time_point         m_phase_deadline;
+    // m_phase_timer 在时间轮上的触发时刻；可能早于 m_phase_deadline
+    clock_type::time_point         m_phase_expires;
+    ss1x::asio::timer_wheel::timer_id m_phase_timer;
+    ss1x::asio::timer_wheel::timer_id m_total_timer;
+    uint64_t                       m_timer_gen;
+    // 正在进行的并行建链
+    std::shared_ptr<ss1x::asio::happy_eyeballs> m_connecting;
 
     // 不过，对于header()函数来说，用户一般只关心response的header。
     ss1x::http::Headers            m_response_headers;
@@ -1926,9 +2624,22 @@ private:
 
     method_t                       m_method;
     std::string                    m_post_content;
+    // 非空时，POST 的 body 从中读取，m_post_content 不用
+    std::shared_ptr<ss1x::asio::body_source> m_body_source;
+    bool                           m_body_chunked;
+    uint64_t                       m_body_sent;
+    std::string                    m_chunk_head;
     onFinished_t                   m_onFinished;
     onResponce_t                   m_onContent;
+    // 实际交给解码器/用户的回调；有 m_flow 时，包装了 credit 的计数
+    onResponce_t                   m_onDeliver;
+    std::shared_ptr<ss1x::asio::content_flow> m_flow;
+    std::shared_ptr<ss1x::asio::request_cancel> m_cancel;
     onEndCheck_t                   m_onEndCheck;
+    ss1x::detail::end_matcher      m_end_matcher;
+    onHeader_t                     m_onHeader;
     CookieFunc_t                   m_onRequestCookie; // Cookie: ...
+    ss1x::asio::request_stats      m_stats;
+    ss1x::asio::onStats_t          m_onStats;
     SetCookieFunc_t                m_onResponseSetCookie; // Set-Cookie: ...
 };
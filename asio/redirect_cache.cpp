@@ -0,0 +1,164 @@
+// ss1x/asio/redirect_cache.cpp
+#include "redirect_cache.hpp"
+
+#include <vector>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+redirect_cache::redirect_cache(size_t max_entries)
+    : m_max_entries(max_entries ? max_entries : 1),
+      m_temporary_ttl(0),
+      m_hits(0),
+      m_misses(0),
+      m_stores(0)
+{
+}
+
+redirect_cache& redirect_cache::instance()
+{
+    static redirect_cache cache;
+    return cache;
+}
+
+std::string redirect_cache::make_key(const std::string& url)
+{
+    return url.substr(0, url.find('#'));
+}
+
+void redirect_cache::erase_locked(entry_map_t::iterator it)
+{
+    m_lru.erase(it->second.pos);
+    m_entries.erase(it);
+}
+
+void redirect_cache::add(const std::string& from, const std::string& to, unsigned status)
+{
+    bool permanent = false;
+    switch (status) {
+        case 301:
+        case 308:
+            permanent = true;
+            break;
+
+        case 302:
+        case 307:
+            break;
+
+        default:
+            return;
+    }
+
+    std::string key    = make_key(from);
+    std::string target = make_key(to);
+    if (key.empty() || target.empty() || key == target) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!permanent && m_temporary_ttl.count() <= 0) {
+        // NOTE 临时跳转换了新的去向；旧的(无论永久与否)都不再可信
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            this->erase_locked(it);
+        }
+        return;
+    }
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        while (m_entries.size() >= m_max_entries) {
+            this->erase_locked(m_entries.find(m_lru.back()));
+        }
+        m_lru.push_front(key);
+        it = m_entries.emplace(key, entry_t()).first;
+        it->second.pos = m_lru.begin();
+    }
+    else {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.pos);
+    }
+    it->second.to        = target;
+    it->second.permanent = permanent;
+    it->second.expires   = permanent ? clock_type::time_point::max()
+                                     : clock_type::now() + m_temporary_ttl;
+    ++m_stores;
+    COLOG_DEBUG(key, " -> ", target, SSS_VALUE_MSG(status));
+}
+
+std::string redirect_cache::resolve(const std::string& url, unsigned* hops)
+{
+    std::string              current = make_key(url);
+    std::vector<std::string> visited;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const auto now = clock_type::now();
+        for (unsigned hop = 0; hop < max_hops; ++hop) {
+            auto it = m_entries.find(current);
+            if (it == m_entries.end()) {
+                break;
+            }
+            if (it->second.expires <= now) {
+                this->erase_locked(it);
+                break;
+            }
+            m_lru.splice(m_lru.begin(), m_lru, it->second.pos);
+            visited.push_back(current);
+            current = it->second.to;
+            bool loop = false;
+            for (const std::string& v : visited) {
+                loop = loop || v == current;
+            }
+            if (loop) {
+                // NOTE 服务端的跳转成了环；交给网络请求去报告 exceed_max_redirect
+                visited.clear();
+                break;
+            }
+        }
+    }
+    if (visited.empty()) {
+        ++m_misses;
+        return std::string();
+    }
+    ++m_hits;
+    if (hops) {
+        *hops = unsigned(visited.size());
+    }
+    return current;
+}
+
+void redirect_cache::erase(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_entries.find(make_key(url));
+    if (it != m_entries.end()) {
+        this->erase_locked(it);
+    }
+}
+
+void redirect_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_entries.clear();
+    m_lru.clear();
+}
+
+size_t redirect_cache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_entries.size();
+}
+
+redirect_cache::stats_t redirect_cache::stats() const
+{
+    stats_t ret;
+    ret.hits   = m_hits;
+    ret.misses = m_misses;
+    ret.stores = m_stores;
+    return ret;
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,97 @@
+// ss1x/asio/redirect_cache.hpp
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ss1x {
+namespace asio {
+
+// NOTE 跳转记录；session 各有一个，见 session::redirects()
+//
+// 站点常见 http -> https -> www 之类的多级跳转；每一级都是一次额外的解析、建链
+// 与往返。这里记录 "源 url -> Location"：
+//
+// 1. 301、308 是永久跳转，一直有效；按 LRU 淘汰，最多 max_entries() 条；
+// 2. 302、307 是临时跳转；temporary_ttl() 大于0 时，缓存这么多秒；默认不缓存；
+// 3. 303 以及 POST 的跳转，不记录。
+//
+// 之后对同一个源 url 的 GET/HEAD，resolve() 沿着记录走到最终的地址，直接请求它。
+// 各个成员函数都是线程安全的。
+class redirect_cache
+{
+public:
+    typedef std::chrono::steady_clock clock_type;
+
+    struct stats_t
+    {
+        uint64_t hits;    // resolve() 得到了新地址
+        uint64_t misses;
+        uint64_t stores;
+    };
+
+    static const size_t   default_max_entries = 1024;
+    // resolve() 最多走这么多级；也用来断开 a -> b -> a 之类的循环
+    static const unsigned max_hops            = 8;
+
+    explicit redirect_cache(size_t max_entries = default_max_entries);
+
+    redirect_cache(const redirect_cache&) = delete;
+    redirect_cache& operator=(const redirect_cache&) = delete;
+
+    static redirect_cache& instance();
+
+public:
+    // status 为跳转响应的状态码；不需要记录的，直接忽略
+    void        add(const std::string& from, const std::string& to, unsigned status);
+
+    // 有记录时，返回最终的地址，hops 非空时写入走过的级数；否则返回空串
+    std::string resolve(const std::string& url, unsigned* hops = nullptr);
+
+    void        erase(const std::string& url);
+    void        clear();
+    size_t      size() const;
+
+    stats_t     stats() const;
+
+    size_t      max_entries() const         { return m_max_entries;                      }
+    void        max_entries(size_t max)     { m_max_entries = max ? max : 1;             }
+    int         temporary_ttl() const       { return int(m_temporary_ttl.count());       }
+    void        temporary_ttl(int seconds)  { m_temporary_ttl = std::chrono::seconds(seconds); }
+
+private:
+    typedef std::list<std::string> lru_t;
+
+    struct entry_t
+    {
+        std::string            to;
+        bool                   permanent;
+        clock_type::time_point expires;
+        lru_t::iterator        pos;
+    };
+    typedef std::unordered_map<std::string, entry_t> entry_map_t;
+
+    // 去掉 #fragment；它不会发送给服务端
+    static std::string make_key(const std::string& url);
+
+    void erase_locked(entry_map_t::iterator it);
+
+    mutable std::mutex    m_lock;
+    entry_map_t           m_entries;
+    // 最近使用的在前
+    lru_t                 m_lru;
+    size_t                m_max_entries;
+    std::chrono::seconds  m_temporary_ttl;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_stores;
+};
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,90 @@
+// ss1x/asio/request_cancel.hpp
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 取消一组请求；经 request_options::cancel 由多个请求共用
+ *
+ * cancel() 之后，尚未结束的请求关闭连接，以 operation_aborted 结束；之后才
+ * 发起的请求，一开始就以 operation_aborted 结束。
+ *
+ * 各个成员函数都是线程安全的；cancel() 可以在任意线程(包括请求自己的回调中)
+ * 调用。
+ */
+class request_cancel
+{
+public:
+    typedef std::function<void()> handler_t;
+
+    request_cancel() : m_cancelled(false) {}
+
+    request_cancel(const request_cancel&) = delete;
+    request_cancel& operator=(const request_cancel&) = delete;
+
+    void cancel()
+    {
+        handlers_t handlers;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_cancelled = true;
+            handlers.swap(m_handlers);
+        }
+        // NOTE 在锁外调用；handler 中会 detach()
+        for (auto& item : handlers) {
+            item.second();
+        }
+    }
+
+    bool cancelled() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_cancelled;
+    }
+
+public:
+    // NOTE 以下由 client 调用
+
+    // 为 owner 登记 handler；已经取消时，不登记，直接调用 handler
+    void attach(const void* owner, handler_t&& handler)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_cancelled) {
+                m_handlers.emplace_back(owner, std::move(handler));
+                return;
+            }
+        }
+        handler();
+    }
+
+    // owner 的请求已结束；其 handler 持有的资源，随之释放
+    void detach(const void* owner)
+    {
+        handler_t handler;
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto it = m_handlers.begin(); it != m_handlers.end(); ++it) {
+            if (it->first == owner) {
+                handler.swap(it->second);
+                m_handlers.erase(it);
+                break;
+            }
+        }
+    }
+
+private:
+    typedef std::vector<std::pair<const void*, handler_t>> handlers_t;
+
+    mutable std::mutex m_lock;
+    bool               m_cancelled;
+    handlers_t         m_handlers;
+};
+
+} // namespace asio
+} // namespace ss1x
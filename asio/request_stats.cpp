@@ -0,0 +1,37 @@
+// ss1x/asio/request_stats.cpp
+#include "request_stats.hpp"
+
+#include <ostream>
+
+namespace ss1x {
+namespace asio {
+
+void request_stats::print(std::ostream& o) const
+{
+    o << "{total: " << this->total().count() << "us"
+      << ", dns: " << this->dns().count() << "us"
+      << ", connect: " << this->connect().count() << "us";
+    if (tunnel_done != time_point()) {
+        o << ", tunnel: " << this->tunnel().count() << "us";
+    }
+    o << ", tls: " << this->tls().count() << "us"
+      << ", wait: " << this->wait().count() << "us"
+      << ", transfer: " << this->transfer().count() << "us"
+      << ", sent: " << request_bytes
+      << ", header: " << header_bytes
+      << ", body: " << body_bytes
+      << ", decoded: " << decoded_bytes
+      << ", redirects: " << redirects
+      << ", reused: " << connection_reused
+      << ", resumed: " << tls_resumed
+      << '}';
+}
+
+std::ostream& operator<<(std::ostream& o, const request_stats& stats)
+{
+    stats.print(o);
+    return o;
+}
+
+} // namespace asio
+} // namespace ss1x
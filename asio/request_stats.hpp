@@ -0,0 +1,83 @@
+// ss1x/asio/request_stats.hpp
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 单个请求的各阶段耗时，以及收发的字节数
+ *
+ * 时间点都取自 steady_clock；没有经历的阶段(比如复用连接时的 dns/connect，
+ * 明文 http 的 tls)，保持为默认值 time_point{}，对应的时长为0。
+ * 有跳转(或复用的连接失效而重连)时，start 为第一次请求的开始；各阶段的时间点
+ * 与 body 字节数，是最后一次请求的；request_bytes、header_bytes 则累计所有请求。
+ */
+struct request_stats
+{
+    typedef std::chrono::steady_clock   clock_type;
+    typedef clock_type::time_point      time_point;
+    typedef std::chrono::microseconds   duration;
+
+    request_stats()
+        : request_bytes(0),
+          header_bytes(0),
+          body_bytes(0),
+          decoded_bytes(0),
+          redirects(0),
+          connection_reused(false),
+          tls_resumed(false)
+    {}
+
+    time_point start;        // 发起请求
+    time_point dns_start;    // 开始域名解析(有代理时，解析的是代理)
+    time_point dns_done;
+    time_point connected;    // tcp 建链完成
+    time_point tunnel_done;  // 经由代理时，CONNECT 得到应答
+    time_point tls_done;     // tls 握手完成
+    time_point request_sent; // 请求(包括 POST 的 body)发送完毕
+    time_point first_byte;   // 收到响应的第一批字节
+    time_point header_done;  // 响应 header 解析完毕
+    time_point finish;       // 请求结束(成功或失败)
+
+    uint64_t   request_bytes; // 发送的请求头 + body
+    uint64_t   header_bytes;  // 收到的状态行 + header
+    uint64_t   body_bytes;    // 收到的 body(包括 chunk 的分隔)
+    uint64_t   decoded_bytes; // 解压之后，交给 onContent 的字节数
+    unsigned   redirects;
+    bool       connection_reused;
+    bool       tls_resumed;
+
+    static time_point now() { return clock_type::now(); }
+
+    // from 与 to 都经历过时，才有时长
+    static duration span(time_point from, time_point to)
+    {
+        if (from == time_point() || to == time_point() || to < from) {
+            return duration(0);
+        }
+        return std::chrono::duration_cast<duration>(to - from);
+    }
+
+    duration dns() const      { return span(dns_start, dns_done);                          }
+    duration connect() const  { return span(dns_done, connected);                          }
+    duration tunnel() const   { return span(connected, tunnel_done);                       }
+    duration tls() const      { return span(tunnel_done == time_point() ? connected : tunnel_done, tls_done); }
+    // 请求发出，到收到响应的第一批字节
+    duration wait() const     { return span(request_sent, first_byte);                     }
+    duration transfer() const { return span(header_done, finish);                          }
+    duration total() const    { return span(start, finish);                                }
+
+    void print(std::ostream& o) const;
+};
+
+std::ostream& operator<<(std::ostream& o, const request_stats& stats);
+
+typedef std::function<void(const request_stats& stats)> onStats_t;
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,179 @@
+// ss1x/asio/request_writer.hpp
+#pragma once
+
+#include <sss/string_view.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ss1x/asio/headers.hpp>
+
+namespace ss1x {
+namespace detail {
+
+/**
+ * @brief 不经过 iostream 的请求序列化；直接追加到调用者的 std::string
+ *
+ * 该 string 由调用者预留容量、clear() 之后复用；于是稳定之后，序列化不再分配内存。
+ */
+class request_writer
+{
+public:
+    explicit request_writer(std::string& out) : m_out(out) {}
+
+    request_writer& raw(sss::string_view sv)
+    {
+        m_out.append(sv.data(), sv.size());
+        return *this;
+    }
+
+    request_writer& raw(char c)
+    {
+        m_out.push_back(c);
+        return *this;
+    }
+
+    request_writer& number(uint64_t value)
+    {
+        char  buf[20];
+        char* end = buf + sizeof(buf);
+        char* p   = end;
+        do {
+            *--p = char('0' + value % 10);
+            value /= 10;
+        } while (value);
+        m_out.append(p, end - p);
+        return *this;
+    }
+
+    // chunk-size 行用；小写，不带前缀
+    request_writer& hex(uint64_t value)
+    {
+        char  buf[16];
+        char* end = buf + sizeof(buf);
+        char* p   = end;
+        do {
+            *--p = "0123456789abcdef"[value & 0xf];
+            value >>= 4;
+        } while (value);
+        m_out.append(p, end - p);
+        return *this;
+    }
+
+    request_writer& crlf()
+    {
+        m_out.append("\r\n", 2);
+        return *this;
+    }
+
+    // "name: value\r\n"
+    request_writer& field(sss::string_view name, sss::string_view value)
+    {
+        return this->raw(name).raw(": ").raw(value).crlf();
+    }
+
+    request_writer& field(sss::string_view name, uint64_t value)
+    {
+        return this->raw(name).raw(": ").number(value).crlf();
+    }
+
+    // 多值(以 "\r\n" 串接)的 value，每个值单独一行
+    request_writer& field_lines(sss::string_view name, sss::string_view value)
+    {
+        while (!value.empty()) {
+            size_t pos = value.find("\r\n");
+            this->field(name, value.substr(0, pos));
+            if (pos == sss::string_view::npos) {
+                break;
+            }
+            value = value.substr(pos + 2);
+        }
+        return *this;
+    }
+
+private:
+    std::string& m_out;
+};
+
+/**
+ * @brief 已序列化的请求头块的缓存；每个线程一份，不加锁
+ *
+ * 以(host 行、请求方式等标志、用户提供的 request header)为键；用户的 header
+ * 没有变化时，直接复用上次拼好的整块文本。条目很少，线性查找；满了之后，
+ * 轮流替换。
+ */
+class request_header_cache
+{
+    typedef std::map<std::string, std::string, sss::stricmp_t> base_map_t;
+
+public:
+    struct entry_t
+    {
+        entry_t() : flags(0), has_cookie(false), has_content_length(false) {}
+
+        std::string         host;
+        int                 flags;
+        ss1x::http::Headers headers;
+
+        // 校验过的 http 版本号，如 "1.1"
+        std::string         version;
+        // 除请求行、动态字段之外的所有 header 行
+        std::string         block;
+        // 用户自己提供了 Cookie/Content-Length；此时不再动态生成
+        bool                has_cookie;
+        bool                has_content_length;
+    };
+
+    static const size_t max_entries = 16;
+
+    request_header_cache() : m_next(0) {}
+
+    // 每个线程一份
+    static request_header_cache& local()
+    {
+        static thread_local request_header_cache cache;
+        return cache;
+    }
+
+    const entry_t* find(sss::string_view host, int flags, const ss1x::http::Headers& headers) const
+    {
+        for (const auto& entry : m_entries) {
+            if (entry.flags == flags && sss::string_view(entry.host) == host &&
+                entry.headers.http_version == headers.http_version &&
+                entry.headers.size() == headers.size() &&
+                static_cast<const base_map_t&>(entry.headers) == static_cast<const base_map_t&>(headers))
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // 取一个可写的条目；调用者填好各个字段
+    entry_t& slot()
+    {
+        if (m_entries.size() < max_entries) {
+            m_entries.emplace_back();
+            return m_entries.back();
+        }
+        entry_t& entry = m_entries[m_next];
+        m_next = (m_next + 1) % max_entries;
+        return entry;
+    }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_next = 0;
+    }
+
+private:
+    std::vector<entry_t> m_entries;
+    size_t               m_next;
+};
+
+} // namespace detail
+} // namespace ss1x
@@ -0,0 +1,736 @@
+// ss1x/asio/session.cpp
+#include "session.hpp"
+
+#include "metrics.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <strings.h>
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+
+// NOTE 阻塞调用的状态，由 handler 与调用者共享；
+// 调用者因异常提前离开时，置空 p_out，之后的 handler 就不会再写到已失效的流上。
+struct sync_state_t
+{
+    sync_state_t() : p_out(nullptr), done(false) {}
+
+    std::ostream*             p_out;
+    boost::system::error_code ec;
+    ss1x::http::Headers       header;
+    bool                      done;
+};
+
+struct sync_state_guard_t
+{
+    std::shared_ptr<sync_state_t> state;
+    ~sync_state_guard_t() { state->p_out = nullptr; }
+};
+
+// NOTE 经由 http_cache 的 GET，各个回调共享的状态
+struct cache_state_t
+{
+    cache_state_t() : p_cache(nullptr), has_entry(false), redirects(0) {}
+
+    http_cache*                         p_cache;
+    std::string                         url;
+    // 有过期的记录，并且已带上校验器
+    bool                                has_entry;
+    http_cache::entry_t                 entry;
+    // 可缓存的 200 响应，边收边写
+    std::unique_ptr<http_cache::writer> writer;
+    unsigned                            redirects;
+    session::onContent_t                on_content;
+    session::onFinished_t               on_finished;
+    // 调用者原始的参数
+    request_options                     options;
+};
+
+void report_stats(const request_options& options, const request_stats& stats)
+{
+    if (options.stats) {
+        *options.stats = stats;
+    }
+    if (options.on_stats) {
+        options.on_stats(stats);
+    }
+}
+
+// 用缓存的 header 与 body，走一遍 on_header、on_content、on_finished；
+// p_stats 非空时，在 on_finished 之前，补上结束时间并报告
+void serve_cached(cache_state_t& state, std::istream& body, request_stats* p_stats)
+{
+    const ss1x::http::Headers& header = state.entry.header;
+    if (state.options.on_header && !state.options.on_header(header)) {
+        if (p_stats) {
+            p_stats->finish = request_stats::now();
+            report_stats(state.options, *p_stats);
+        }
+        if (state.on_finished) {
+            state.on_finished(boost::asio::error::operation_aborted, header);
+        }
+        return;
+    }
+    if (state.on_content) {
+        std::vector<char> buffer(64 * 1024);
+        while (body.read(buffer.data(), std::streamsize(buffer.size())) || body.gcount() > 0) {
+            state.on_content(sss::string_view(buffer.data(), size_t(body.gcount())));
+        }
+    }
+    if (p_stats) {
+        p_stats->finish = request_stats::now();
+        report_stats(state.options, *p_stats);
+    }
+    if (state.on_finished) {
+        state.on_finished(boost::system::error_code(), header);
+    }
+}
+
+// NOTE 一次可合并的 GET；发起者的 client 收到什么，就按顺序转给每个等待者
+struct flight_t
+{
+    struct waiter_t
+    {
+        waiter_t() : p_stats(nullptr), offset(0), header_seen(false), rejected(false) {}
+
+        session::onContent_t             on_content;
+        session::onFinished_t            on_finished;
+        proxy_tunnel_client::onHeader_t  on_header;
+        request_stats*                   p_stats;
+        onStats_t                        on_stats;
+        // 已转交的 body 字节数
+        size_t                           offset;
+        bool                             header_seen;
+        bool                             rejected;
+    };
+    typedef std::vector<std::shared_ptr<waiter_t>> waiter_list_t;
+
+    // body 超过这么多字节之后，不再接受新的等待者，也不再缓存 body
+    static const size_t buffer_limit = 4 * 1024 * 1024;
+
+    flight_t() : closed(false), finished(false), has_header(false) {}
+
+    waiter_list_t snapshot()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return waiters;
+    }
+
+    // 补上 w 还没有收到的 header 与 body
+    void catch_up(waiter_t& w)
+    {
+        if (!has_header) {
+            return;
+        }
+        if (!w.header_seen) {
+            w.header_seen = true;
+            w.rejected    = w.on_header && !w.on_header(header);
+        }
+        if (!w.rejected && w.on_content && w.offset < buffer.size()) {
+            w.on_content(sss::string_view(buffer.data() + w.offset, buffer.size() - w.offset));
+        }
+        w.offset = buffer.size();
+    }
+
+    // 以下三项，由 lock 保护；等待者在其他线程中加入
+    std::mutex          lock;
+    waiter_list_t       waiters;
+    bool                closed;
+    bool                finished;
+
+    // NOTE 以下各项，只在发起者 client 的回调中读写；这些回调由 strand 串行执行
+    bool                has_header;
+    ss1x::http::Headers header;
+    std::string         buffer;
+    request_stats       stats;
+};
+
+std::string coalesce_key(const std::string& url, const request_options& options)
+{
+    std::ostringstream oss;
+    oss << http_cache::normalize_url(url) << '\n'
+        << options.proxy_domain << ':' << options.proxy_port << '\n'
+        << int(options.expect_type) << ' ' << options.max_redirect << ' '
+        << options.use_cookie_jar << ' ' << static_cast<const void*>(options.cache) << '\n';
+    for (const auto& kv : options.header) {
+        oss << kv.first << ": " << kv.second << '\n';
+    }
+    return oss.str();
+}
+
+bool is_coalescable(const request_options& options)
+{
+    return !options.flow && !options.cancel && !options.end_check && options.end_markers.empty() &&
+           !options.cookie_func && !options.set_cookie_func;
+}
+
+// NOTE 缓存以规范化的 url 为键，存的是完整的 200 响应；带 Range、凭据或者
+// 条件的请求，结果与 url 之外的东西有关，既不查缓存，也不写入
+bool is_cacheable_request(const request_options& options)
+{
+    if (options.cookie_func) {
+        return false;
+    }
+    for (const auto& kv : options.header) {
+        const std::string& key = kv.first;
+        if (::strcasecmp(key.c_str(), "Range") == 0 ||
+            ::strcasecmp(key.c_str(), "Authorization") == 0 ||
+            ::strcasecmp(key.c_str(), "Proxy-Authorization") == 0 ||
+            ::strcasecmp(key.c_str(), "Cookie") == 0 ||
+            ::strncasecmp(key.c_str(), "If-", 3) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+metric_counter& coalesced_counter()
+{
+    static metric_counter& s_counter = metrics_registry::instance().counter(
+        "ss1x_coalesced_requests_total",
+        "GET requests served by joining an identical in-flight request.");
+    return s_counter;
+}
+
+} // namespace detail
+
+session::session()
+    : m_ssl_ctx(boost::asio::ssl::context::tls_client),
+      m_threads(1)
+{
+    m_ssl_ctx.set_default_verify_paths();
+    m_tls_sessions.attach(m_ssl_ctx);
+}
+
+session::~session()
+{
+    m_clients.clear();
+    m_pool.clear();
+}
+
+void session::start(method_t method, const std::string& url,
+                    const std::string* p_post_content,
+                    onContent_t&& on_content, onFinished_t&& on_finished,
+                    const request_options& options,
+                    const std::shared_ptr<body_source>& body)
+{
+    if (options.coalesce && method.is(method_t::E_GET) && detail::is_coalescable(options)) {
+        this->start_coalesced(url, std::move(on_content), std::move(on_finished), options);
+        return;
+    }
+    if (options.cache && method.is(method_t::E_GET) && detail::is_cacheable_request(options)) {
+        this->start_cached(url, std::move(on_content), std::move(on_finished), options);
+        return;
+    }
+
+    client_list_t::iterator it;
+    {
+        std::lock_guard<std::mutex> lock(m_clients_lock);
+        m_clients.emplace_back(new proxy_tunnel_client(m_io_service, nullptr));
+        it = std::prev(m_clients.end());
+    }
+    proxy_tunnel_client& c = **it;
+
+    c.upgrade_to_ssl(m_ssl_ctx);
+    c.setConnectionPool(&m_pool);
+    c.setRedirectCache(&m_redirects);
+    c.request_header() = options.header;
+    c.setTimeouts(options.timeouts);
+    if (options.flow) {
+        c.setContentFlow(options.flow);
+    }
+    if (options.cancel) {
+        c.setRequestCancel(options.cancel);
+    }
+    if (options.max_redirect >= 0) {
+        c.max_redirect(options.max_redirect);
+    }
+    c.setOnContent(std::move(on_content));
+    if (options.end_check) {
+        c.setOnEndCheck(options.end_check);
+    }
+    if (!options.end_markers.empty()) {
+        c.setEndMarkers(options.end_markers);
+    }
+    if (options.on_header) {
+        c.setOnHeader(options.on_header);
+    }
+    if (options.stats || options.on_stats) {
+        request_stats* p_stats  = options.stats;
+        onStats_t      on_stats = options.on_stats;
+        c.setOnStats([p_stats, on_stats](const request_stats& stats) -> void {
+            if (p_stats) {
+                *p_stats = stats;
+            }
+            if (on_stats) {
+                on_stats(stats);
+            }
+        });
+    }
+
+    proxy_tunnel_client::CookieFunc_t    cookie_func     = options.cookie_func;
+    proxy_tunnel_client::SetCookieFunc_t set_cookie_func = options.set_cookie_func;
+    if (options.use_cookie_jar && !cookie_func && !set_cookie_func) {
+        ss1x::cookie::jar* p_jar = &m_cookies;
+        cookie_func = [p_jar](const std::string& url) -> std::vector<std::string> {
+            return p_jar->get(url);
+        };
+        set_cookie_func = [p_jar](const std::string& domain, const std::string& cookie) -> bool {
+            return p_jar->set(domain, cookie);
+        };
+    }
+    if (cookie_func) {
+        c.setCookieFunc(std::move(cookie_func));
+    }
+    if (set_cookie_func) {
+        c.setSetCookieFunc(std::move(set_cookie_func));
+    }
+
+    bool reported = false;
+    c.setOnFinished([this, it, on_finished, reported]() mutable -> void {
+        if (reported) {
+            return;
+        }
+        reported = true;
+        proxy_tunnel_client& c = **it;
+        COLOG_DEBUG(SSS_VALUE_MSG(c.header().status_code));
+        if (on_finished) {
+            on_finished(c.error_code(), c.header());
+        }
+        // NOTE 此时仍处于 client 自身的 handler 调用栈中，不能直接析构
+        m_io_service.post([this, it]() -> void { this->release_client(it); });
+    });
+
+    try {
+        if (options.proxy_domain.empty()) {
+            if (method.is(method_t::E_POST) && body) {
+                c.http_post(url, body);
+            }
+            else if (method.is(method_t::E_POST)) {
+                c.http_post(url, *p_post_content);
+            }
+            else if (method.is(method_t::E_HEAD)) {
+                c.http_head(url);
+            }
+            else {
+                c.http_get(url, options.expect_type);
+            }
+        }
+        else {
+            if (method.is(method_t::E_POST) && body) {
+                c.ssl_tunnel_post(options.proxy_domain, options.proxy_port, url, body,
+                                  options.expect_type);
+            }
+            else if (method.is(method_t::E_POST)) {
+                c.ssl_tunnel_post(options.proxy_domain, options.proxy_port, url,
+                                  *p_post_content, options.expect_type);
+            }
+            else if (method.is(method_t::E_HEAD)) {
+                c.ssl_tunnel_head(options.proxy_domain, options.proxy_port, url);
+            }
+            else {
+                c.ssl_tunnel_get(options.proxy_domain, options.proxy_port, url,
+                                 options.expect_type);
+            }
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(m_clients_lock);
+        m_clients.erase(it);
+        throw;
+    }
+}
+
+void session::start_cached(const std::string& url,
+                           onContent_t&& on_content, onFinished_t&& on_finished,
+                           const request_options& options, bool revalidate)
+{
+    std::shared_ptr<detail::cache_state_t> state = std::make_shared<detail::cache_state_t>();
+    state->p_cache     = options.cache;
+    state->url         = url;
+    state->on_content  = std::move(on_content);
+    state->on_finished = std::move(on_finished);
+    state->options     = options;
+
+    http_cache& cache = *options.cache;
+    state->has_entry  = revalidate && cache.lookup(url, state->entry);
+    if (state->has_entry && http_cache::is_fresh(state->entry)) {
+        std::shared_ptr<std::ifstream> p_body = cache.open_body(state->entry);
+        if (p_body) {
+            COLOG_DEBUG("cache hit: ", url);
+            cache.count_hit();
+            request_stats stats;
+            stats.start         = request_stats::now();
+            stats.decoded_bytes = state->entry.body_size;
+            // NOTE 与网络请求一样，回调不在调用者的栈上执行
+            m_io_service.post([state, p_body, stats]() mutable -> void {
+                detail::serve_cached(*state, *p_body, &stats);
+            });
+            return;
+        }
+        state->has_entry = false;
+    }
+
+    request_options inner = options;
+    inner.cache           = nullptr;
+    if (state->has_entry && !http_cache::add_validators(state->entry, inner.header)) {
+        state->has_entry = false;
+    }
+    inner.on_header = [state](const ss1x::http::Headers& header) -> bool {
+        // NOTE 304 没有 body；等到结束时确认没有跳转过，再决定是否使用缓存
+        if (header.status_code == 304 && state->has_entry) {
+            return true;
+        }
+        if (http_cache::is_storable(header)) {
+            state->writer = state->p_cache->begin_store(state->url);
+        }
+        return !state->options.on_header || state->options.on_header(header);
+    };
+    inner.stats    = nullptr;
+    inner.on_stats = [state](const request_stats& stats) -> void {
+        state->redirects = stats.redirects;
+        detail::report_stats(state->options, stats);
+    };
+
+    this->start(
+        method_t::E_GET, url, nullptr,
+        [state](sss::string_view data) -> void {
+            if (state->writer) {
+                state->writer->write(data.data(), data.size());
+            }
+            if (state->on_content) {
+                state->on_content(data);
+            }
+        },
+        [this, state](const boost::system::error_code& ec,
+                      const ss1x::http::Headers& header) -> void {
+            const bool ok       = !ec || ec == boost::asio::error::eof;
+            const bool deferred = header.status_code == 304 && state->has_entry;
+            if (deferred && ok) {
+                std::shared_ptr<std::ifstream> p_body;
+                if (!state->redirects) {
+                    p_body = state->p_cache->open_body(state->entry);
+                }
+                if (p_body) {
+                    COLOG_DEBUG("cache revalidated: ", state->url);
+                    state->p_cache->count_revalidated();
+                    state->p_cache->refresh(state->entry, header);
+                    detail::serve_cached(*state, *p_body, nullptr);
+                    return;
+                }
+                // NOTE 校验器随跳转带到了别的 url 上，它的 304 与缓存的记录无关；
+                // 或者 body 在验证期间丢失了。不带校验器，重新请求一次
+                COLOG_DEBUG("cache revalidation not usable, refetch: ", state->url,
+                            SSS_VALUE_MSG(state->redirects));
+                onContent_t  content  = state->on_content;
+                onFinished_t finished = state->on_finished;
+                this->start_cached(state->url, std::move(content), std::move(finished),
+                                   state->options, false);
+                return;
+            }
+            state->p_cache->count_miss();
+            if (state->writer) {
+                if (ok && !state->redirects) {
+                    state->writer->commit(header);
+                }
+                state->writer.reset();
+            }
+            boost::system::error_code result = ec;
+            if (deferred && state->options.on_header && !state->options.on_header(header)) {
+                result = boost::asio::error::operation_aborted;
+            }
+            if (state->on_finished) {
+                state->on_finished(result, header);
+            }
+        },
+        inner);
+}
+
+void session::start_coalesced(const std::string& url,
+                              onContent_t&& on_content, onFinished_t&& on_finished,
+                              const request_options& options)
+{
+    std::shared_ptr<detail::flight_t::waiter_t> waiter = std::make_shared<detail::flight_t::waiter_t>();
+    waiter->on_content  = std::move(on_content);
+    waiter->on_finished = std::move(on_finished);
+    waiter->on_header   = options.on_header;
+    waiter->p_stats     = options.stats;
+    waiter->on_stats    = options.on_stats;
+
+    const std::string key = detail::coalesce_key(url, options);
+    std::shared_ptr<detail::flight_t> flight;
+    {
+        std::lock_guard<std::mutex> lock(m_flights_lock);
+        auto it = m_flights.find(key);
+        if (it != m_flights.end()) {
+            std::lock_guard<std::mutex> guard(it->second->lock);
+            if (!it->second->closed && !it->second->finished) {
+                it->second->waiters.push_back(waiter);
+                COLOG_DEBUG("coalesced: ", url);
+                detail::coalesced_counter().add();
+                return;
+            }
+        }
+        // NOTE 已经关闭的 flight 仍在传输中；新的 flight 顶替它的位置
+        flight = std::make_shared<detail::flight_t>();
+        flight->waiters.push_back(waiter);
+        m_flights[key] = flight;
+    }
+
+    request_options inner = options;
+    inner.coalesce = false;
+    inner.stats    = nullptr;
+    inner.on_stats = [flight](const request_stats& stats) -> void {
+        flight->stats = stats;
+    };
+    inner.on_header = [flight](const ss1x::http::Headers& header) -> bool {
+        flight->header     = header;
+        flight->has_header = true;
+        for (const auto& w : flight->snapshot()) {
+            flight->catch_up(*w);
+        }
+        // NOTE 个别等待者拒绝，不影响其他等待者；其 body 不再转交
+        return true;
+    };
+
+    onContent_t content = [flight](sss::string_view data) -> void {
+        if (flight->closed) {
+            for (const auto& w : flight->snapshot()) {
+                if (!w->rejected && w->on_content) {
+                    w->on_content(data);
+                }
+            }
+            return;
+        }
+        flight->buffer.append(data.data(), data.size());
+        if (flight->buffer.size() > detail::flight_t::buffer_limit) {
+            std::lock_guard<std::mutex> guard(flight->lock);
+            flight->closed = true;
+        }
+        for (const auto& w : flight->snapshot()) {
+            flight->catch_up(*w);
+        }
+        if (flight->closed) {
+            // 所有等待者都已追平，之后也不会再有新的等待者
+            std::string().swap(flight->buffer);
+        }
+    };
+
+    onFinished_t finished = [this, key, flight](const boost::system::error_code& ec,
+                                                const ss1x::http::Headers& header) -> void {
+        detail::flight_t::waiter_list_t waiters;
+        {
+            std::lock_guard<std::mutex> guard(flight->lock);
+            flight->finished = true;
+            waiters          = flight->waiters;
+        }
+        this->drop_flight(key, flight);
+        for (const auto& w : waiters) {
+            flight->catch_up(*w);
+            if (w->p_stats) {
+                *w->p_stats = flight->stats;
+            }
+            if (w->on_stats) {
+                w->on_stats(flight->stats);
+            }
+            if (!w->on_finished) {
+                continue;
+            }
+            if (w->rejected) {
+                w->on_finished(boost::asio::error::operation_aborted, header);
+            }
+            else {
+                w->on_finished(ec, header);
+            }
+        }
+    };
+
+    try {
+        this->start(method_t::E_GET, url, nullptr,
+                    std::move(content), std::move(finished), inner);
+    }
+    catch (...) {
+        this->drop_flight(key, flight);
+        throw;
+    }
+}
+
+void session::drop_flight(const std::string& key, const std::shared_ptr<detail::flight_t>& flight)
+{
+    std::lock_guard<std::mutex> lock(m_flights_lock);
+    auto it = m_flights.find(key);
+    if (it != m_flights.end() && it->second == flight) {
+        m_flights.erase(it);
+    }
+}
+
+void session::release_client(client_list_t::iterator it)
+{
+    // 被取消的定时器、socket 操作的回调，可能还排在 io_service 或 strand 的队列里
+    if ((*it)->has_pending_handlers()) {
+        m_io_service.post([this, it]() -> void { this->release_client(it); });
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_clients_lock);
+    m_clients.erase(it);
+}
+
+size_t session::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_clients_lock);
+    return m_clients.size();
+}
+
+void session::async_get(const std::string& url,
+                        onContent_t&& on_content, onFinished_t&& on_finished,
+                        const request_options& options)
+{
+    this->start(method_t::E_GET, url, nullptr,
+                std::move(on_content), std::move(on_finished), options);
+}
+
+void session::async_post(const std::string& url, const std::string& post_content,
+                         onContent_t&& on_content, onFinished_t&& on_finished,
+                         const request_options& options)
+{
+    this->start(method_t::E_POST, url, &post_content,
+                std::move(on_content), std::move(on_finished), options);
+}
+
+void session::async_post(const std::string& url, std::shared_ptr<body_source> body,
+                         onContent_t&& on_content, onFinished_t&& on_finished,
+                         const request_options& options)
+{
+    if (!body) {
+        body = make_memory_body(sss::string_view());
+    }
+    this->start(method_t::E_POST, url, nullptr,
+                std::move(on_content), std::move(on_finished), options, body);
+}
+
+void session::async_head(const std::string& url, onFinished_t&& on_finished,
+                         const request_options& options)
+{
+    this->start(method_t::E_HEAD, url, nullptr,
+                onContent_t(), std::move(on_finished), options);
+}
+
+boost::system::error_code session::wait(method_t method, std::ostream& out,
+                                        ss1x::http::Headers& header,
+                                        const std::string& url,
+                                        const std::string* p_post_content,
+                                        const request_options& options,
+                                        const std::shared_ptr<body_source>& body)
+{
+    std::shared_ptr<detail::sync_state_t> state = std::make_shared<detail::sync_state_t>();
+    state->p_out = &out;
+    detail::sync_state_guard_t guard{state};
+
+    this->start(
+        method, url, p_post_content,
+        [state](sss::string_view response) -> void {
+            if (state->p_out) {
+                *state->p_out << response;
+            }
+        },
+        [state](const boost::system::error_code& ec,
+                const ss1x::http::Headers& header) -> void {
+            state->ec     = ec;
+            state->header = header;
+            state->done   = true;
+        },
+        options, body);
+
+    if (m_io_service.stopped()) {
+        m_io_service.restart();
+    }
+    while (!state->done && m_io_service.run_one()) {
+    }
+    // 顺带处理已经就绪的 handler，比如刚结束的 client 的析构
+    m_io_service.poll();
+
+    if (!state->done) {
+        return boost::asio::error::operation_aborted;
+    }
+    header = std::move(state->header);
+    return state->ec;
+}
+
+boost::system::error_code session::get(std::ostream& out, ss1x::http::Headers& header,
+                                       const std::string& url,
+                                       const request_options& options)
+{
+    return this->wait(method_t::E_GET, out, header, url, nullptr, options);
+}
+
+boost::system::error_code session::head(ss1x::http::Headers& header, const std::string& url,
+                                        const request_options& options)
+{
+    std::ostringstream out;
+    return this->wait(method_t::E_HEAD, out, header, url, nullptr, options);
+}
+
+boost::system::error_code session::post(std::ostream& out, ss1x::http::Headers& header,
+                                        const std::string& url,
+                                        const std::string& post_content,
+                                        const request_options& options)
+{
+    return this->wait(method_t::E_POST, out, header, url, &post_content, options);
+}
+
+boost::system::error_code session::post(std::ostream& out, ss1x::http::Headers& header,
+                                        const std::string& url,
+                                        std::shared_ptr<body_source> body,
+                                        const request_options& options)
+{
+    if (!body) {
+        body = make_memory_body(sss::string_view());
+    }
+    return this->wait(method_t::E_POST, out, header, url, nullptr, options, body);
+}
+
+void session::run()
+{
+    if (m_io_service.stopped()) {
+        m_io_service.restart();
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < m_threads; ++i) {
+        workers.emplace_back([this]() -> void { m_io_service.run(); });
+    }
+    // NOTE 异常离开时，也要等其他线程结束，否则 std::thread 析构时会 terminate
+    try {
+        m_io_service.run();
+    }
+    catch (...) {
+        m_io_service.stop();
+        for (auto& t : workers) {
+            t.join();
+        }
+        throw;
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+session& session::default_session()
+{
+    static thread_local session s;
+    return s;
+}
+
+} // namespace asio
+} // namespace ss1x
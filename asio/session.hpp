@@ -0,0 +1,219 @@
+// ss1x/asio/session.hpp
+#pragma once
+
+#include <ss1x/asio/proxy_tunnel_client.hpp>
+#include <ss1x/asio/body_source.hpp>
+#include <ss1x/asio/connection_pool.hpp>
+#include <ss1x/asio/headers.hpp>
+#include <ss1x/asio/http_cache.hpp>
+#include <ss1x/asio/redirect_cache.hpp>
+#include <ss1x/asio/cookie.hpp>
+#include <ss1x/asio/request_stats.hpp>
+#include <ss1x/asio/tls_session_cache.hpp>
+
+#include <functional>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include <sss/string_view.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace detail {
+struct flight_t;
+} // namespace detail
+
+// 单次请求的参数；默认值，等同于 redirectHttpGet() 的行为
+struct request_options
+{
+    request_options()
+        : proxy_port(0),
+          expect_type(res_type_any),
+          max_redirect(-1),
+          use_cookie_jar(true),
+          stats(nullptr),
+          cache(nullptr),
+          coalesce(false)
+    {}
+
+    ss1x::http::Headers                      header;
+    // 非空时，经由 http proxy (CONNECT) 访问
+    std::string                              proxy_domain;
+    int                                      proxy_port;
+    resource_type                            expect_type;
+    // -1 means client default
+    int                                      max_redirect;
+    // NOTE 为true，且下面两个函数都没有提供时，使用 session 自带的 cookie jar
+    bool                                     use_cookie_jar;
+    proxy_tunnel_client::CookieFunc_t        cookie_func;
+    proxy_tunnel_client::SetCookieFunc_t     set_cookie_func;
+    // NOTE 以下两项，只对以关闭连接作为结束的 body 起作用；有 Content-Length
+    // 或者 chunked 时，按其自身的长度结束，不需要标记
+    // end_check 每次只拿到新收到的字节
+    proxy_tunnel_client::onEndCheck_t        end_check;
+    // 收到任一标记，即认为 body 已经完整；跨越两次读取的标记也能识别
+    std::vector<std::string>                 end_markers;
+    // 最终响应的 header 读完时调用；返回 false 放弃 body，结果为 operation_aborted
+    proxy_tunnel_client::onHeader_t          on_header;
+    // 建链、握手、首字节、读取间隔，以及整个请求的超时
+    request_timeouts                         timeouts;
+    // 非空时，消费者可以暂停/限制 body 的读取
+    std::shared_ptr<content_flow>            flow;
+    // 非空时，可以中途取消；多个请求共用时，一次取消全部
+    std::shared_ptr<request_cancel>          cancel;
+    // NOTE 请求结束时(先于 on_finished)，各阶段耗时与字节数：stats 非空时写入
+    // 其中，并调用 on_stats；异步请求时，stats 指向的对象要一直有效到结束
+    request_stats*                           stats;
+    onStats_t                                on_stats;
+    // NOTE 非空时，GET 先查缓存：新鲜的记录直接使用，不发请求；过期的记录
+    // 带上校验器去验证，得到 304 时，以缓存的 body 与(合并后的) header 作为
+    // 结果，调用者看到的状态码仍是 200；可缓存的 200 响应，边收边写入缓存。
+    // 命中缓存时，flow 不起作用。header 中有 Range、Authorization、Cookie、
+    // If-* 等，或者设置了 cookie_func 的请求，不经过缓存
+    http_cache*                              cache;
+    // NOTE 为 true 时，同一 session 中同时进行的相同 GET(规范化的 url、header、
+    // 代理、cache 等参数都相同)合并为一次传输；后来者先补上已收到的 body，
+    // 再与发起者同步接收。超时等参数以发起者的为准；设置了 flow、cancel、end_check、
+    // end_markers 或者 cookie_func 的请求，不参与合并
+    bool                                     coalesce;
+};
+
+/**
+ * @brief 长期存在的 http 会话
+ *
+ * 持有一个 io_service、ssl::context、cookie jar、keep-alive 连接池以及 TLS
+ * session 缓存；多次请求，共享这些资源；于是 ssl::context 的初始化
+ * (set_default_verify_paths)，以及 tcp/tls 建链的开销，只需要付出一次；
+ * 连接池里的连接过期之后，再次建链，也可以走 TLS 的简化握手。
+ *
+ * async_get()/async_post() 只是发起请求，需要 run() 来驱动；
+ * get()/post() 则是阻塞版本，内部驱动 io_service，直到该请求完成。
+ *
+ * run() 可以用 threads(n) 个线程驱动 io_service；每个连接的回调，由各自的
+ * strand 串行执行，于是 TLS 解密、解压缩等计算，可以分摊到多个核上。
+ * 此时，onContent/onFinished 回调，会在不同的线程中被调用。
+ */
+class session
+{
+public:
+    typedef proxy_tunnel_client::onResponce_t onContent_t;
+    typedef std::function<void(const boost::system::error_code& ec,
+                               const ss1x::http::Headers& header)>
+        onFinished_t;
+
+    session();
+    ~session();
+
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+public:
+    boost::asio::io_service&    get_io_service()   { return m_io_service; }
+    boost::asio::ssl::context&  ssl_context()      { return m_ssl_ctx;    }
+    connection_pool&            pool()             { return m_pool;       }
+    tls_session_cache&          tls_sessions()     { return m_tls_sessions; }
+    ss1x::cookie::jar&          cookies()          { return m_cookies;    }
+    // 301/308 等跳转的记录；之后对同一 url 的 GET，直接请求最终的地址
+    redirect_cache&             redirects()        { return m_redirects;  }
+
+    // 尚未完成的请求数
+    size_t pending() const;
+
+    // run() 使用的线程数；默认为1
+    size_t threads() const          { return m_threads;                    }
+    void   threads(size_t n)        { m_threads = n ? n : 1;               }
+
+    void async_get(const std::string& url,
+                   onContent_t&& on_content, onFinished_t&& on_finished,
+                   const request_options& options = request_options());
+
+    void async_post(const std::string& url, const std::string& post_content,
+                    onContent_t&& on_content, onFinished_t&& on_finished,
+                    const request_options& options = request_options());
+
+    // NOTE body 边读边发，不整体载入内存；长度未知时以 chunked 发送。
+    // 跳转、池中连接失效重发时，body 需要能 rewind()
+    void async_post(const std::string& url, std::shared_ptr<body_source> body,
+                    onContent_t&& on_content, onFinished_t&& on_finished,
+                    const request_options& options = request_options());
+
+    void async_head(const std::string& url, onFinished_t&& on_finished,
+                    const request_options& options = request_options());
+
+    boost::system::error_code head(ss1x::http::Headers& header, const std::string& url,
+                                   const request_options& options = request_options());
+
+    boost::system::error_code get(std::ostream& out, ss1x::http::Headers& header,
+                                  const std::string& url,
+                                  const request_options& options = request_options());
+
+    boost::system::error_code post(std::ostream& out, ss1x::http::Headers& header,
+                                   const std::string& url, const std::string& post_content,
+                                   const request_options& options = request_options());
+
+    boost::system::error_code post(std::ostream& out, ss1x::http::Headers& header,
+                                   const std::string& url, std::shared_ptr<body_source> body,
+                                   const request_options& options = request_options());
+
+    // 驱动所有已发起的请求，直到全部完成；使用 threads() 个线程(含当前线程)
+    void run();
+
+    // 每个线程一个的默认会话；redirectHttpGet() 等函数，都是它的简单包装
+    static session& default_session();
+
+private:
+    typedef std::list<std::unique_ptr<proxy_tunnel_client>> client_list_t;
+
+    // body 非空时，POST 的内容取自 body，而不是 p_post_content
+    void start(method_t method, const std::string& url, const std::string* p_post_content,
+               onContent_t&& on_content, onFinished_t&& on_finished,
+               const request_options& options,
+               const std::shared_ptr<body_source>& body = std::shared_ptr<body_source>());
+
+    // options.cache 非空时的 GET；revalidate 为 false 时，不查缓存，也不带校验器
+    void start_cached(const std::string& url,
+                      onContent_t&& on_content, onFinished_t&& on_finished,
+                      const request_options& options, bool revalidate = true);
+
+    // options.coalesce 为 true 时的 GET
+    void start_coalesced(const std::string& url,
+                         onContent_t&& on_content, onFinished_t&& on_finished,
+                         const request_options& options);
+    // flight 结束(或者发起失败)时，从 m_flights 中移除；已被新的 flight 顶替的，不动
+    void drop_flight(const std::string& key, const std::shared_ptr<detail::flight_t>& flight);
+
+    // NOTE client 的回调全部执行完之后，才能析构它
+    void release_client(client_list_t::iterator it);
+
+    boost::system::error_code wait(method_t method, std::ostream& out,
+                                   ss1x::http::Headers& header, const std::string& url,
+                                   const std::string* p_post_content,
+                                   const request_options& options,
+                                   const std::shared_ptr<body_source>& body = std::shared_ptr<body_source>());
+
+    // NOTE 成员声明顺序：client 与连接池中的socket，都要先于 io_service 析构
+    boost::asio::io_service   m_io_service;
+    boost::asio::ssl::context m_ssl_ctx;
+    tls_session_cache         m_tls_sessions;
+    connection_pool           m_pool;
+    ss1x::cookie::jar         m_cookies;
+    redirect_cache            m_redirects;
+    mutable std::mutex        m_clients_lock;
+    client_list_t             m_clients;
+    size_t                    m_threads;
+    // 进行中的可合并请求；key 见 start_coalesced()
+    std::mutex                m_flights_lock;
+    std::unordered_map<std::string, std::shared_ptr<detail::flight_t>> m_flights;
+};
+
+} // namespace asio
+} // namespace ss1x
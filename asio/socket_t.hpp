@@ -2,7 +2,6 @@
 
 #include <memory>
 #include <stdexcept>
-#include <mutex>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -12,6 +11,8 @@
 #include <sss/debug/value_msg.hpp>
 #include <sss/util/PostionThrow.hpp>
 
+#include "tls_session_cache.hpp"
+
 namespace ss1x {
 namespace detail {
 
@@ -21,6 +22,7 @@ constexpr T const& constexpr_max(T const& a, T const& b)
     return a > b ? a : b;
 }
 
+// NOTE 本身不加锁；多线程驱动 io_service 时，由使用者(的 strand)保证串行访问
 struct socket_t {
 private:
     typedef boost::asio::ip::tcp::socket basic_socket_t;
@@ -29,7 +31,6 @@ private:
 
     basic_socket_t m_socket;
     std::unique_ptr<ssl_socket_t> m_ssl_stream;
-    std::mutex m_socket_lock;
     bool m_endable_ssl;
 
 public:
@@ -50,7 +51,6 @@ public:
 
     void upgrade_to_ssl(boost::asio::ssl::context& ctx)
     {
-        std::lock_guard<std::mutex> lock(m_socket_lock);
         if (!has_ssl()) {
             COLOG_DEBUG("from ", &ctx);
             m_ssl_stream.reset(new ssl_socket_t(m_socket, ctx));
@@ -67,25 +67,16 @@ public:
         // 0000: .....
         // == Info: TLSv1.3 (OUT), TLS handshake, Client hello (1):
 
-        std::lock_guard<std::mutex> lock(m_socket_lock);
         if (!has_ssl()) {
-            // /home/sarrow/extra/boost1_67/include/boost/asio/ssl/context_base.hpp:81
-            boost::asio::ssl::context ssl_context(boost::asio::ssl::context::sslv23);
-            //boost::asio::ssl::context ssl_context(boost::asio::ssl::context::tlsv13);
-            ssl_context.set_default_verify_paths();
-            ssl_context.set_options(boost::asio::ssl::context::default_workarounds
-                                    //| boost::asio::ssl::context::no_sslv2
-                                    //| boost::asio::ssl::context::single_dh_use
-                                    // | boost::asio::ssl::context::no_sslv3
-                                    );
-            m_ssl_stream.reset(new ssl_socket_t(m_socket, ssl_context));
+            // NOTE 不再每次临时构造 context(set_default_verify_paths 要读整个证书目录)；
+            // 改用进程级共享的 context，同时也就用上了它的 TLS session 缓存。
+            m_ssl_stream.reset(new ssl_socket_t(m_socket, ss1x::asio::tls_session_cache::shared_context()));
         }
         m_endable_ssl = true;
     }
 
     void disable_ssl()
     {
-        std::lock_guard<std::mutex> lock(m_socket_lock);
         if (m_ssl_stream && m_endable_ssl) {
             m_endable_ssl = false;
         }
@@ -93,7 +84,6 @@ public:
 
     void enable_ssl()
     {
-        std::lock_guard<std::mutex> lock(m_socket_lock);
         if (!m_endable_ssl) {
             m_endable_ssl = true;
         }
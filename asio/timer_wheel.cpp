@@ -0,0 +1,164 @@
+// ss1x/asio/timer_wheel.cpp
+#include "timer_wheel.hpp"
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+boost::asio::io_service::id timer_wheel::id;
+
+const size_t timer_wheel::default_slot_count;
+const int    timer_wheel::default_resolution_ms;
+
+timer_wheel::timer_wheel(boost::asio::io_service& io_service)
+    : boost::asio::io_service::service(io_service),
+      m_timer(io_service),
+      m_resolution(std::chrono::milliseconds(default_resolution_ms)),
+      m_slots(default_slot_count),
+      m_next_id(0),
+      m_cursor(0),
+      m_running(false),
+      m_shutdown(false)
+{
+}
+
+timer_wheel::~timer_wheel()
+{
+}
+
+#if BOOST_VERSION >= 106600
+void timer_wheel::shutdown()
+#else
+void timer_wheel::shutdown_service()
+#endif
+{
+    entry_map_t entries;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_shutdown = true;
+        m_running  = false;
+        entries.swap(m_entries);
+        for (auto& slot : m_slots) {
+            slot.clear();
+        }
+        boost::system::error_code ec;
+        m_timer.cancel(ec);
+    }
+    // NOTE 回调持有的资源，在锁外释放
+}
+
+size_t timer_wheel::slot_of_locked(clock_type::time_point expires) const
+{
+    // 向上取整：回调可以晚，不能早
+    uint64_t ticks = 1;
+    if (expires > m_now + m_resolution) {
+        ticks = uint64_t((expires - m_now + m_resolution - clock_type::duration(1)) / m_resolution);
+    }
+    return size_t((m_cursor + ticks) % m_slots.size());
+}
+
+timer_wheel::timer_id timer_wheel::schedule(clock_type::time_point expires, handler_t&& handler)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_shutdown) {
+        return 0;
+    }
+    if (!m_running) {
+        // 空转时不走格；重新开始计时
+        m_now = clock_type::now();
+    }
+    timer_id id = ++m_next_id;
+    entry_t& entry = m_entries[id];
+    entry.expires  = expires;
+    entry.handler  = std::move(handler);
+    m_slots[this->slot_of_locked(expires)].push_back(id);
+    this->start_locked();
+    return id;
+}
+
+bool timer_wheel::cancel(timer_id id)
+{
+    handler_t handler;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_entries.find(id);
+        if (it == m_entries.end()) {
+            return false;
+        }
+        handler = std::move(it->second.handler);
+        m_entries.erase(it);
+    }
+    return true;
+}
+
+size_t timer_wheel::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_entries.size();
+}
+
+void timer_wheel::start_locked()
+{
+    if (m_running || m_entries.empty()) {
+        return;
+    }
+    m_running = true;
+    m_timer.expires_at(m_now + m_resolution);
+    m_timer.async_wait(std::bind(&timer_wheel::on_tick, this, std::placeholders::_1));
+}
+
+void timer_wheel::on_tick(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    std::vector<handler_t> due;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_shutdown) {
+            return;
+        }
+        const clock_type::time_point now = clock_type::now();
+        size_t steps = 0;
+        while (m_now + m_resolution <= now && steps < m_slots.size()) {
+            m_now   += m_resolution;
+            m_cursor = (m_cursor + 1) % m_slots.size();
+            ++steps;
+
+            std::vector<timer_id>& slot = m_slots[m_cursor];
+            size_t kept = 0;
+            for (size_t i = 0; i < slot.size(); ++i) {
+                auto it = m_entries.find(slot[i]);
+                if (it == m_entries.end()) {
+                    continue;
+                }
+                if (it->second.expires <= now) {
+                    due.push_back(std::move(it->second.handler));
+                    m_entries.erase(it);
+                    continue;
+                }
+                // 还要再转几圈
+                slot[kept++] = slot[i];
+            }
+            slot.resize(kept);
+        }
+        if (m_now + m_resolution <= now) {
+            // NOTE 落后超过一圈(比如进程被挂起过)；每个槽都已检查过一遍，直接追上
+            auto behind = (now - m_now) / m_resolution;
+            COLOG_DEBUG("timer wheel behind:", SSS_VALUE_MSG(behind));
+            m_cursor = size_t((m_cursor + uint64_t(behind)) % m_slots.size());
+            m_now   += behind * m_resolution;
+        }
+
+        m_running = false;
+        this->start_locked();
+    }
+    for (auto& handler : due) {
+        handler();
+    }
+}
+
+} // namespace asio
+} // namespace ss1x
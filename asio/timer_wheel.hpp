@@ -0,0 +1,109 @@
+// ss1x/asio/timer_wheel.hpp
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/version.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace ss1x {
+namespace asio {
+
+/**
+ * @brief 挂在 io_service 上的哈希时间轮；同一个 io_service 上的所有请求共用
+ *
+ * 每个请求各持一个 deadline_timer 时，每次重置都要 cancel + async_wait，
+ * 取消的回调还要再排一次队；上万个并发请求，就是上万个内核定时器的进出。
+ * 这里只用一个 steady_timer，每隔 resolution() 走一格；定时器按到期时间
+ * 散列到 slot_count() 个槽中，schedule()/cancel() 都是 O(1)。
+ *
+ * - 到期时间超过一圈的定时器，留在槽中，等走到那一圈再触发；
+ * - 精度为 resolution()；回调最多晚一格被调用，不会提前；
+ * - cancel() 直接销毁回调，不再调用它(与 asio 的 operation_aborted 不同)；
+ * - 回调在驱动 io_service 的线程中调用，此时不持有内部锁；需要串行化的，
+ *   自己用 strand 包装。
+ *
+ * 各个成员函数都是线程安全的。
+ */
+class timer_wheel : public boost::asio::io_service::service
+{
+public:
+    typedef std::chrono::steady_clock   clock_type;
+    typedef uint64_t                    timer_id;
+    typedef std::function<void()>       handler_t;
+
+    static boost::asio::io_service::id id;
+
+    static const size_t default_slot_count    = 512;
+    static const int    default_resolution_ms = 100;
+
+    explicit timer_wheel(boost::asio::io_service& io_service);
+    ~timer_wheel();
+
+    // 该 io_service 上的时间轮；第一次使用时创建
+    static timer_wheel& of(boost::asio::io_service& io_service)
+    {
+        return boost::asio::use_service<timer_wheel>(io_service);
+    }
+
+public:
+    /**
+     * @return 非0的 id，用于 cancel()
+     */
+    timer_id schedule(clock_type::time_point expires, handler_t&& handler);
+
+    timer_id schedule(clock_type::duration wait, handler_t&& handler)
+    {
+        return this->schedule(clock_type::now() + wait, std::move(handler));
+    }
+
+    // 已经触发(或正在触发)的，返回 false
+    bool     cancel(timer_id id);
+
+    // 尚未触发的定时器个数
+    size_t   size() const;
+
+    clock_type::duration resolution() const { return m_resolution;    }
+    size_t               slot_count() const { return m_slots.size();  }
+
+private:
+    // NOTE io_service 析构前调用；此后不再触发任何回调
+#if BOOST_VERSION >= 106600
+    void shutdown() override;
+#else
+    void shutdown_service() override;
+#endif
+
+    struct entry_t
+    {
+        clock_type::time_point expires;
+        handler_t              handler;
+    };
+    typedef std::unordered_map<timer_id, entry_t> entry_map_t;
+
+    size_t slot_of_locked(clock_type::time_point expires) const;
+    void   start_locked();
+    void   on_tick(const boost::system::error_code& ec);
+
+    mutable std::mutex            m_lock;
+    boost::asio::steady_timer     m_timer;
+    clock_type::duration          m_resolution;
+    // NOTE 槽中只记录 id；被 cancel() 的，走到该槽时顺便清理
+    std::vector<std::vector<timer_id>> m_slots;
+    entry_map_t                   m_entries;
+    timer_id                      m_next_id;
+    // m_cursor 为当前所在的槽，m_now 为走到该槽的时刻
+    size_t                        m_cursor;
+    clock_type::time_point        m_now;
+    bool                          m_running;
+    bool                          m_shutdown;
+};
+
+} // namespace asio
+} // namespace ss1x
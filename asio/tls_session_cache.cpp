@@ -0,0 +1,257 @@
+// ss1x/asio/tls_session_cache.cpp
+#include "tls_session_cache.hpp"
+
+#include <sss/colorlog.hpp>
+#include <sss/debug/value_msg.hpp>
+
+namespace ss1x {
+namespace asio {
+
+namespace {
+
+void free_ssl_key(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx,
+                  long argl, void* argp)
+{
+    (void)parent; (void)ad; (void)idx; (void)argl; (void)argp;
+    delete static_cast<std::string*>(ptr);
+}
+
+struct shared_tls_t
+{
+    shared_tls_t()
+        : ctx(boost::asio::ssl::context::tls_client)
+    {
+        ctx.set_default_verify_paths();
+        ctx.set_options(boost::asio::ssl::context::default_workarounds);
+        cache.attach(ctx);
+    }
+
+    // NOTE cache 要先于 ctx 析构
+    boost::asio::ssl::context ctx;
+    tls_session_cache         cache;
+};
+
+shared_tls_t& shared_tls()
+{
+    static shared_tls_t s;
+    return s;
+}
+
+} // namespace
+
+tls_session_cache::tls_session_cache(size_t max_entries)
+    : m_max_entries(max_entries),
+      m_handshakes(0),
+      m_offered(0),
+      m_resumed(0),
+      m_stored(0),
+      m_evicted(0)
+{
+}
+
+tls_session_cache::~tls_session_cache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_ctx_lock);
+        for (SSL_CTX* ctx : m_attached) {
+            if (from(ctx) == this) {
+                ::SSL_CTX_set_ex_data(ctx, ctx_cache_index(), nullptr);
+            }
+            ::SSL_CTX_free(ctx);
+        }
+        m_attached.clear();
+    }
+    this->clear();
+}
+
+int tls_session_cache::ssl_key_index()
+{
+    static int index = ::SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &free_ssl_key);
+    return index;
+}
+
+int tls_session_cache::ctx_cache_index()
+{
+    static int index = ::SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+std::string tls_session_cache::make_key(const std::string& host, int port)
+{
+    return host + ':' + std::to_string(port);
+}
+
+void tls_session_cache::attach(boost::asio::ssl::context& ctx)
+{
+    SSL_CTX* native = ctx.native_handle();
+    // NOTE 不使用 openssl 内部的 session 缓存(服务端用的)；由 new_session 回调接管
+    ::SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    ::SSL_CTX_sess_set_new_cb(native, &tls_session_cache::on_new_session);
+    ::SSL_CTX_set_ex_data(native, ctx_cache_index(), this);
+
+    std::lock_guard<std::mutex> lock(m_ctx_lock);
+    // 持有一份引用，以免 context 先于本对象析构
+    ::SSL_CTX_up_ref(native);
+    m_attached.push_back(native);
+}
+
+void tls_session_cache::detach(boost::asio::ssl::context& ctx)
+{
+    SSL_CTX* native = ctx.native_handle();
+    if (from(native) == this) {
+        ::SSL_CTX_sess_set_new_cb(native, nullptr);
+        ::SSL_CTX_set_ex_data(native, ctx_cache_index(), nullptr);
+    }
+
+    std::lock_guard<std::mutex> lock(m_ctx_lock);
+    for (auto it = m_attached.begin(); it != m_attached.end(); ++it) {
+        if (*it == native) {
+            ::SSL_CTX_free(native);
+            m_attached.erase(it);
+            break;
+        }
+    }
+}
+
+tls_session_cache* tls_session_cache::from(SSL_CTX* ctx)
+{
+    return ctx ? static_cast<tls_session_cache*>(::SSL_CTX_get_ex_data(ctx, ctx_cache_index()))
+               : nullptr;
+}
+
+bool tls_session_cache::prepare(SSL* ssl, const std::string& host, int port)
+{
+    if (!::SSL_set_tlsext_host_name(ssl, host.c_str())) {
+        return false;
+    }
+
+    std::string* p_key = static_cast<std::string*>(::SSL_get_ex_data(ssl, ssl_key_index()));
+    if (p_key) {
+        *p_key = make_key(host, port);
+    }
+    else {
+        p_key = new std::string(make_key(host, port));
+        ::SSL_set_ex_data(ssl, ssl_key_index(), p_key);
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_entries.find(*p_key);
+    if (it == m_entries.end()) {
+        return true;
+    }
+    if (!::SSL_SESSION_is_resumable(it->second.sess)) {
+        ::SSL_SESSION_free(it->second.sess);
+        m_lru.erase(it->second.pos);
+        m_entries.erase(it);
+        return true;
+    }
+    if (::SSL_set_session(ssl, it->second.sess)) {
+        ++m_offered;
+    }
+    return true;
+}
+
+void tls_session_cache::on_handshake(SSL* ssl)
+{
+    ++m_handshakes;
+    if (::SSL_session_reused(ssl)) {
+        ++m_resumed;
+    }
+}
+
+int tls_session_cache::on_new_session(SSL* ssl, SSL_SESSION* sess)
+{
+    tls_session_cache* self = from(::SSL_get_SSL_CTX(ssl));
+    std::string* p_key = static_cast<std::string*>(::SSL_get_ex_data(ssl, ssl_key_index()));
+    if (!self || !p_key) {
+        return 0;
+    }
+    // NOTE 保存一份副本：连接没有经过 SSL_shutdown 就释放时(比如服务端直接
+    // 关闭了连接)，openssl 会把当前 session 标记为不可复用；副本不受影响。
+    SSL_SESSION* copy = ::SSL_SESSION_dup(sess);
+    if (copy) {
+        self->store(*p_key, copy);
+    }
+    // 返回0，sess 仍由 openssl 管理
+    return 0;
+}
+
+void tls_session_cache::store(const std::string& key, SSL_SESSION* sess)
+{
+    COLOG_DEBUG(SSS_VALUE_MSG(key));
+    std::lock_guard<std::mutex> lock(m_lock);
+    ++m_stored;
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        ::SSL_SESSION_free(it->second.sess);
+        it->second.sess = sess;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.pos);
+        return;
+    }
+
+    m_lru.push_front(key);
+    entry_t entry;
+    entry.sess = sess;
+    entry.pos  = m_lru.begin();
+    m_entries.insert(std::make_pair(key, entry));
+
+    while (m_entries.size() > m_max_entries && !m_lru.empty()) {
+        auto victim = m_entries.find(m_lru.back());
+        ::SSL_SESSION_free(victim->second.sess);
+        m_entries.erase(victim);
+        m_lru.pop_back();
+        ++m_evicted;
+    }
+}
+
+void tls_session_cache::remove(const std::string& host, int port)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_entries.find(make_key(host, port));
+    if (it == m_entries.end()) {
+        return;
+    }
+    ::SSL_SESSION_free(it->second.sess);
+    m_lru.erase(it->second.pos);
+    m_entries.erase(it);
+}
+
+void tls_session_cache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto& item : m_entries) {
+        ::SSL_SESSION_free(item.second.sess);
+    }
+    m_entries.clear();
+    m_lru.clear();
+}
+
+size_t tls_session_cache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_entries.size();
+}
+
+tls_session_cache::stats_t tls_session_cache::stats() const
+{
+    stats_t s;
+    s.handshakes = m_handshakes;
+    s.offered    = m_offered;
+    s.resumed    = m_resumed;
+    s.stored     = m_stored;
+    s.evicted    = m_evicted;
+    return s;
+}
+
+boost::asio::ssl::context& tls_session_cache::shared_context()
+{
+    return shared_tls().ctx;
+}
+
+tls_session_cache& tls_session_cache::shared_cache()
+{
+    return shared_tls().cache;
+}
+
+} // namespace asio
+} // namespace ss1x
@@ -0,0 +1,121 @@
+// ss1x/asio/tls_session_cache.hpp
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <boost/asio/ssl.hpp>
+
+namespace ss1x {
+namespace asio {
+
+// NOTE 客户端 TLS session 缓存
+//
+// 挂接(attach)到某个 ssl::context 之后，经由该 context 完成的握手，服务端
+// 下发的 session(TLS1.2 session id / TLS1.3 ticket)，都会按 "host:port"
+// 记录下来；下次对同一 "host:port" 建链时，prepare() 把它交给 SSL 对象，
+// 于是可以走简化握手，省掉证书链的传输与校验，以及密钥交换。
+//
+// 各个成员函数都是线程安全的。
+class tls_session_cache
+{
+public:
+    struct stats_t
+    {
+        uint64_t handshakes; // 完成的握手次数
+        uint64_t offered;    // 握手前，提供了缓存 session 的次数
+        uint64_t resumed;    // 服务端接受了 session，简化握手的次数
+        uint64_t stored;     // 收到的新 session 数
+        uint64_t evicted;    // 因容量被淘汰的 session 数
+
+        // resumed / handshakes
+        double hit_rate() const
+        {
+            return handshakes ? double(resumed) / double(handshakes) : 0.0;
+        }
+    };
+
+    static const size_t default_max_entries = 256;
+
+    explicit tls_session_cache(size_t max_entries = default_max_entries);
+    ~tls_session_cache();
+
+    tls_session_cache(const tls_session_cache&) = delete;
+    tls_session_cache& operator=(const tls_session_cache&) = delete;
+
+public:
+    /**
+     * @brief 在 ctx 上打开客户端 session 缓存，并把新 session 记到本对象中
+     *
+     * 一个 context 同时只能挂接一个缓存；本对象析构时，自动解除挂接。
+     */
+    void attach(boost::asio::ssl::context& ctx);
+    void detach(boost::asio::ssl::context& ctx);
+
+    // context 上挂接的缓存；没有则返回 nullptr
+    static tls_session_cache* from(SSL_CTX* ctx);
+
+    /**
+     * @brief 握手之前调用：设置 SNI，并提供该 host:port 上次的 session
+     *
+     * @return false if SNI could not be set
+     */
+    bool prepare(SSL* ssl, const std::string& host, int port);
+
+    // 握手成功之后调用，用于统计
+    void on_handshake(SSL* ssl);
+
+    // 握手失败，或者服务端拒绝了session时，删除该 host:port 的记录
+    void remove(const std::string& host, int port);
+
+    void   clear();
+    size_t size() const;
+
+    stats_t stats() const;
+
+    size_t max_entries() const      { return m_max_entries; }
+    void   max_entries(size_t max)  { m_max_entries = max;  }
+
+    // 进程级的默认客户端 context；设置了系统默认证书路径，并挂接了默认缓存
+    static boost::asio::ssl::context& shared_context();
+    static tls_session_cache&         shared_cache();
+
+private:
+    static std::string make_key(const std::string& host, int port);
+
+    static int  on_new_session(SSL* ssl, SSL_SESSION* sess);
+    void        store(const std::string& key, SSL_SESSION* sess);
+
+    static int  ssl_key_index();
+    static int  ctx_cache_index();
+
+    typedef std::list<std::string> lru_list_t;
+    struct entry_t
+    {
+        SSL_SESSION*         sess;
+        lru_list_t::iterator pos;
+    };
+    typedef std::map<std::string, entry_t> entry_map_t;
+
+    mutable std::mutex    m_lock;
+    entry_map_t           m_entries;
+    // front: most recently stored
+    lru_list_t            m_lru;
+    size_t                m_max_entries;
+
+    std::atomic<uint64_t> m_handshakes;
+    std::atomic<uint64_t> m_offered;
+    std::atomic<uint64_t> m_resumed;
+    std::atomic<uint64_t> m_stored;
+    std::atomic<uint64_t> m_evicted;
+
+    std::mutex            m_ctx_lock;
+    std::list<SSL_CTX*>   m_attached;
+};
+
+} // namespace asio
+} // namespace ss1x